@@ -1,6 +1,15 @@
 #ifndef BMS_MAIN_H
 #define BMS_MAIN_H
 
+#include "capture_recorder.h"
+#include "tx_queue.h"
+
 void bms_setup();
 
+// Queue in front of the UART that carries everything sent to the board.
+const TxQueue &getTxQueue();
+
+// The latest BMS traffic, served at /capture.
+CaptureRecorder &getCaptureRecorder();
+
 #endif /* BMS_MAIN_H */
\ No newline at end of file
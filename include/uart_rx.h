@@ -0,0 +1,21 @@
+#ifndef UART_RX_H
+#define UART_RX_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Replaces HardwareSerial's UART0 receive interrupt with one that moves every
+// byte into a lock-free ring right away, together with the time it arrived.
+// Serial.begin() has to be called first, Serial.read() gets nothing after.
+void uartRxBegin(unsigned long baud);
+
+// Moves up to maxLen received bytes into buffer, never blocks.
+size_t uartRxRead(uint8_t *buffer, size_t maxLen);
+
+// micros() when the first byte returned by the last uartRxRead() arrived.
+unsigned long uartRxLastReadMicros();
+
+// Bytes lost to a full ring or hardware FIFO overflow since the last call.
+uint32_t uartRxTakeDroppedBytes();
+
+#endif  // UART_RX_H
@@ -1,39 +1,19 @@
 #include "battery_fuel_gauge.h"
 
-#include <cmath>
+#include <algorithm>
 
 #include "defer.h"
+#include "ocv_table.h"
 
 namespace {
 
-template <class T>
-inline T clamp(T x, T lower, T upper) {
-  return std::min(upper, std::max(x, lower));
-}
+typedef OcvTable<DefaultOcvCurve> DefaultOcvTable;
+// 1.5KB, kept in flash rather than RAM.
+constexpr DefaultOcvTable::Table DEFAULT_OCV_TABLE PROGMEM =
+    DefaultOcvTable::generate();
 
 int32_t openCircuitSocFromCellVoltage(int32_t cellVoltageMillivolts) {
-  static constexpr int LOOKUP_TABLE_RANGE_MIN_MV = 2700;
-  static constexpr int LOOKUP_TABLE_RANGE_MAX_MV = 4200;
-  static uint8_t LOOKUP_TABLE[31] = {0,  0,  0,  0,  1,  2,  3,  4,  5,  7,  8,
-                                     11, 14, 16, 18, 19, 25, 30, 33, 37, 43, 48,
-                                     53, 60, 67, 71, 76, 82, 92, 97, 100};
-  static constexpr int32_t LOOKUP_TABLE_SIZE =
-      (sizeof(LOOKUP_TABLE) / sizeof(*LOOKUP_TABLE));
-  static constexpr int32_t RANGE =
-      LOOKUP_TABLE_RANGE_MAX_MV - LOOKUP_TABLE_RANGE_MIN_MV;
-  // (RANGE - 1) upper limit effectively clamps the leftIndex below to
-  // (LOOKUP_TABLE_SIZE - 2)
-  cellVoltageMillivolts =
-      clamp(cellVoltageMillivolts - LOOKUP_TABLE_RANGE_MIN_MV, 0, RANGE - 1);
-  float floatIndex =
-      float(cellVoltageMillivolts) * (LOOKUP_TABLE_SIZE - 1) / RANGE;
-  const int32_t leftIndex = int(floatIndex);
-  const float fractional = floatIndex - leftIndex;
-  const int32_t rightIndex = leftIndex + 1;
-  const int32_t leftValue = LOOKUP_TABLE[leftIndex];
-  const int32_t rightValue = LOOKUP_TABLE[rightIndex];
-  return clamp<int32_t>(
-      leftValue + round((rightValue - leftValue) * fractional), 0, 100);
+  return DefaultOcvTable::socPercent(DEFAULT_OCV_TABLE, cellVoltageMillivolts);
 }
 
 }  // namespace
@@ -41,9 +21,14 @@ int32_t openCircuitSocFromCellVoltage(int32_t cellVoltageMillivolts) {
 void BatteryFuelGauge::updateVoltage(int32_t voltageMillivolts,
                                      int32_t nowMillis) {
   voltage_millivolts_ = voltageMillivolts;
-  filtered_voltage_millivolts_.step(voltageMillivolts);
-  voltage_based_soc_ =
-      openCircuitSocFromCellVoltage(filtered_voltage_millivolts_.get());
+  filtered_voltage_millivolts_.step(voltageMillivolts, nowMillis);
+  // The filtered voltage mostly sits still at millivolt resolution, no need
+  // to redo the lookup then.
+  const int32_t filteredMillivolts = filtered_voltage_millivolts_.get();
+  if (filteredMillivolts != soc_lookup_millivolts_) {
+    soc_lookup_millivolts_ = filteredMillivolts;
+    voltage_based_soc_ = openCircuitSocFromCellVoltage(filteredMillivolts);
+  }
   // If we're at the lowest Ah discharge we've seen, use voltage to set the
   // bottom SOC to the current level of charge.
   if (state_.currentMilliampSeconds == state_.bottomMilliampSeconds) {
@@ -140,7 +125,13 @@ int32_t BatteryFuelGauge::getSoc() const {
   if (state_.bottomMilliampSeconds == 0) {
     return state_.topSoc;
   }
-  return state_.topSoc - (state_.topSoc - state_.bottomSoc) *
-                             ((float)(state_.currentMilliampSeconds)) /
-                             ((float)(state_.bottomMilliampSeconds));
+  // Integer math with the result rounded to the nearest percent, 64 bits as
+  // a full charge is around 10^7 mAs. The gauge keeps topSoc >= bottomSoc so
+  // nothing here is negative.
+  const int64_t numerator =
+      (int64_t)(state_.topSoc - state_.bottomSoc) *
+      state_.currentMilliampSeconds;
+  const int64_t denominator = state_.bottomMilliampSeconds;
+  return state_.topSoc - (int32_t)((2 * numerator + denominator) /
+                                   (2 * denominator));
 }
\ No newline at end of file
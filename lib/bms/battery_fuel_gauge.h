@@ -19,6 +19,13 @@ struct FuelGaugeState {
   int32_t bottomSoc = 0;
 };
 
+// 400s low pass period, the sample rate adapts to the voltage messages.
+struct CellVoltageFilterDesign {
+  static constexpr double CUTOFF_HZ = 0.0025;
+  static constexpr double SAMPLE_RATE_HZ = 1;
+  static constexpr int32_t MAX_INPUT = 8192;
+};
+
 /**
  * Assumes that the class gets to see all of the energy going into and out of
  * the battery.
@@ -50,8 +57,11 @@ class BatteryFuelGauge {
   void onHighestDischarge();
 
   int32_t voltage_millivolts_ = -1;
-  LowPassFilter filtered_voltage_millivolts_;
+  AdaptiveLowPassFilter<CellVoltageFilterDesign, 16, 125, 24>
+      filtered_voltage_millivolts_;
   int32_t voltage_based_soc_ = -1;
+  // Filtered voltage voltage_based_soc_ was looked up for.
+  int32_t soc_lookup_millivolts_ = -1;
   int32_t last_current_update_time_millis_ = -1;
   int32_t milliamp_seconds_discharged_ = 0;
   int32_t milliamp_seconds_recharged_ = 0;
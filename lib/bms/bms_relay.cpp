@@ -1,12 +1,48 @@
 #include "bms_relay.h"
 
+#include <array>
 #include <cstring>
 #include <limits>
 
+#include "bms_relay_core.h"
 #include "packet.h"
 
 namespace {
-const uint8_t PREAMBLE[] = {0xFF, 0x55, 0xAA};
+constexpr size_t PREAMBLE_LENGTH = 3;
+
+// KMP failure function of the preamble: element i is the length of the
+// longest proper prefix of preamble[0..i] that is also a suffix of it.
+constexpr std::array<uint8_t, PREAMBLE_LENGTH> preambleFailureTable(
+    const uint8_t* preamble) {
+  std::array<uint8_t, PREAMBLE_LENGTH> failure{};
+  uint8_t k = 0;
+  for (size_t i = 1; i < PREAMBLE_LENGTH; i++) {
+    while (k > 0 && preamble[i] != preamble[k]) {
+      k = failure[k - 1];
+    }
+    if (preamble[i] == preamble[k]) {
+      k++;
+    }
+    failure[i] = k;
+  }
+  return failure;
+}
+
+// Given that the last `matched` bytes seen are the beginning of the preamble,
+// returns how many of the last bytes are after seeing b.
+uint8_t preambleMatchAfter(const uint8_t* preamble,
+                           const std::array<uint8_t, PREAMBLE_LENGTH>& failure,
+                           uint8_t matched, uint8_t b) {
+  while (true) {
+    if (matched < PREAMBLE_LENGTH && preamble[matched] == b) {
+      return matched + 1;
+    }
+    if (matched == 0) {
+      return 0;
+    }
+    matched = failure[matched - 1];
+  }
+}
 
 unsigned long packetTypeRebroadcastTimeout(int type) {
   if (type == 0 || type == 5) {
@@ -23,104 +59,166 @@ unsigned long packetTypeRebroadcastTimeout(int type) {
 
 BmsRelay::BmsRelay(const Source& source, const Sink& sink,
                    const MillisProvider& millis)
-    : source_(source), sink_(sink), millis_provider_(millis) {
-  sourceBuffer_.reserve(64);
-}
+    : BmsRelay(
+          [source](uint8_t* buffer, size_t maxLen) {
+            size_t len = 0;
+            while (len < maxLen) {
+              const int byte = source();
+              if (byte < 0) {
+                break;
+              }
+              buffer[len++] = byte;
+            }
+            return len;
+          },
+          sink, millis) {}
+
+BmsRelay::BmsRelay(const BulkSource& source, const Sink& sink,
+                   const MillisProvider& millis)
+    : BmsRelay(
+          source,
+          [sink](const uint8_t* data, size_t len) {
+            for (size_t i = 0; i < len; i++) {
+              sink(data[i]);
+            }
+          },
+          millis) {}
+
+BmsRelay::BmsRelay(const BulkSource& source, const PacketSink& sink,
+                   const MillisProvider& millis)
+    : source_(source), sink_(sink), millis_provider_(millis) {}
+
+// The std::function based relay is just another instantiation of the byte
+// path, one that can be set up at runtime.
+namespace {
+struct FunctionClock {
+  const BmsRelay::MillisProvider& millis_provider;
+  const BmsRelay::MicrosProvider& micros_provider;
+
+  unsigned long millis() const { return millis_provider(); }
+  unsigned long micros() const { return micros_provider(); }
+  bool hasMicros() const { return (bool)micros_provider; }
+};
+}  // namespace
 
 void BmsRelay::loop() {
-  while (true) {
-    int byte = source_();
-    now_millis_ = millis_provider_();
-    if (byte < 0) {
-      maybeReplayPackets();
-      return;
-    }
-    sourceBuffer_.push_back(byte);
-    processNextByte();
-  }
+  FunctionClock clock{millis_provider_, micros_provider_};
+  run(source_, sink_, clock);
 }
 
-void BmsRelay::maybeReplayPackets() {
-  for (const IndividualPacketStat& stat :
-       packet_tracker_.getIndividualPacketStats()) {
-    if (stat.total_num < 1) {
-      continue;
-    }
-    if ((now_millis_ - stat.last_packet_millis) <
-        packetTypeRebroadcastTimeout(stat.id)) {
-      continue;
+void BmsRelay::onUnknownData(const uint8_t* data, size_t len) {
+  if (unknownDataCallback_) {
+    for (size_t i = 0; i < len; i++) {
+      unknownDataCallback_(data[i]);
     }
-    std::vector<uint8_t> data_copy(stat.last_seen_valid_packet);
-    Packet p(data_copy.data(), data_copy.size());
-    ingestPacket(p);
   }
+  packet_tracker_.unknownBytes(len);
+  bus_utilization_.unknownBytes(len);
+  if (capture_recorder_) {
+    capture_recorder_->record(captureMicros(rx_micros_),
+                              CAPTURE_UNKNOWN_DATA | CAPTURE_FORWARDED, data,
+                              len);
+  }
+  last_packet_end_valid_ = false;
 }
 
-void BmsRelay::purgeUnknownData() {
-  for (uint8_t b : sourceBuffer_) {
-    sink_(b);
+uint8_t BmsRelay::resyncDiscardLength() {
+  static_assert(sizeof(PREAMBLE) == PREAMBLE_LENGTH, "Preamble length");
+  static constexpr std::array<uint8_t, PREAMBLE_LENGTH> PREAMBLE_FAILURE =
+      preambleFailureTable(PREAMBLE);
+  // Everything before the last byte matched the preamble so far.
+  const uint8_t matched = sourceBufferLen_ - 1;
+  // A stray 0xFF is common noise, two or more matching bytes most likely
+  // were a real packet that got mangled on the wire.
+  if (matched >= 2) {
+    packet_tracker_.partialPacketDiscarded();
   }
-  if (unknownDataCallback_) {
-    for (uint8_t b : sourceBuffer_) {
-      unknownDataCallback_(b);
-    }
-  }
-  packet_tracker_.unknownBytes(sourceBuffer_.size());
-  sourceBuffer_.clear();
+  // Keep the longest tail that could still be the start of a packet.
+  const uint8_t keep = preambleMatchAfter(PREAMBLE, PREAMBLE_FAILURE, matched,
+                                          sourceBuffer_[sourceBufferLen_ - 1]);
+  return sourceBufferLen_ - keep;
 }
 
-// Called with every new byte.
-void BmsRelay::processNextByte() {
-  // If up to first three bytes of the sourceBuffer don't match expected
-  // preamble, flush the data unchanged.
-  for (unsigned int i = 0; i < std::min(sizeof(PREAMBLE), sourceBuffer_.size());
-       i++) {
-    if (sourceBuffer_[i] != PREAMBLE[i]) {
-      purgeUnknownData();
-      return;
+void BmsRelay::discardFromSourceBuffer(uint8_t len) {
+  const uint8_t keep = sourceBufferLen_ - len;
+  memmove(sourceBuffer_, sourceBuffer_ + len, keep);
+  sourceBufferLen_ = keep;
+  resynchronized_ = keep > 0;
+  packet_start_micros_ = rx_micros_;
+}
+
+bool BmsRelay::ingestBufferedPacket() {
+  Packet p(sourceBuffer_, sourceBufferLen_);
+  if (resynchronized_ && p.isValid()) {
+    packet_tracker_.packetRecoveredByResync();
+  }
+  resynchronized_ = false;
+  if (track_latency_) {
+    if (last_packet_end_valid_) {
+      // Both ends are estimates, they can cross for back to back packets.
+      const int32_t gap = packet_start_micros_ - last_packet_end_micros_;
+      bus_utilization_.idleGap(gap > 0 ? gap : 0);
     }
+    // Assuming the packet's bytes came in back to back.
+    last_packet_end_micros_ =
+        packet_start_micros_ + sourceBufferLen_ * TxScheduler::BYTE_MICROS;
+    last_packet_end_valid_ = true;
   }
-  // Check if we have the message type.
-  if (sourceBuffer_.size() < 4) {
-    return;
+  const unsigned long rxMicros = captureMicros(packet_start_micros_);
+  if (capture_recorder_) {
+    capture_recorder_->record(rxMicros, 0, sourceBuffer_, sourceBufferLen_);
   }
-  uint8_t type = sourceBuffer_[3];
-  if (type >= sizeof(PACKET_LENGTHS_BY_TYPE) ||
-      PACKET_LENGTHS_BY_TYPE[type] < 0) {
-    purgeUnknownData();
-    return;
+  const bool forward = ingestPacket(p);
+  // Cut through packets are out already, swallowed or not.
+  if (capture_recorder_ && (forward || cutting_through_)) {
+    if (cutting_through_ ||
+        capture_recorder_->lastRecordMatches(sourceBuffer_, sourceBufferLen_)) {
+      capture_recorder_->addFlagsToLast(CAPTURE_FORWARDED);
+    } else {
+      // Stamped with the time of the packet it replaces.
+      capture_recorder_->record(rxMicros, CAPTURE_TO_MB | CAPTURE_MODIFIED,
+                                sourceBuffer_, sourceBufferLen_);
+    }
   }
-  uint8_t len = PACKET_LENGTHS_BY_TYPE[type];
-  if (sourceBuffer_.size() < len) {
-    return;
+  if (!forward && !cutting_through_) {
+    bus_utilization_.swallowedBytes(sourceBufferLen_);
   }
-  Packet p(sourceBuffer_.data(), len);
-  ingestPacket(p);
-  sourceBuffer_.clear();
+  return forward;
+}
+
+void BmsRelay::captureReplay(const Packet& p) {
+  capture_recorder_->record(captureMicros(now_micros_),
+                            CAPTURE_TO_MB | CAPTURE_REPLAYED, p.start(),
+                            p.len());
+}
+
+void BmsRelay::onFirstByteForwarded(uint8_t type, unsigned long nowMicros) {
+  packet_tracker_.forwardingLatency(type, nowMicros - packet_start_micros_);
 }
 
-void BmsRelay::ingestPacket(Packet& p) {
-  packet_tracker_.processPacket(p, now_millis_);
-  for (auto& callback : receivedPacketCallbacks_) {
-    callback(this, &p);
-  };
-  bmsStatusParser(p);
-  bmsSerialParser(p);
-  currentParser(p);
-  batteryPercentageParser(p);
-  cellVoltageParser(p);
-  temperatureParser(p);
-  //  Recalculate CRC so that logging callbacks see the correct CRCs
-  p.recalculateCrcIfValid();
-  if (p.shouldForward()) {
-    for (auto& callback : forwardedPacketCallbacks_) {
-      callback(this, &p);
+void BmsRelay::onLastByteForwarded(uint8_t type, unsigned long nowMicros) {
+  packet_tracker_.relayLatency(type, nowMicros - packet_start_micros_);
+}
+
+bool BmsRelay::ingestPacket(Packet& p) {
+  p.setChanged(packet_tracker_.processPacket(p, now_millis_));
+  if (p.isValid()) {
+    const unsigned long timeout = packetTypeRebroadcastTimeout(p.getType());
+    if (timeout != std::numeric_limits<unsigned long>::max()) {
+      tx_scheduler_.schedule(p.getType(), now_millis_ + timeout);
     }
   }
-  p.recalculateCrcIfValid();
-  if (p.shouldForward()) {
-    for (int i = 0; i < p.len(); i++) {
-      sink_(p.start()[i]);
-    }
+  receivedPacketCallbacks_.call(this, &p);
+  if (p.isChanged()) {
+    changedPacketCallbacks_.call(this, &p);
   }
-}
\ No newline at end of file
+  parsePacket(p);
+  // Parsers patch the checksum as they write so the packet is consistent at
+  // this point. Callbacks writing through Packet::data() have to call
+  // recalculateCrcIfValid() themselves.
+  if (!p.shouldForward()) {
+    return false;
+  }
+  forwardedPacketCallbacks_.call(this, &p);
+  return true;
+}
@@ -1,15 +1,17 @@
 #ifndef BMS_RELAY_H
 #define BMS_RELAY_H
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <limits>
-#include <vector>
 
 #include "battery_fuel_gauge.h"
+#include "bus_utilization.h"
+#include "capture_recorder.h"
+#include "packet.h"
 #include "packet_tracker.h"
-
-class Packet;
+#include "tx_scheduler.h"
 
 class BmsRelay {
  public:
@@ -18,37 +20,99 @@ class BmsRelay {
    * value when there's no data available on the wire.
    */
   typedef std::function<int()> Source;
+  /**
+   * @brief Function polled for all of the data currently available from the
+   * BMS. Copies up to maxLen bytes into the buffer and returns the number of
+   * bytes copied, 0 when there's no data available on the wire.
+   */
+  typedef std::function<size_t(uint8_t* buffer, size_t maxLen)> BulkSource;
   /**
    * @brief Function called to send data to the MB.
    */
   typedef std::function<void(uint8_t)> Sink;
+  /**
+   * @brief Function called to send data to the MB, a whole packet or as much
+   * of it as is available at a time.
+   */
+  typedef std::function<void(const uint8_t* data, size_t len)> PacketSink;
 
   /**
-   * @brief Packet callback.
+   * @brief Packet callback. A plain function pointer so that calling it on
+   * every packet doesn't go through std::function.
    */
-  typedef std::function<void(BmsRelay*, Packet*)> PacketCallback;
+  typedef void (*PacketCallback)(BmsRelay*, Packet*);
 
   typedef std::function<unsigned long()> MillisProvider;
+  typedef std::function<unsigned long()> MicrosProvider;
 
   BmsRelay(const Source& source, const Sink& sink,
            const MillisProvider& millisProvider);
+  BmsRelay(const BulkSource& source, const Sink& sink,
+           const MillisProvider& millisProvider);
+  BmsRelay(const BulkSource& source, const PacketSink& sink,
+           const MillisProvider& millisProvider);
+  virtual ~BmsRelay() = default;
 
   /**
    * @brief All of the data ingestion, processing and forwarding is done here.
    * Must be called continuously from arduino loop.
    */
-  void loop();
+  virtual void loop();
+
+  /**
+   * @return false if all of MAX_PACKET_CALLBACKS slots are taken.
+   */
+  bool addReceivedPacketCallback(PacketCallback callback) {
+    return receivedPacketCallbacks_.add(callback);
+  }
 
-  void addReceivedPacketCallback(const PacketCallback& callback) {
-    receivedPacketCallbacks_.push_back(callback);
+  /**
+   * @return false if all of MAX_PACKET_CALLBACKS slots are taken.
+   */
+  bool addForwardedPacketCallback(PacketCallback callback) {
+    return forwardedPacketCallbacks_.add(callback);
   }
 
-  void addForwardedPacketCallback(const PacketCallback& callback) {
-    forwardedPacketCallbacks_.push_back(callback);
+  /**
+   * @brief Like addReceivedPacketCallback() but only called for packets that
+   * differ from the previous packet of their type, see Packet::isChanged().
+   * Meant for consumers that only care about new data, e.g. displays.
+   *
+   * @return false if all of MAX_PACKET_CALLBACKS slots are taken.
+   */
+  bool addChangedPacketCallback(PacketCallback callback) {
+    return changedPacketCallbacks_.add(callback);
   }
 
   void setUnknownDataCallback(const Sink& c) { unknownDataCallback_ = c; }
 
+  /**
+   * @brief When enabled, packets of types that the relay never rewrites or
+   * swallows are streamed to the sink as their bytes arrive instead of after
+   * the whole packet has been received. Packet callbacks still see the
+   * complete packet afterwards, but they can no longer stop such packets
+   * from being forwarded.
+   */
+  void setCutThroughForwarding(bool enabled) { cut_through_enabled_ = enabled; }
+
+  /**
+   * @brief Optional, enables per packet type forwarding latency tracking
+   * in the PacketTracker. Not used by BmsRelayCore, which gets the time from
+   * its clock policy.
+   */
+  void setMicrosProvider(const MicrosProvider& micros) {
+    micros_provider_ = micros;
+  }
+
+  /**
+   * @brief Optional, records packets as received, what was forwarded,
+   * rewritten or replayed, and unknown data. Times are micros when latency
+   * tracking is on, millis * 1000 otherwise.
+   */
+  void setCaptureRecorder(CaptureRecorder* recorder) {
+    capture_recorder_ = recorder;
+  }
+
   /**
    * @brief If set to non-zero value, spoofs captured BMS serial
    * with the number provided here. The serial number can be found
@@ -113,21 +177,101 @@ class BmsRelay {
 
   const PacketTracker& getPacketTracker() const { return packet_tracker_; }
 
+  const BusUtilization& getBusUtilization() const { return bus_utilization_; }
+
   BatteryFuelGauge& getBatteryFuelGauge() { return battery_fuel_gauge_; }
 
+ protected:
+  // For BmsRelayCore, which brings its own source, sink and clock.
+  BmsRelay() {}
+
+  /**
+   * @brief Body of loop(), templated on the source, sink and clock so that
+   * the whole byte path can be inlined for them. Defined in
+   * bms_relay_core.h, see BmsRelayCore for what the types have to provide.
+   */
+  template <class SourceT, class SinkT, class ClockT>
+  void run(SourceT& source, SinkT& sink, ClockT& clock);
+
  private:
   // BMS current units to milliamps.
   static constexpr int CURRENT_SCALER = 55;
-  void processNextByte();
-  void purgeUnknownData();
-  void maybeReplayPackets();
-  void ingestPacket(Packet& p);
+  // Bytes pulled from the source per call.
+  static constexpr size_t SOURCE_CHUNK_SIZE = 64;
+  static constexpr uint8_t PREAMBLE[] = {0xFF, 0x55, 0xAA};
+
+  // Parts of the byte path that talk to the sink or the clock.
+  template <class SinkT, class ClockT>
+  void processBytes(SinkT& sink, ClockT& clock, const uint8_t* data,
+                    size_t len);
+  template <class SinkT, class ClockT>
+  void processNextByte(SinkT& sink, ClockT& clock, uint8_t b);
+  template <class SinkT, class ClockT>
+  void onPacketComplete(SinkT& sink, ClockT& clock);
+  // Every byte to the MB goes through here.
+  template <class SinkT>
+  void send(SinkT& sink, const uint8_t* data, size_t len) {
+    sink(data, len);
+    bus_utilization_.bytesOut(len);
+  }
+  template <class SinkT>
+  void forwardUnknownData(SinkT& sink, const uint8_t* data, size_t len);
+  template <class SinkT>
+  void resynchronize(SinkT& sink);
+  template <class SinkT>
+  void maybeReplayPackets(SinkT& sink);
+
+  // Everything else, shared by all instantiations.
+  void onUnknownData(const uint8_t* data, size_t len);
+  // Returns how many bytes from the front of sourceBuffer_ have to go.
+  uint8_t resyncDiscardLength();
+  void discardFromSourceBuffer(uint8_t len);
+  void onLastByteForwarded(uint8_t type, unsigned long nowMicros);
+  // Returns true if the packet in sourceBuffer_ should be forwarded.
+  bool ingestBufferedPacket();
+  // Returns true if the packet should be forwarded.
+  bool ingestPacket(Packet& p);
+  void onFirstByteForwarded(uint8_t type, unsigned long nowMicros);
+  unsigned long captureMicros(unsigned long micros) const {
+    return track_latency_ ? micros : now_millis_ * 1000UL;
+  }
+  void captureReplay(const Packet& p);
+  // True for packet types whose parser might modify or swallow them.
+  static bool isRewrittenPacketType(uint8_t type);
+
+  static constexpr uint8_t MAX_PACKET_CALLBACKS = 4;
+  class PacketCallbackList {
+   public:
+    bool add(PacketCallback callback) {
+      if (size_ >= MAX_PACKET_CALLBACKS) {
+        return false;
+      }
+      callbacks_[size_++] = callback;
+      return true;
+    }
+    void call(BmsRelay* relay, Packet* packet) const {
+      for (uint8_t i = 0; i < size_; i++) {
+        callbacks_[i](relay, packet);
+      }
+    }
+
+   private:
+    PacketCallback callbacks_[MAX_PACKET_CALLBACKS];
+    uint8_t size_ = 0;
+  };
 
-  std::vector<PacketCallback> receivedPacketCallbacks_;
-  std::vector<PacketCallback> forwardedPacketCallbacks_;
+  PacketCallbackList receivedPacketCallbacks_;
+  PacketCallbackList changedPacketCallbacks_;
+  PacketCallbackList forwardedPacketCallbacks_;
   Sink unknownDataCallback_;
 
-  std::vector<uint8_t> sourceBuffer_;
+  uint8_t sourceBuffer_[MAX_PACKET_LENGTH];
+  uint8_t sourceBufferLen_ = 0;
+  // True if sourceBuffer_ starts with bytes kept by resynchronize().
+  bool resynchronized_ = false;
+  bool cut_through_enabled_ = false;
+  // True while the packet in sourceBuffer_ is being cut through.
+  bool cutting_through_ = false;
   uint32_t serial_override_ = 0;
   uint32_t captured_serial_ = 0;
   int16_t current_milliamps_ = 0;
@@ -136,22 +280,48 @@ class BmsRelay {
   int8_t overridden_soc_percent_ = -1;
   uint16_t cell_millivolts_[15] = {0};
   uint16_t total_voltage_millivolts_ = 0;
+  uint16_t min_cell_millivolts_ = 0;
 
   int8_t temperatures_celsius_[5] = {0};
   int8_t avg_temperature_celsius_ = 0;
   uint8_t last_status_byte_ = 0;
-  const Source source_;
-  const Sink sink_;
+  // Only used by the std::function based constructors.
+  const BulkSource source_;
+  const PacketSink sink_;
   const MillisProvider millis_provider_;
+  MicrosProvider micros_provider_;
+
   int32_t now_millis_;
+  // Last loop() that got anything from the source.
+  unsigned long last_rx_millis_ = 0;
+  bool track_latency_ = false;
+  unsigned long now_micros_ = 0;
+  // When the bytes currently being processed arrived, now_micros_ unless the
+  // source knows better.
+  unsigned long rx_micros_ = 0;
+  unsigned long packet_start_micros_ = 0;
+  // Estimated end of the last packet from the BMS, only valid if no unknown
+  // data followed it.
+  bool last_packet_end_valid_ = false;
+  unsigned long last_packet_end_micros_ = 0;
   PacketTracker packet_tracker_;
+  BusUtilization bus_utilization_;
+  CaptureRecorder* capture_recorder_ = nullptr;
+  // Replay deadlines by packet type, pushed back by every packet of the type.
+  TxScheduler tx_scheduler_;
   BatteryFuelGauge battery_fuel_gauge_;
 
+  // Packet type to parser dispatch table, defined next to the parsers in
+  // packet_parsers.cpp.
+  struct Parsers;
+  void parsePacket(Packet& p);
+
   void bmsStatusParser(Packet& p);
   void bmsSerialParser(Packet& p);
   void currentParser(Packet& p);
   void batteryPercentageParser(Packet& p);
   void cellVoltageParser(Packet& p);
+  void unchangedCellVoltageParser(Packet& p);
   void temperatureParser(Packet& p);
 };
 
@@ -0,0 +1,253 @@
+#ifndef BMS_RELAY_CORE_H
+#define BMS_RELAY_CORE_H
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "bms_relay.h"
+#include "packet.h"
+
+/**
+ * @brief BmsRelay with the source, sink and clock fixed at compile time, so
+ * that the whole byte path is compiled and inlined for them instead of going
+ * through std::function for every call.
+ *
+ * The policy types need to provide:
+ * - SourcePolicy: size_t operator()(uint8_t* buffer, size_t maxLen), with
+ *   the same contract as BmsRelay::BulkSource.
+ * - SinkPolicy: void operator()(const uint8_t* data, size_t len), with the
+ *   same contract as BmsRelay::PacketSink.
+ * - ClockPolicy: unsigned long millis(), unsigned long micros() and
+ *   bool hasMicros(). Forwarding latency is only tracked if hasMicros() is
+ *   true, micros() is never called otherwise.
+ *
+ * SourcePolicy may also provide, and the relay uses them if it does:
+ * - unsigned long receivedMicros(): when the first byte returned by the last
+ *   call arrived, in the clock's micros(). Latency is then measured from
+ *   there instead of from the start of loop().
+ * - uint32_t takeDroppedBytes(): bytes lost before the relay got to them
+ *   since the last call, counted in GlobalStats::total_rx_bytes_dropped.
+ *
+ * (The parameters can't be called Source and Sink, BmsRelay's typedefs of
+ * the same name would hide them inside of the class.)
+ */
+template <class SourcePolicy, class SinkPolicy, class ClockPolicy>
+class BmsRelayCore final : public BmsRelay {
+ public:
+  BmsRelayCore(SourcePolicy source, SinkPolicy sink, ClockPolicy clock)
+      : source_(std::move(source)),
+        sink_(std::move(sink)),
+        clock_(std::move(clock)) {}
+
+  void loop() override { run(source_, sink_, clock_); }
+
+ private:
+  SourcePolicy source_;
+  SinkPolicy sink_;
+  ClockPolicy clock_;
+};
+
+namespace bms_relay_core_internal {
+
+// Overloads for the optional SourcePolicy members, the int parameter makes
+// the first one preferred whenever it compiles.
+template <class SourceT>
+auto receivedMicros(SourceT& source, unsigned long, int)
+    -> decltype(source.receivedMicros()) {
+  return source.receivedMicros();
+}
+template <class SourceT>
+unsigned long receivedMicros(SourceT&, unsigned long fallback, long) {
+  return fallback;
+}
+
+template <class SourceT>
+auto takeDroppedBytes(SourceT& source, int)
+    -> decltype(source.takeDroppedBytes()) {
+  return source.takeDroppedBytes();
+}
+template <class SourceT>
+uint32_t takeDroppedBytes(SourceT&, long) {
+  return 0;
+}
+
+}  // namespace bms_relay_core_internal
+
+template <class SourceT, class SinkT, class ClockT>
+void BmsRelay::run(SourceT& source, SinkT& sink, ClockT& clock) {
+  // A single drain pass takes a tiny fraction of a millisecond, no point in
+  // asking the clock for every byte.
+  now_millis_ = clock.millis();
+  track_latency_ = clock.hasMicros();
+  if (track_latency_) {
+    now_micros_ = clock.micros();
+  }
+  bus_utilization_.update(now_millis_);
+  const uint32_t dropped =
+      bms_relay_core_internal::takeDroppedBytes(source, 0);
+  if (dropped > 0) {
+    packet_tracker_.rxBytesDropped(dropped);
+  }
+  uint8_t chunk[SOURCE_CHUNK_SIZE];
+  while (true) {
+    const size_t len = source(chunk, sizeof(chunk));
+    if (len == 0) {
+      maybeReplayPackets(sink);
+      return;
+    }
+    last_rx_millis_ = now_millis_;
+    bus_utilization_.bytesIn(len);
+    if (track_latency_) {
+      rx_micros_ =
+          bms_relay_core_internal::receivedMicros(source, now_micros_, 0);
+    }
+    processBytes(sink, clock, chunk, len);
+  }
+}
+
+template <class SinkT, class ClockT>
+void BmsRelay::processBytes(SinkT& sink, ClockT& clock, const uint8_t* data,
+                            size_t len) {
+  const uint8_t* const end = data + len;
+  while (data < end) {
+    if (cutting_through_) {
+      // Whatever we have of the rest of the packet goes out in one piece.
+      const uint8_t packetLen = PACKET_LENGTHS_BY_TYPE[sourceBuffer_[3]];
+      const uint8_t chunkLen =
+          std::min<size_t>(packetLen - sourceBufferLen_, end - data);
+      memcpy(sourceBuffer_ + sourceBufferLen_, data, chunkLen);
+      send(sink, data, chunkLen);
+      sourceBufferLen_ += chunkLen;
+      data += chunkLen;
+      if (sourceBufferLen_ == packetLen) {
+        onPacketComplete(sink, clock);
+      }
+      continue;
+    }
+    if (sourceBufferLen_ == 0) {
+      // Not inside of a packet, skip over everything that can't start one.
+      const uint8_t* packetStart =
+          (const uint8_t*)memchr(data, PREAMBLE[0], end - data);
+      if (packetStart == nullptr) {
+        packetStart = end;
+      }
+      if (packetStart != data) {
+        forwardUnknownData(sink, data, packetStart - data);
+        data = packetStart;
+        continue;
+      }
+    }
+    processNextByte(sink, clock, *data++);
+  }
+}
+
+// Called with every new byte.
+template <class SinkT, class ClockT>
+void BmsRelay::processNextByte(SinkT& sink, ClockT& clock, uint8_t b) {
+  if (sourceBufferLen_ == 0) {
+    packet_start_micros_ = rx_micros_;
+  }
+  sourceBuffer_[sourceBufferLen_++] = b;
+  // If up to first three bytes of the sourceBuffer don't match expected
+  // preamble, flush the data unchanged. Earlier bytes were checked on
+  // previous calls so only the new one needs a look.
+  if (sourceBufferLen_ <= sizeof(PREAMBLE)) {
+    if (b != PREAMBLE[sourceBufferLen_ - 1]) {
+      resynchronize(sink);
+    }
+    return;
+  }
+  const uint8_t type = sourceBuffer_[3];
+  if (sourceBufferLen_ == sizeof(PREAMBLE) + 1) {
+    // Just got the message type.
+    if (type >= sizeof(PACKET_LENGTHS_BY_TYPE) ||
+        PACKET_LENGTHS_BY_TYPE[type] < 0) {
+      resynchronize(sink);
+      return;
+    }
+    if (cut_through_enabled_ && !isRewrittenPacketType(type)) {
+      // processBytes() takes it from here.
+      cutting_through_ = true;
+      send(sink, sourceBuffer_, sourceBufferLen_);
+      if (track_latency_) {
+        onFirstByteForwarded(type, clock.micros());
+      }
+      return;
+    }
+  }
+  if (sourceBufferLen_ == PACKET_LENGTHS_BY_TYPE[type]) {
+    onPacketComplete(sink, clock);
+  }
+}
+
+template <class SinkT, class ClockT>
+void BmsRelay::onPacketComplete(SinkT& sink, ClockT& clock) {
+  const uint8_t type = sourceBuffer_[3];
+  if (ingestBufferedPacket()) {
+    if (!cutting_through_) {
+      send(sink, sourceBuffer_, sourceBufferLen_);
+    }
+    // Sampled right here rather than once per loop() so that the time spent
+    // on parsing and callbacks shows up too.
+    if (track_latency_) {
+      const unsigned long nowMicros = clock.micros();
+      if (!cutting_through_) {
+        onFirstByteForwarded(type, nowMicros);
+      }
+      onLastByteForwarded(type, nowMicros);
+    }
+  }
+  cutting_through_ = false;
+  sourceBufferLen_ = 0;
+}
+
+template <class SinkT>
+void BmsRelay::forwardUnknownData(SinkT& sink, const uint8_t* data,
+                                  size_t len) {
+  send(sink, data, len);
+  onUnknownData(data, len);
+}
+
+// Called when the last byte in sourceBuffer_ doesn't fit the packet header.
+template <class SinkT>
+void BmsRelay::resynchronize(SinkT& sink) {
+  const uint8_t len = resyncDiscardLength();
+  forwardUnknownData(sink, sourceBuffer_, len);
+  discardFromSourceBuffer(len);
+}
+
+template <class SinkT>
+void BmsRelay::maybeReplayPackets(SinkT& sink) {
+  // Predicting the next packet isn't free, only done when there's a point.
+  if (!tx_scheduler_.hasDueReplays(now_millis_)) {
+    return;
+  }
+  BusState bus;
+  bus.now_millis = now_millis_;
+  bus.quiet_millis = now_millis_ - last_rx_millis_;
+  bus.mid_packet = sourceBufferLen_ > 0;
+  bus.millis_until_next_packet =
+      packet_tracker_.millisUntilNextPacket(now_millis_);
+  const int type = tx_scheduler_.nextReplay(bus);
+  if (type < 0) {
+    return;
+  }
+  // Replayed from a copy, the tracker's store has to keep the packet as
+  // received or parsers rewriting it would make the next identical packet
+  // look changed.
+  uint8_t replay[MAX_PACKET_LENGTH];
+  memcpy(replay, packet_tracker_.getLastValidPacket(type),
+         PACKET_LENGTHS_BY_TYPE[type]);
+  Packet p(replay, PACKET_LENGTHS_BY_TYPE[type], /*replayed=*/true);
+  // Reschedules the replay.
+  if (ingestPacket(p)) {
+    send(sink, p.start(), p.len());
+    bus_utilization_.replayedBytes(p.len());
+    if (capture_recorder_) {
+      captureReplay(p);
+    }
+  }
+}
+
+#endif  // BMS_RELAY_CORE_H
@@ -0,0 +1,43 @@
+#include "bus_utilization.h"
+
+#include <algorithm>
+
+namespace {
+
+void keepPeak(BusCounters* peak, const BusCounters& second) {
+  peak->bytes_in = std::max(peak->bytes_in, second.bytes_in);
+  peak->bytes_out = std::max(peak->bytes_out, second.bytes_out);
+  peak->replayed_bytes = std::max(peak->replayed_bytes, second.replayed_bytes);
+  peak->swallowed_bytes =
+      std::max(peak->swallowed_bytes, second.swallowed_bytes);
+  peak->unknown_bytes = std::max(peak->unknown_bytes, second.unknown_bytes);
+}
+
+}  // namespace
+
+void BusUtilization::update(unsigned long now_millis) {
+  const unsigned long elapsed = now_millis - second_start_millis_;
+  if (elapsed >= 1000) {
+    // Nothing got counted in the seconds in between.
+    last_second_ = elapsed >= 2000 ? BusCounters() : current_second_;
+    keepPeak(&peak_second_, current_second_);
+    current_second_ = BusCounters();
+    second_start_millis_ += elapsed / 1000 * 1000;
+  }
+  const unsigned long windowElapsed = now_millis - window_start_millis_;
+  if (windowElapsed >= IDLE_GAP_WINDOW_MILLIS) {
+    previous_idle_gap_micros_ = idle_gap_micros_;
+    if (windowElapsed >= 2 * IDLE_GAP_WINDOW_MILLIS) {
+      previous_idle_gap_micros_.clear();
+    }
+    idle_gap_micros_.clear();
+    window_start_millis_ +=
+        windowElapsed / IDLE_GAP_WINDOW_MILLIS * IDLE_GAP_WINDOW_MILLIS;
+  }
+}
+
+BusUtilization::IdleGapHistogram BusUtilization::idleGapMicros() const {
+  IdleGapHistogram result = previous_idle_gap_micros_;
+  result.merge(idle_gap_micros_);
+  return result;
+}
@@ -0,0 +1,89 @@
+#ifndef BUS_UTILIZATION_H
+#define BUS_UTILIZATION_H
+
+#include <cstdint>
+
+#include "log_histogram.h"
+
+struct BusCounters {
+  BusCounters()
+      : bytes_in(0),
+        bytes_out(0),
+        replayed_bytes(0),
+        swallowed_bytes(0),
+        unknown_bytes(0) {}
+  // BMS to Owie.
+  uint32_t bytes_in;
+  // Owie to MB, replays included. Counts what the relay handed to its sink,
+  // whether or not the sink got it out.
+  uint32_t bytes_out;
+  uint32_t replayed_bytes;
+  // Packets received but not forwarded, see Packet::setShouldForward().
+  uint32_t swallowed_bytes;
+  // Received bytes that weren't part of a packet, forwarded as is.
+  uint32_t unknown_bytes;
+};
+
+/**
+ * @brief How busy the links to the BMS and the MB are, in per second counts
+ * and idle gaps between packets from the BMS. Counting is a couple of
+ * additions, everything else happens once a second.
+ */
+class BusUtilization {
+ public:
+  // One direction of the line at 115200 baud, 8N1.
+  static constexpr uint32_t MAX_BYTES_PER_SECOND = 11520;
+  // Idle gaps cover the last one to two windows.
+  static constexpr unsigned long IDLE_GAP_WINDOW_MILLIS = 60000;
+  // The last bucket holds everything from 2^17us, about 131ms, up.
+  typedef LogHistogram<19> IdleGapHistogram;
+
+  /**
+   * @brief Starts a new second if the current one is over, to be called
+   * before counting anything at that time.
+   */
+  void update(unsigned long now_millis);
+
+  void bytesIn(uint32_t num) {
+    current_second_.bytes_in += num;
+    total_.bytes_in += num;
+  }
+  void bytesOut(uint32_t num) {
+    current_second_.bytes_out += num;
+    total_.bytes_out += num;
+  }
+  void replayedBytes(uint32_t num) {
+    current_second_.replayed_bytes += num;
+    total_.replayed_bytes += num;
+  }
+  void swallowedBytes(uint32_t num) {
+    current_second_.swallowed_bytes += num;
+    total_.swallowed_bytes += num;
+  }
+  void unknownBytes(uint32_t num) {
+    current_second_.unknown_bytes += num;
+    total_.unknown_bytes += num;
+  }
+  // Time between the end of a packet and the start of the next one.
+  void idleGap(uint32_t micros) { idle_gap_micros_.add(micros); }
+
+  // Counts of the last complete second.
+  const BusCounters& lastSecond() const { return last_second_; }
+  // Highest count of every field in any second, not necessarily the same
+  // second for all of them.
+  const BusCounters& peakSecond() const { return peak_second_; }
+  const BusCounters& total() const { return total_; }
+  IdleGapHistogram idleGapMicros() const;
+
+ private:
+  unsigned long second_start_millis_ = 0;
+  unsigned long window_start_millis_ = 0;
+  BusCounters current_second_;
+  BusCounters last_second_;
+  BusCounters peak_second_;
+  BusCounters total_;
+  IdleGapHistogram idle_gap_micros_;
+  IdleGapHistogram previous_idle_gap_micros_;
+};
+
+#endif  // BUS_UTILIZATION_H
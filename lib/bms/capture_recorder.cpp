@@ -0,0 +1,132 @@
+#include "capture_recorder.h"
+
+namespace {
+
+size_t varintSize(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+void putLittleEndian32(uint8_t* out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = value >> (8 * i);
+  }
+}
+
+}  // namespace
+
+CaptureRecorder::CaptureRecorder(size_t capacity)
+    : buffer_(new uint8_t[capacity]), capacity_(capacity) {}
+
+CaptureRecorder::~CaptureRecorder() { delete[] buffer_; }
+
+void CaptureRecorder::record(uint32_t micros, uint8_t flags,
+                             const uint8_t* data, size_t len) {
+  if (paused_) {
+    lost_records_++;
+    return;
+  }
+  if (!has_records_) {
+    start_micros_ = micros;
+    last_micros_ = micros;
+  }
+  const uint32_t delta = micros - last_micros_;
+  const size_t size = 1 + varintSize(delta) + varintSize(len) + len;
+  if (size > capacity_) {
+    lost_records_++;
+    return;
+  }
+  while (capacity_ - used_ < size) {
+    dropOldest();
+  }
+  last_record_ = used_;
+  has_records_ = true;
+  last_micros_ = micros;
+  writeByte(flags);
+  writeVarint(delta);
+  writeVarint(len);
+  for (size_t i = 0; i < len; i++) {
+    writeByte(data[i]);
+  }
+}
+
+void CaptureRecorder::addFlagsToLast(uint8_t flags) {
+  if (has_records_) {
+    buffer_[indexOf(last_record_)] |= flags;
+  }
+}
+
+bool CaptureRecorder::lastRecordMatches(const uint8_t* data,
+                                        size_t len) const {
+  if (!has_records_) {
+    return false;
+  }
+  size_t offset = last_record_ + 1;
+  varintAt(&offset);
+  if (varintAt(&offset) != len) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (byteAt(offset + i) != data[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t CaptureRecorder::readCapture(size_t offset, uint8_t* out,
+                                    size_t maxLen) const {
+  uint8_t header[CAPTURE_HEADER_SIZE] = {'O', 'W', 'C', 'P', CAPTURE_VERSION};
+  putLittleEndian32(&header[8], start_micros_);
+  putLittleEndian32(&header[12], lost_records_);
+  size_t len = 0;
+  while (len < maxLen && offset < captureSize()) {
+    out[len++] = offset < CAPTURE_HEADER_SIZE
+                     ? header[offset]
+                     : byteAt(offset - CAPTURE_HEADER_SIZE);
+    offset++;
+  }
+  return len;
+}
+
+void CaptureRecorder::writeByte(uint8_t b) {
+  buffer_[indexOf(used_)] = b;
+  used_++;
+}
+
+void CaptureRecorder::writeVarint(uint32_t value) {
+  while (value >= 0x80) {
+    writeByte((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  writeByte(value);
+}
+
+uint32_t CaptureRecorder::varintAt(size_t* offset) const {
+  uint32_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t b = byteAt((*offset)++);
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      return value;
+    }
+  }
+}
+
+void CaptureRecorder::dropOldest() {
+  size_t offset = 1;
+  start_micros_ += varintAt(&offset);
+  offset += varintAt(&offset);
+  tail_ = indexOf(offset);
+  used_ -= offset;
+  lost_records_++;
+  if (used_ == 0) {
+    has_records_ = false;
+  } else {
+    last_record_ -= offset;
+  }
+}
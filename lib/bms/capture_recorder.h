@@ -0,0 +1,101 @@
+#ifndef CAPTURE_RECORDER_H
+#define CAPTURE_RECORDER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum CaptureFlags : uint8_t {
+  // Set for Owie to MB, clear for BMS to Owie.
+  CAPTURE_TO_MB = 1 << 0,
+  // Went on to the MB as received.
+  CAPTURE_FORWARDED = 1 << 1,
+  // Rewritten version of the packet received right before it.
+  CAPTURE_MODIFIED = 1 << 2,
+  CAPTURE_REPLAYED = 1 << 3,
+  // Bytes that weren't part of a packet.
+  CAPTURE_UNKNOWN_DATA = 1 << 4,
+};
+
+/**
+ * @brief Keeps the latest traffic in a RAM ring buffer, oldest records make
+ * room for new ones.
+ *
+ * readCapture() produces this format, all integers little endian:
+ *
+ *   Header, CAPTURE_HEADER_SIZE bytes:
+ *     char[4]   "OWCP"
+ *     uint8_t   format version, CAPTURE_VERSION
+ *     uint8_t   reserved, 0
+ *     uint16_t  reserved, 0
+ *     uint32_t  start micros, what the first record's delta is relative to
+ *     uint32_t  records lost, overwritten or not recorded while paused
+ *   Records, until the end of the capture:
+ *     uint8_t   CaptureFlags
+ *     varint    micros since the previous record
+ *     varint    data length
+ *     uint8_t[] data
+ *
+ * varints are LEB128, 7 bits per byte starting with the least significant
+ * ones, the top bit is set on all but the last byte. Times are micros() of
+ * the device and wrap around.
+ */
+class CaptureRecorder {
+ public:
+  static constexpr size_t CAPTURE_HEADER_SIZE = 16;
+  static constexpr uint8_t CAPTURE_VERSION = 1;
+
+  // Allocates the buffer right away, nothing else allocates later.
+  explicit CaptureRecorder(size_t capacity);
+  ~CaptureRecorder();
+  CaptureRecorder(const CaptureRecorder&) = delete;
+  CaptureRecorder& operator=(const CaptureRecorder&) = delete;
+
+  void record(uint32_t micros, uint8_t flags, const uint8_t* data,
+              size_t len);
+  // Adds flags to the latest record, e.g. once it's known to be forwarded.
+  void addFlagsToLast(uint8_t flags);
+  // Whether the latest record holds exactly this data.
+  bool lastRecordMatches(const uint8_t* data, size_t len) const;
+
+  /**
+   * @brief While paused nothing gets recorded, so that a capture that's
+   * being read in pieces doesn't change under the reader.
+   */
+  void setPaused(bool paused) { paused_ = paused; }
+
+  size_t captureSize() const { return CAPTURE_HEADER_SIZE + used_; }
+  /**
+   * @brief Copies up to maxLen bytes of the capture from offset on.
+   * @return number of bytes copied, 0 at the end.
+   */
+  size_t readCapture(size_t offset, uint8_t* out, size_t maxLen) const;
+
+ private:
+  void writeByte(uint8_t b);
+  void writeVarint(uint32_t value);
+  // No modulo, there's no divide instruction on the ESP8266.
+  size_t indexOf(size_t offset) const {
+    const size_t i = tail_ + offset;
+    return i < capacity_ ? i : i - capacity_;
+  }
+  uint8_t byteAt(size_t offset) const { return buffer_[indexOf(offset)]; }
+  // Reads a varint at *offset from the tail and moves past it.
+  uint32_t varintAt(size_t* offset) const;
+  void dropOldest();
+
+  uint8_t* const buffer_;
+  const size_t capacity_;
+  // Oldest record.
+  size_t tail_ = 0;
+  size_t used_ = 0;
+  // Offset of the latest record's flags from the tail, if there is one.
+  size_t last_record_ = 0;
+  bool has_records_ = false;
+  bool paused_ = false;
+  // Time of the record before the oldest one.
+  uint32_t start_micros_ = 0;
+  uint32_t last_micros_ = 0;
+  uint32_t lost_records_ = 0;
+};
+
+#endif  // CAPTURE_RECORDER_H
@@ -0,0 +1,109 @@
+#ifndef DEADLINE_QUEUE_H
+#define DEADLINE_QUEUE_H
+
+#include <cstdint>
+
+/**
+ * @brief Indexed binary min-heap of deadlines for ids in [0, N). Every id is
+ * queued at most once, scheduling an already queued id moves it. All
+ * operations are O(log N) and nothing is allocated.
+ *
+ * Deadlines are compared with wraparound in mind, i.e. they must be within
+ * 2^31 of each other.
+ */
+template <uint8_t N>
+class DeadlineQueue {
+ public:
+  DeadlineQueue() {
+    for (uint8_t id = 0; id < N; id++) {
+      position_[id] = NOT_QUEUED;
+    }
+  }
+
+  bool empty() const { return size_ == 0; }
+  uint8_t size() const { return size_; }
+  bool contains(uint8_t id) const { return position_[id] != NOT_QUEUED; }
+
+  // Id with the earliest deadline. Queue must not be empty.
+  uint8_t top() const { return heap_[0]; }
+  uint32_t topDeadline() const { return deadline_[heap_[0]]; }
+  uint32_t deadline(uint8_t id) const { return deadline_[id]; }
+
+  void schedule(uint8_t id, uint32_t deadline) {
+    deadline_[id] = deadline;
+    if (position_[id] == NOT_QUEUED) {
+      position_[id] = size_;
+      heap_[size_++] = id;
+    }
+    siftDown(siftUp(position_[id]));
+  }
+
+  void cancel(uint8_t id) {
+    const uint8_t pos = position_[id];
+    if (pos == NOT_QUEUED) {
+      return;
+    }
+    position_[id] = NOT_QUEUED;
+    if (pos == --size_) {
+      return;
+    }
+    heap_[pos] = heap_[size_];
+    position_[heap_[pos]] = pos;
+    siftDown(siftUp(pos));
+  }
+
+  void pop() { cancel(heap_[0]); }
+
+ private:
+  static constexpr uint8_t NOT_QUEUED = 0xFF;
+  static_assert(N < NOT_QUEUED, "Too many ids");
+
+  bool earlier(uint8_t a, uint8_t b) const {
+    return (int32_t)(deadline_[heap_[a]] - deadline_[heap_[b]]) < 0;
+  }
+
+  void swap(uint8_t a, uint8_t b) {
+    const uint8_t id = heap_[a];
+    heap_[a] = heap_[b];
+    heap_[b] = id;
+    position_[heap_[a]] = a;
+    position_[heap_[b]] = b;
+  }
+
+  uint8_t siftUp(uint8_t pos) {
+    while (pos > 0) {
+      const uint8_t parent = (pos - 1) / 2;
+      if (!earlier(pos, parent)) {
+        break;
+      }
+      swap(pos, parent);
+      pos = parent;
+    }
+    return pos;
+  }
+
+  void siftDown(uint8_t pos) {
+    while (true) {
+      const uint8_t left = 2 * pos + 1;
+      if (left >= size_) {
+        return;
+      }
+      uint8_t child = left;
+      if (left + 1 < size_ && earlier(left + 1, left)) {
+        child = left + 1;
+      }
+      if (!earlier(child, pos)) {
+        return;
+      }
+      swap(pos, child);
+      pos = child;
+    }
+  }
+
+  uint8_t heap_[N];
+  uint8_t position_[N];
+  uint32_t deadline_[N];
+  uint8_t size_ = 0;
+};
+
+#endif  // DEADLINE_QUEUE_H
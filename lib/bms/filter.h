@@ -1,6 +1,9 @@
 #ifndef FILTER_H
 #define FILTER_H
 
+#include <array>
+#include <cstdint>
+
 // Based on
 // http://www.schwietering.com/jayduino/filtuino/index.php?characteristic=bu&passmode=lp&order=2&usesr=usesr&sr=1&frequencyLow=0.0025&noteLow=&noteHigh=&pw=pw&calctype=float&run=Send
 // With alpha=0.0025 and observed sample rate of the voltage messages of 1Hz,
@@ -38,4 +41,239 @@ class LowPassFilter {
   }
 };
 
+// Everything below only ever runs at compile time, doubles are fine.
+namespace filter_design {
+
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double sqrt(double x) {
+  double root = x > 1 ? x : 1;
+  for (int i = 0; i < 64; i++) {
+    root = (root + x / root) / 2;
+  }
+  return root;
+}
+
+// Taylor series of sin and cos, accurate for |x| <= pi / 4.
+constexpr double tan(double x) {
+  double sin = 0;
+  double cos = 0;
+  // x^n / n!
+  double term = 1;
+  for (int n = 0; n < 24; n++) {
+    const double sign = (n / 2) % 2 == 0 ? 1 : -1;
+    if (n % 2 == 0) {
+      cos += sign * term;
+    } else {
+      sin += sign * term;
+    }
+    term *= x / (n + 1);
+  }
+  return sin / cos;
+}
+
+constexpr int64_t round(double x) {
+  return x < 0 ? (int64_t)(x - 0.5) : (int64_t)(x + 0.5);
+}
+
+// Same form as LowPassFilter: v2 = b * x + a0 * v0 + a1 * v1, with the
+// output v0 + 2 * v1 + v2.
+struct Biquad {
+  double b;
+  double a0;
+  double a1;
+};
+
+// Second order Butterworth low pass through the bilinear transform.
+constexpr Biquad butterworthLowPass(double cutoffHz, double sampleRateHz) {
+  const double k = tan(PI * cutoffHz / sampleRateHz);
+  const double d = 1 + sqrt(2) * k + k * k;
+  return Biquad{k * k / d, -(1 - sqrt(2) * k + k * k) / d,
+                2 * (1 - k * k) / d};
+}
+
+// Upper bound on the sum of the magnitudes of the impulse response of v,
+// i.e. on |v| per unit of input magnitude. The poles are r * e^(+-i * theta)
+// and |h[n]| <= b * r^n / sin(theta).
+constexpr double stateGainBound(const Biquad& f) {
+  const double r = sqrt(-f.a0);
+  const double cosTheta = f.a1 / (2 * r);
+  return f.b / ((1 - r) * sqrt(1 - cosTheta * cosTheta));
+}
+
+}  // namespace filter_design
+
+// Coefficients of filter_design::Biquad in Q30.
+struct BiquadQ30 {
+  int32_t b;
+  int32_t a0;
+  int32_t a1;
+
+  static constexpr int32_t ONE = (int32_t)1 << 30;
+
+  /**
+   * @brief Rounds to Q30 and then picks b so that the DC gain is exactly
+   * one, rather than off by a fraction of a percent, a0 moves by up to 3 LSB
+   * for that.
+   */
+  static constexpr BiquadQ30 quantize(const filter_design::Biquad& f) {
+    const int64_t a1 = filter_design::round(f.a1 * ONE);
+    int64_t a0 = filter_design::round(f.a0 * ONE);
+    // v at rest is b / (1 - a0 - a1) times the input, one quarter of it for
+    // the output to match.
+    const int64_t rest = ONE - a0 - a1;
+    a0 += rest % 4;
+    return BiquadQ30{(int32_t)((rest - rest % 4) / 4), (int32_t)a0,
+                     (int32_t)a1};
+  }
+};
+
+/**
+ * @brief State of a LowPassFilter style biquad in fixed point, v in Q
+ * FRACTION_BITS. The rounding error of every step is carried into the next
+ * one. Without that the output would get stuck short of its target by up
+ * to several LSB of the input, as poles this close to 1 make
+ * 1 - a0 - a1 tiny.
+ *
+ * Callers make sure that |v| stays below 2^30, see stateFits().
+ */
+template <uint8_t FRACTION_BITS>
+class BiquadQ30State {
+ public:
+  static_assert(FRACTION_BITS >= 2 && FRACTION_BITS <= 24, "Fraction bits");
+
+  /**
+   * @brief Whether inputs up to maxInput in magnitude keep |v| within
+   * range for the filter.
+   */
+  static constexpr bool stateFits(const filter_design::Biquad& f,
+                                  int32_t maxInput) {
+    // One more LSB per step for the carried rounding error.
+    return (filter_design::stateGainBound(f) * maxInput + 1) *
+               ((int64_t)1 << FRACTION_BITS) +
+               1 / (1 - filter_design::sqrt(-f.a0)) <
+           (double)((int64_t)1 << 30);
+  }
+
+  void step(int32_t x, const BiquadQ30& c) {
+    if (!initialized_) {
+      initialized_ = true;
+      // Same as LowPassFilter, at rest right away.
+      const int32_t v = (x * ((int32_t)1 << FRACTION_BITS)) / 4;
+      v_[0] = v;
+      v_[1] = v;
+      v_[2] = v;
+      return;
+    }
+    v_[0] = v_[1];
+    v_[1] = v_[2];
+    const int64_t acc = (int64_t)c.b * ((int64_t)x << FRACTION_BITS) +
+                        (int64_t)c.a0 * v_[0] + (int64_t)c.a1 * v_[1] +
+                        residue_;
+    v_[2] = (int32_t)(acc >> 30);
+    residue_ = (int32_t)(acc - ((int64_t)v_[2] << 30));
+  }
+
+  // Rounded to the nearest integer.
+  int32_t get() const {
+    return (v_[0] + 2 * v_[1] + v_[2] + ((int32_t)1 << (FRACTION_BITS - 1))) >>
+           FRACTION_BITS;
+  }
+
+ private:
+  bool initialized_ = false;
+  int32_t v_[3] = {0};
+  int32_t residue_ = 0;
+};
+
+/**
+ * @brief Integer version of LowPassFilter for any cutoff and sample rate,
+ * coefficients are designed at compile time. Design has to provide:
+ * - static constexpr double CUTOFF_HZ, below SAMPLE_RATE_HZ / 4.
+ * - static constexpr double SAMPLE_RATE_HZ.
+ * - static constexpr int32_t MAX_INPUT, largest input magnitude.
+ */
+template <class Design, uint8_t FRACTION_BITS = 16>
+class FixedLowPassFilter {
+ public:
+  static constexpr filter_design::Biquad DESIGN =
+      filter_design::butterworthLowPass(Design::CUTOFF_HZ,
+                                        Design::SAMPLE_RATE_HZ);
+  static constexpr BiquadQ30 COEFFICIENTS = BiquadQ30::quantize(DESIGN);
+
+  static_assert(Design::CUTOFF_HZ < Design::SAMPLE_RATE_HZ / 4, "Cutoff");
+  static_assert(BiquadQ30State<FRACTION_BITS>::stateFits(DESIGN,
+                                                         Design::MAX_INPUT),
+                "State could overflow, use fewer fraction bits");
+
+  void step(int32_t x) { state_.step(x, COEFFICIENTS); }
+  int32_t get() const { return state_.get(); }
+
+ private:
+  BiquadQ30State<FRACTION_BITS> state_;
+};
+
+/**
+ * @brief FixedLowPassFilter for samples that don't come at a steady rate.
+ * Every step uses coefficients designed for the time since the previous
+ * sample, from a table with PERIOD_STEP_MILLIS resolution, so that the
+ * cutoff stays at Design::CUTOFF_HZ in real time. Design::SAMPLE_RATE_HZ
+ * isn't used.
+ */
+template <class Design, uint8_t FRACTION_BITS, uint32_t PERIOD_STEP_MILLIS,
+          uint8_t NUM_PERIODS>
+class AdaptiveLowPassFilter {
+ public:
+  typedef std::array<BiquadQ30, NUM_PERIODS> Table;
+
+  static constexpr filter_design::Biquad designFor(uint8_t index) {
+    return filter_design::butterworthLowPass(
+        Design::CUTOFF_HZ, 1000.0 / ((index + 1) * PERIOD_STEP_MILLIS));
+  }
+
+  static constexpr bool allStatesFit() {
+    for (uint8_t i = 0; i < NUM_PERIODS; i++) {
+      if (!BiquadQ30State<FRACTION_BITS>::stateFits(designFor(i),
+                                                    Design::MAX_INPUT)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static constexpr Table generate() {
+    Table table{};
+    for (uint8_t i = 0; i < NUM_PERIODS; i++) {
+      table[i] = BiquadQ30::quantize(designFor(i));
+    }
+    return table;
+  }
+
+  static constexpr Table COEFFICIENTS = generate();
+
+  // Cutoff below a quarter of the lowest sample rate, in milliseconds.
+  static_assert(Design::CUTOFF_HZ * NUM_PERIODS * PERIOD_STEP_MILLIS < 250,
+                "Cutoff");
+  static_assert(allStatesFit(),
+                "State could overflow, use fewer fraction bits");
+
+  void step(int32_t x, uint32_t nowMillis) {
+    // Rounded to the nearest period in the table.
+    uint32_t index = (nowMillis - last_step_millis_ + PERIOD_STEP_MILLIS / 2) /
+                     PERIOD_STEP_MILLIS;
+    if (index < 1) {
+      index = 1;
+    } else if (index > NUM_PERIODS) {
+      index = NUM_PERIODS;
+    }
+    last_step_millis_ = nowMillis;
+    state_.step(x, COEFFICIENTS[index - 1]);
+  }
+  int32_t get() const { return state_.get(); }
+
+ private:
+  uint32_t last_step_millis_ = 0;
+  BiquadQ30State<FRACTION_BITS> state_;
+};
+
 #endif
\ No newline at end of file
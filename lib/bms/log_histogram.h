@@ -0,0 +1,54 @@
+#ifndef LOG_HISTOGRAM_H
+#define LOG_HISTOGRAM_H
+
+#include <cstdint>
+
+/**
+ * @brief Histogram with power of two sized buckets. Bucket 0 counts zeros,
+ * bucket i counts values in [2^(i-1), 2^i) and the last bucket also
+ * everything above. Adding a value is a couple of instructions and nothing
+ * is allocated.
+ */
+template <uint8_t NUM_BUCKETS>
+class LogHistogram {
+ public:
+  static_assert(NUM_BUCKETS >= 2 && NUM_BUCKETS <= 33, "Bucket count");
+
+  static constexpr uint8_t numBuckets() { return NUM_BUCKETS; }
+
+  // Smallest value that lands in the bucket.
+  static constexpr uint32_t bucketLowerBound(uint8_t bucket) {
+    return bucket == 0 ? 0 : (uint32_t)1 << (bucket - 1);
+  }
+
+  static uint8_t bucketFor(uint32_t value) {
+    if (value == 0) {
+      return 0;
+    }
+    const uint8_t bucket = 32 - __builtin_clz(value);
+    return bucket < NUM_BUCKETS ? bucket : NUM_BUCKETS - 1;
+  }
+
+  void add(uint32_t value) {
+    counts_[bucketFor(value)]++;
+    total_++;
+  }
+
+  void merge(const LogHistogram& other) {
+    for (uint8_t bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+      counts_[bucket] += other.counts_[bucket];
+    }
+    total_ += other.total_;
+  }
+
+  void clear() { *this = LogHistogram(); }
+
+  uint32_t count(uint8_t bucket) const { return counts_[bucket]; }
+  uint32_t total() const { return total_; }
+
+ private:
+  uint32_t counts_[NUM_BUCKETS] = {0};
+  uint32_t total_ = 0;
+};
+
+#endif  // LOG_HISTOGRAM_H
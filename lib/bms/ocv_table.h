@@ -0,0 +1,91 @@
+#ifndef OCV_TABLE_H
+#define OCV_TABLE_H
+
+#include <array>
+#include <cstdint>
+
+#ifdef ARDUINO
+#include <pgmspace.h>
+#else
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_byte
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#endif
+#endif
+
+/**
+ * @brief Open circuit voltage curve of a cell chemistry, SOC in percent at
+ * evenly spaced cell voltages from MIN_MV to MAX_MV.
+ */
+template <int32_t MIN_MV, int32_t MAX_MV, uint8_t... SOC_PERCENT>
+struct OcvCurve {
+  static constexpr int32_t MIN_MILLIVOLTS = MIN_MV;
+  static constexpr int32_t MAX_MILLIVOLTS = MAX_MV;
+  static constexpr uint8_t NUM_POINTS = sizeof...(SOC_PERCENT);
+  static constexpr uint8_t POINTS[NUM_POINTS] = {SOC_PERCENT...};
+
+  static_assert(MAX_MV > MIN_MV, "Voltage range");
+  static_assert(NUM_POINTS >= 2, "Need at least two points");
+};
+
+// The curve Owie has always used.
+typedef OcvCurve<2700, 4200, 0, 0, 0, 0, 1, 2, 3, 4, 5, 7, 8, 11, 14, 16, 18,
+                 19, 25, 30, 33, 37, 43, 48, 53, 60, 67, 71, 76, 82, 92, 97,
+                 100>
+    DefaultOcvCurve;
+
+/**
+ * @brief The curve linearly interpolated at every millivolt, so that a
+ * lookup is a single index. generate() runs at compile time, the result is
+ * meant to be kept in PROGMEM:
+ *
+ *   constexpr OcvTable<Curve>::Table TABLE PROGMEM =
+ *       OcvTable<Curve>::generate();
+ */
+template <class Curve>
+class OcvTable {
+ public:
+  static constexpr int32_t SIZE =
+      Curve::MAX_MILLIVOLTS - Curve::MIN_MILLIVOLTS;
+  typedef std::array<uint8_t, SIZE> Table;
+
+  static constexpr Table generate() {
+    Table table{};
+    for (int32_t offset = 0; offset < SIZE; offset++) {
+      table[offset] = interpolate(offset);
+    }
+    return table;
+  }
+
+  /**
+   * @param table generate()'s result, in PROGMEM or not.
+   * @return SOC in percent, voltages out of range are clamped to it.
+   */
+  static int32_t socPercent(const Table& table, int32_t cellMillivolts) {
+    int32_t offset = cellMillivolts - Curve::MIN_MILLIVOLTS;
+    if (offset < 0) {
+      offset = 0;
+    } else if (offset >= SIZE) {
+      offset = SIZE - 1;
+    }
+    return pgm_read_byte(&table[offset]);
+  }
+
+ private:
+  static constexpr uint8_t interpolate(int32_t offset) {
+    const int32_t scaled = offset * (Curve::NUM_POINTS - 1);
+    const int32_t left = scaled / SIZE;
+    const int32_t remainder = scaled % SIZE;
+    const int32_t leftValue = Curve::POINTS[left];
+    const int32_t delta = Curve::POINTS[left + 1] - leftValue;
+    // delta * remainder / SIZE rounded half away from zero.
+    const int32_t magnitude =
+        ((delta < 0 ? -delta : delta) * remainder * 2 + SIZE) / (2 * SIZE);
+    const int32_t value = leftValue + (delta < 0 ? -magnitude : magnitude);
+    return value < 0 ? 0 : (value > 100 ? 100 : value);
+  }
+};
+
+#endif  // OCV_TABLE_H
@@ -4,12 +4,28 @@
 #include <cstdint>
 
 // A bunch of places use sizeof(), don't change type.
-static const int8_t PACKET_LENGTHS_BY_TYPE[] = {
+static constexpr int8_t PACKET_LENGTHS_BY_TYPE[] = {
     7, -1, 38, 7, 11, 8, 10, 13, 7, 7, -1, 8, 8, 9, -1, 11, 16, 10};
 
+constexpr int8_t maxPacketLength() {
+  int8_t result = 0;
+  for (int8_t len : PACKET_LENGTHS_BY_TYPE) {
+    if (len > result) {
+      result = len;
+    }
+  }
+  return result;
+}
+
+// Length of the longest known packet, sizes the relay's frame buffer.
+static constexpr int8_t MAX_PACKET_LENGTH = maxPacketLength();
+
 class Packet {
  public:
-  Packet(uint8_t* start, uint8_t len) : start_(start), len_(len) { validate(); }
+  Packet(uint8_t* start, uint8_t len, bool replayed = false)
+      : start_(start), len_(len), replayed_(replayed) {
+    validate();
+  }
 
   int getType() const {
     if (!valid_) {
@@ -20,6 +36,23 @@ class Packet {
 
   bool isValid() const { return valid_; }
 
+  /**
+   * @brief Whether this is a stored packet re-sent by the relay because the
+   * BMS went quiet, rather than one that just came from the BMS.
+   */
+  bool isReplayed() const { return replayed_; }
+
+  /**
+   * @brief False if the packet is byte for byte the same as the previous
+   * valid packet of its type. Replays never count as changed.
+   */
+  bool isChanged() const { return changed_; }
+  void setChanged(bool changed) { changed_ = changed; }
+
+  /**
+   * @brief Writing through this pointer leaves the checksum stale, either use
+   * setDataByte() or call recalculateCrcIfValid() afterwards.
+   */
   uint8_t* data() const {
     if (!valid_) {
       return nullptr;
@@ -27,6 +60,22 @@ class Packet {
     return start_ + 4;
   }
 
+  /**
+   * @brief Overwrites a byte of a valid packet's data, patching the checksum
+   * with the difference rather than summing the whole packet again.
+   */
+  void setDataByte(int index, uint8_t value) {
+    if (!valid_) {
+      return;
+    }
+    uint8_t* const byte = start_ + 4 + index;
+    uint16_t crc = ((uint16_t)(start_[len_ - 2])) << 8 | start_[len_ - 1];
+    crc += value - *byte;
+    *byte = value;
+    start_[len_ - 2] = (crc >> 8);
+    start_[len_ - 1] = (crc & 0xFF);
+  }
+
   int dataLength() const {
     if (!valid_) {
       return -1;
@@ -51,6 +100,8 @@ class Packet {
   void validate();
   uint8_t* start_;
   uint8_t len_;
+  bool replayed_;
+  bool changed_ = true;
   bool valid_ = false;
   bool shouldForward_ = true;
 };
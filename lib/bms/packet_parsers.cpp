@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstdint>
 
@@ -15,9 +16,6 @@ inline int16_t int16FromNetworkOrder(const void* const p) {
 }  // namespace
 
 void BmsRelay::batteryPercentageParser(Packet& p) {
-  if (p.getType() != 3) {
-    return;
-  }
   // 0x3 message is just one byte containing battery percentage.
   bms_soc_percent_ = *(int8_t*)p.data();
   overridden_soc_percent_ = battery_fuel_gauge_.getSoc();
@@ -25,13 +23,10 @@ void BmsRelay::batteryPercentageParser(Packet& p) {
     p.setShouldForward(false);
     return;
   }
-  p.data()[0] = overridden_soc_percent_;
+  p.setDataByte(0, overridden_soc_percent_);
 }
 
 void BmsRelay::currentParser(Packet& p) {
-  if (p.getType() != 5) {
-    return;
-  }
   p.setShouldForward(isCharging());
 
   // 0x5 message encodes current as signed int16.
@@ -42,9 +37,6 @@ void BmsRelay::currentParser(Packet& p) {
 }
 
 void BmsRelay::bmsSerialParser(Packet& p) {
-  if (p.getType() != 6) {
-    return;
-  }
   // 0x6 message has the BMS serial number encoded inside of it.
   // It is the last seven digits from the sticker on the back of the BMS.
   if (captured_serial_ == 0) {
@@ -57,15 +49,12 @@ void BmsRelay::bmsSerialParser(Packet& p) {
   }
   uint32_t serial_override_copy = serial_override_;
   for (int i = 3; i >= 0; i--) {
-    p.data()[i] = serial_override_copy & 0xFF;
+    p.setDataByte(i, serial_override_copy & 0xFF);
     serial_override_copy >>= 8;
   }
 }
 
 void BmsRelay::cellVoltageParser(Packet& p) {
-  if (p.getType() != 2) {
-    return;
-  }
   // The data in this packet is 16 int16-s. First 15 of them is
   // individual cell voltages in millivolts. The last value is mysterious.
   const uint8_t* const data = p.data();
@@ -80,13 +69,17 @@ void BmsRelay::cellVoltageParser(Packet& p) {
     cell_millivolts_[i] = cellVoltage;
   }
   total_voltage_millivolts_ = total_voltage;
+  min_cell_millivolts_ = min_voltage;
   battery_fuel_gauge_.updateVoltage(min_voltage, now_millis_);
 }
 
+void BmsRelay::unchangedCellVoltageParser(Packet& p) {
+  // Nothing to decode but the fuel gauge filters the voltage over time so it
+  // still needs to see every sample.
+  battery_fuel_gauge_.updateVoltage(min_cell_millivolts_, now_millis_);
+}
+
 void BmsRelay::temperatureParser(Packet& p) {
-  if (p.getType() != 4) {
-    return;
-  }
   int8_t* const temperatures = (int8_t*)p.data();
   int16_t temperature_sum = 0;
   for (int i = 0; i < 5; i++) {
@@ -98,9 +91,6 @@ void BmsRelay::temperatureParser(Packet& p) {
 }
 
 void BmsRelay::bmsStatusParser(Packet& p) {
-  if (p.getType() != 0) {
-    return;
-  }
   last_status_byte_ = p.data()[0];
 
   // Forwarding the status packet during normal operation seems to drive
@@ -110,3 +100,96 @@ void BmsRelay::bmsStatusParser(Packet& p) {
                      isBatteryTempOutOfRange() || isBatteryOvercharged());
   battery_fuel_gauge_.updateChargingStatus(isCharging());
 }
+
+namespace {
+
+typedef void (*ParserFunction)(BmsRelay& relay, Packet& p);
+
+struct ParserTableEntry {
+  ParserFunction parse;
+  // Called instead of parse for packets identical to the previous one of
+  // their type, nullptr if there's nothing to do for them.
+  ParserFunction parseUnchanged;
+  // Whether the parser might modify the packet or stop it from being
+  // forwarded.
+  bool rewrites;
+};
+
+typedef std::array<ParserTableEntry, sizeof(PACKET_LENGTHS_BY_TYPE)>
+    ParserTableByType;
+
+template <uint8_t TYPE, void (BmsRelay::*PARSER)(Packet&),
+          bool REWRITES = false,
+          void (BmsRelay::*UNCHANGED_PARSER)(Packet&) = nullptr>
+struct Parser {
+  static_assert(TYPE < sizeof(PACKET_LENGTHS_BY_TYPE) &&
+                    PACKET_LENGTHS_BY_TYPE[TYPE] > 0,
+                "Unknown packet type");
+  static constexpr uint8_t type = TYPE;
+  static constexpr bool rewrites = REWRITES;
+  // PARSER is a compile time constant so its body gets inlined here.
+  static void parse(BmsRelay& relay, Packet& p) { (relay.*PARSER)(p); }
+  static void parseUnchanged(BmsRelay& relay, Packet& p) {
+    (relay.*UNCHANGED_PARSER)(p);
+  }
+  static constexpr ParserFunction unchangedParser() {
+    // Whatever a rewriting parser does applies to the packet at hand, so it
+    // has to run on every one of them.
+    if constexpr (REWRITES) {
+      return &parse;
+    } else if constexpr (UNCHANGED_PARSER != nullptr) {
+      return &parseUnchanged;
+    } else {
+      return nullptr;
+    }
+  }
+};
+
+template <class... PARSERS>
+constexpr ParserTableByType buildParserTable() {
+  ParserTableByType table{};
+  ((table[PARSERS::type] = {&PARSERS::parse, PARSERS::unchangedParser(),
+                            PARSERS::rewrites}),
+   ...);
+  return table;
+}
+
+constexpr bool REWRITES_PACKET = true;
+
+template <class... PARSERS>
+struct ParserTable {
+  static constexpr ParserTableByType BY_TYPE = buildParserTable<PARSERS...>();
+};
+
+}  // namespace
+
+// Packet types without an entry here are simply not parsed. Packets identical
+// to the previous one of their type skip parsers that don't rewrite them,
+// unless those come with a parser for unchanged packets.
+struct BmsRelay::Parsers
+    : ParserTable<
+          Parser<0, &BmsRelay::bmsStatusParser, REWRITES_PACKET>,
+          Parser<2, &BmsRelay::cellVoltageParser, !REWRITES_PACKET,
+                 &BmsRelay::unchangedCellVoltageParser>,
+          Parser<3, &BmsRelay::batteryPercentageParser, REWRITES_PACKET>,
+          Parser<4, &BmsRelay::temperatureParser>,
+          Parser<5, &BmsRelay::currentParser, REWRITES_PACKET>,
+          Parser<6, &BmsRelay::bmsSerialParser, REWRITES_PACKET>> {};
+
+void BmsRelay::parsePacket(Packet& p) {
+  const int type = p.getType();
+  // Invalid packets have type -1.
+  if (type < 0 || type >= (int)Parsers::BY_TYPE.size()) {
+    return;
+  }
+  const ParserTableEntry& entry = Parsers::BY_TYPE[type];
+  const ParserFunction parse =
+      p.isChanged() ? entry.parse : entry.parseUnchanged;
+  if (parse != nullptr) {
+    parse(*this, p);
+  }
+}
+
+bool BmsRelay::isRewrittenPacketType(uint8_t type) {
+  return type < Parsers::BY_TYPE.size() && Parsers::BY_TYPE[type].rewrites;
+}
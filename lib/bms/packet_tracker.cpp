@@ -1,25 +1,89 @@
 #include "packet_tracker.h"
 
+#include <algorithm>
 #include <cstring>
+#include <limits>
 
 #include "defer.h"
 
-PacketTracker::PacketTracker()
-    : individual_packet_stats_(sizeof(PACKET_LENGTHS_BY_TYPE)) {}
+namespace {
 
-void PacketTracker::processPacket(const Packet& packet,
+// Intervals needed before the mean is trusted for gap detection.
+constexpr uint32_t GAP_DETECTION_MIN_PERIODS = 8;
+// Largest period that still fits in period_ewma_q4_.
+constexpr uint32_t MAX_PERIOD_MILLIS = 0x7FFFFFF;
+
+uint32_t isqrt(uint32_t x) {
+  uint32_t root = 0;
+  uint32_t bit = (uint32_t)1 << 30;
+  while (bit > x) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+}  // namespace
+
+int32_t IndividualPacketStat::deviation_millis() const {
+  return isqrt(period_variance_);
+}
+
+void IndividualPacketStat::addPeriod(uint32_t millis) {
+  // Anything this long (over a day) is as good as never, and the clamp keeps
+  // the fixed point math below from overflowing.
+  millis = std::min<uint32_t>(millis, MAX_PERIOD_MILLIS);
+  if (period_millis.total() == 0) {
+    period_ewma_q4_ = millis * 16;
+    min_period_millis = millis;
+    max_period_millis = millis;
+    period_millis.add(millis);
+    return;
+  }
+  const uint32_t mean = mean_period_millis();
+  if (period_millis.total() >= GAP_DETECTION_MIN_PERIODS && mean > 0 &&
+      millis * 2 > mean * 3) {
+    // Rounded to the nearest number of periods, one of them is this packet.
+    missed_num += (millis + mean / 2) / mean - 1;
+  }
+  period_millis.add(millis);
+  min_period_millis = std::min(min_period_millis, millis);
+  max_period_millis = std::max(max_period_millis, millis);
+
+  // Clamped so that the square fits into 32 bits.
+  const uint32_t diff = std::min<uint32_t>(
+      millis > mean ? millis - mean : mean - millis, 0xFFFF);
+  const uint32_t squared = diff * diff;
+  if (squared >= period_variance_) {
+    period_variance_ += (squared - period_variance_) / 16;
+  } else {
+    period_variance_ -= (period_variance_ - squared) / 16;
+  }
+  period_ewma_q4_ += ((int32_t)millis * 16 - period_ewma_q4_) / 16;
+}
+
+bool PacketTracker::processPacket(const Packet& packet,
                                   const unsigned long now_millis) {
+  if (packet.isReplayed()) {
+    return false;
+  }
   if (!packet.isValid()) {
     global_stats_.total_packet_checksum_mismatches++;
   }
-  // Though this should never happen, let's sanity check the packet
-  // type so we don't accidentally OOM.
+  // Invalid packets have type -1. The upper bound should never be hit as the
+  // relay only frames packets of known types.
   int type = packet.getType();
-  if (type < 0 || type > 255) {
-    return;
-  }
-  if (type >= (int)individual_packet_stats_.size()) {
-    individual_packet_stats_.resize(type + 1);
+  if (type < 0 || type >= (int)NUM_PACKET_TYPES ||
+      packet.len() != PACKET_LENGTHS_BY_TYPE[type]) {
+    return true;
   }
   global_stats_.total_known_bytes_received += packet.len();
   global_stats_.total_known_packets_received++;
@@ -27,20 +91,69 @@ void PacketTracker::processPacket(const Packet& packet,
   IndividualPacketStat* stat = &individual_packet_stats_[type];
   defer { stat->last_packet_millis = now_millis; };
 
-  stat->last_seen_valid_packet.resize(packet.len());
-  memcpy(&stat->last_seen_valid_packet[0], packet.start(), packet.len());
-
+  uint8_t* const lastPacket = &last_valid_packets_[PACKET_SLOT_OFFSETS[type]];
   if (stat->total_num++ == 0) {
     stat->id = type;
-    return;
+    memcpy(lastPacket, packet.start(), packet.len());
+    return true;
+  }
+  // The checksum only depends on the payload, comparing the whole packet is
+  // as good as comparing just the payload.
+  const bool changed = memcmp(lastPacket, packet.start(), packet.len()) != 0;
+  if (changed) {
+    memcpy(lastPacket, packet.start(), packet.len());
+  } else {
+    stat->unchanged_num++;
   }
   // Shouldn't happen but let's guard against.
-  if (now_millis < stat->last_packet_millis) {
-    return;
+  if (now_millis >= stat->last_packet_millis) {
+    stat->addPeriod(now_millis - stat->last_packet_millis);
   }
-  stat->mean_and_dev_.add_value(float(now_millis - stat->last_packet_millis));
+  return changed;
 }
 
 void PacketTracker::unknownBytes(int num) {
   global_stats_.total_unknown_bytes_received += num;
-}
\ No newline at end of file
+}
+unsigned long PacketTracker::millisUntilNextPacket(
+    unsigned long now_millis) const {
+  unsigned long result = std::numeric_limits<unsigned long>::max();
+  for (const IndividualPacketStat& stat : individual_packet_stats_) {
+    const uint32_t mean = stat.mean_period_millis();
+    if (stat.period_millis.total() < GAP_DETECTION_MIN_PERIODS || mean == 0) {
+      continue;
+    }
+    const unsigned long elapsed = now_millis - stat.last_packet_millis;
+    // Same threshold as for counting a missed packet.
+    if (elapsed * 2 > mean * 3) {
+      continue;
+    }
+    result = std::min<unsigned long>(result,
+                                     elapsed >= mean ? 0 : mean - elapsed);
+  }
+  return result;
+}
+
+void PacketTracker::forwardingLatency(int type, unsigned long micros) {
+  if (type < 0 || type >= (int)individual_packet_stats_.size()) {
+    return;
+  }
+  IndividualPacketStat& stat = individual_packet_stats_[type];
+  const int32_t latency = micros;
+  if (stat.forwarding_latency_samples++ == 0) {
+    stat.avg_forwarding_latency_micros = latency;
+  } else {
+    stat.avg_forwarding_latency_micros +=
+        (latency - stat.avg_forwarding_latency_micros) / 8;
+  }
+  if (latency > stat.max_forwarding_latency_micros) {
+    stat.max_forwarding_latency_micros = latency;
+  }
+}
+
+void PacketTracker::relayLatency(int type, unsigned long micros) {
+  if (type < 0 || type >= (int)individual_packet_stats_.size()) {
+    return;
+  }
+  individual_packet_stats_[type].relay_latency_micros.add(micros);
+}
@@ -1,26 +1,81 @@
 #ifndef PACKET_TRACKER_H
 #define PACKET_TRACKER_H
 
-#include <cmath>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
-#include <vector>
 
+#include "log_histogram.h"
 #include "packet.h"
-#include "welford.h"
+
+static constexpr size_t NUM_PACKET_TYPES = sizeof(PACKET_LENGTHS_BY_TYPE);
+
+// Offsets of every packet type's slot in PacketTracker's packet store, the
+// last element is the total size.
+constexpr std::array<uint16_t, NUM_PACKET_TYPES + 1> packetSlotOffsets() {
+  std::array<uint16_t, NUM_PACKET_TYPES + 1> offsets{};
+  for (size_t type = 0; type < NUM_PACKET_TYPES; type++) {
+    const int8_t len = PACKET_LENGTHS_BY_TYPE[type];
+    offsets[type + 1] = offsets[type] + (len > 0 ? len : 0);
+  }
+  return offsets;
+}
+
+static constexpr std::array<uint16_t, NUM_PACKET_TYPES + 1>
+    PACKET_SLOT_OFFSETS = packetSlotOffsets();
 
 class IndividualPacketStat {
  public:
-  IndividualPacketStat() : id(-1), total_num(0), last_packet_millis(0) {}
+  IndividualPacketStat()
+      : id(-1),
+        total_num(0),
+        unchanged_num(0),
+        last_packet_millis(0),
+        forwarding_latency_samples(0),
+        avg_forwarding_latency_micros(0),
+        max_forwarding_latency_micros(0),
+        min_period_millis(0),
+        max_period_millis(0),
+        missed_num(0) {}
   // Packet message id, -1 if not initialized
   int id;
   int32_t total_num;
-  std::vector<uint8_t> last_seen_valid_packet;
+  // Packets identical to the one before them.
+  int32_t unchanged_num;
   unsigned long last_packet_millis;
-  int32_t mean_period_millis() const { return (int32_t)mean_and_dev_.mean(); }
-  int32_t deviation_millis() const { return (int32_t)mean_and_dev_.sd(); };
+  // Time from the first byte of a packet arriving from the BMS to the first
+  // byte of it going out to the MB. Only tracked if the relay has a micros
+  // provider.
+  int32_t forwarding_latency_samples;
+  // Exponential moving average, 1/8 weight for the newest sample.
+  int32_t avg_forwarding_latency_micros;
+  int32_t max_forwarding_latency_micros;
+  // Time from the first byte of a packet arriving from the BMS to its last
+  // byte going out to the MB, for packets that got forwarded. The last
+  // bucket holds everything from 16ms up.
+  LogHistogram<16> relay_latency_micros;
+
+  // Time between packets of this type. All integer math, the ESP8266 has no
+  // FPU. Mean and deviation are exponential moving averages with 1/16 weight
+  // for the newest interval.
+  int32_t mean_period_millis() const { return (period_ewma_q4_ + 8) / 16; }
+  int32_t deviation_millis() const;
+  uint32_t min_period_millis;
+  uint32_t max_period_millis;
+  // The last bucket holds everything from 2048ms up.
+  LogHistogram<13> period_millis;
+  // Packets that most likely got lost on the way, estimated from intervals
+  // over 1.5 times the mean period.
+  int32_t missed_num;
 
  private:
-  Welford<float> mean_and_dev_;
+  void addPeriod(uint32_t millis);
+
+  // In 1/16 of a millisecond.
+  int32_t period_ewma_q4_ = 0;
+  // Moving average of the squared difference to the mean, in ms^2.
+  uint32_t period_variance_ = 0;
   friend class PacketTracker;
 };
 
@@ -29,27 +84,79 @@ struct GlobalStats {
       : total_known_packets_received(0),
         total_known_bytes_received(0),
         total_packet_checksum_mismatches(0),
-        total_unknown_bytes_received(0) {}
+        total_unknown_bytes_received(0),
+        total_packets_recovered_by_resync(0),
+        total_partial_packets_discarded(0),
+        total_rx_bytes_dropped(0) {}
   int32_t total_known_packets_received;
   int32_t total_known_bytes_received;
   int32_t total_packet_checksum_mismatches;
   int32_t total_unknown_bytes_received;
+  // Valid packets that started within data that failed to match the packet
+  // header, e.g. the second FF in FF FF 55 AA.
+  int32_t total_packets_recovered_by_resync;
+  // Dropped headers that had at least two bytes of preamble matched.
+  int32_t total_partial_packets_discarded;
+  // Bytes the receiver had to throw away before the relay got to them, e.g.
+  // because its buffer was full.
+  int32_t total_rx_bytes_dropped;
 };
 
 class PacketTracker {
  public:
-  PacketTracker();
-
-  void processPacket(const Packet& packet, const unsigned long millis);
+  /**
+   * @brief Replayed packets are ignored, the rest gets counted and valid ones
+   * are stored as the last seen packet of their type.
+   *
+   * @return false if the packet is identical to the stored one or replayed.
+   */
+  bool processPacket(const Packet& packet, const unsigned long millis);
   void unknownBytes(int num);
+  void packetRecoveredByResync() {
+    global_stats_.total_packets_recovered_by_resync++;
+  }
+  void partialPacketDiscarded() {
+    global_stats_.total_partial_packets_discarded++;
+  }
+  void rxBytesDropped(uint32_t num) {
+    global_stats_.total_rx_bytes_dropped += num;
+  }
+  /**
+   * @brief Estimates when the BMS sends its next packet from the periods of
+   * the types seen so far. Types that are well overdue are left out, they
+   * might not come at all.
+   *
+   * @return 0 if a packet is due right now, ULONG_MAX if there's no telling.
+   */
+  unsigned long millisUntilNextPacket(unsigned long now_millis) const;
+  void forwardingLatency(int type, unsigned long micros);
+  void relayLatency(int type, unsigned long micros);
   const GlobalStats& getGlobalStats() const { return global_stats_; }
-  const std::vector<IndividualPacketStat>& getIndividualPacketStats() const {
+  const std::array<IndividualPacketStat, NUM_PACKET_TYPES>&
+  getIndividualPacketStats() const {
     return individual_packet_stats_;
   }
 
+  /**
+   * @brief Last valid packet of the given type, PACKET_LENGTHS_BY_TYPE[type]
+   * bytes long. nullptr if none was seen yet.
+   */
+  uint8_t* getLastValidPacket(int type) {
+    if (type < 0 || type >= (int)NUM_PACKET_TYPES ||
+        individual_packet_stats_[type].total_num == 0) {
+      return nullptr;
+    }
+    return &last_valid_packets_[PACKET_SLOT_OFFSETS[type]];
+  }
+  const uint8_t* getLastValidPacket(int type) const {
+    return const_cast<PacketTracker*>(this)->getLastValidPacket(type);
+  }
+
  private:
   GlobalStats global_stats_;
-  std::vector<IndividualPacketStat> individual_packet_stats_;
+  std::array<IndividualPacketStat, NUM_PACKET_TYPES> individual_packet_stats_;
+  // One fixed size slot per packet type.
+  uint8_t last_valid_packets_[PACKET_SLOT_OFFSETS[NUM_PACKET_TYPES]];
 };
 
 #endif
\ No newline at end of file
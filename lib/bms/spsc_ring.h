@@ -0,0 +1,106 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// The producer side runs in interrupt context on the ESP8266 where it has to
+// stay in IRAM, i.e. it can't be left to an out of line copy in flash.
+#define SPSC_RING_INLINE inline __attribute__((always_inline))
+
+/**
+ * @brief Lock-free ring buffer for exactly one producer and one consumer,
+ * e.g. an interrupt handler and the main loop, or two threads. The producer
+ * only ever writes head_ and the consumer only tail_, both are free running
+ * counters so that all N slots can be used.
+ *
+ * Nothing gets overwritten, pushing into a full ring pushes as much as fits
+ * and leaves the rest to the caller.
+ */
+template <class T, uint32_t N>
+class SpscRing {
+ public:
+  static_assert(N > 0 && (N & (N - 1)) == 0, "Size must be a power of two");
+
+  static constexpr uint32_t capacity() { return N; }
+
+  // Producer side.
+
+  /**
+   * @return number of elements pushed, less than len if the ring got full.
+   */
+  SPSC_RING_INLINE uint32_t push(const T* data, uint32_t len) {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    const uint32_t free = N - (head - tail_.load(std::memory_order_acquire));
+    if (len > free) {
+      len = free;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+      buffer_[(head + i) & (N - 1)] = data[i];
+    }
+    head_.store(head + len, std::memory_order_release);
+    return len;
+  }
+
+  SPSC_RING_INLINE bool push(const T& value) { return push(&value, 1) == 1; }
+
+  /**
+   * @brief Number of elements ever pushed, wraps around at 2^32.
+   */
+  SPSC_RING_INLINE uint32_t totalPushed() const {
+    return head_.load(std::memory_order_relaxed);
+  }
+
+  // Consumer side.
+
+  /**
+   * @return number of elements copied into out.
+   */
+  uint32_t pop(T* out, uint32_t maxLen) {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t len = head_.load(std::memory_order_acquire) - tail;
+    if (len > maxLen) {
+      len = maxLen;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+      out[i] = buffer_[(tail + i) & (N - 1)];
+    }
+    tail_.store(tail + len, std::memory_order_release);
+    return len;
+  }
+
+  /**
+   * @brief Copies the oldest element without removing it.
+   * @return false if the ring is empty.
+   */
+  bool front(T* out) const {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+    *out = buffer_[tail & (N - 1)];
+    return true;
+  }
+
+  /**
+   * @brief Number of elements ever popped, wraps around at 2^32.
+   */
+  uint32_t totalPopped() const {
+    return tail_.load(std::memory_order_relaxed);
+  }
+
+  // Either side.
+
+  uint32_t size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+
+ private:
+  T buffer_[N];
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+};
+
+#endif  // SPSC_RING_H
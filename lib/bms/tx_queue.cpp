@@ -0,0 +1,59 @@
+#include "tx_queue.h"
+
+#include <algorithm>
+#include <cstring>
+
+void TxQueue::write(const uint8_t* data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  // Anything already queued has to go out first to keep the byte order.
+  pump();
+  size_t written = 0;
+  if (size_ == 0) {
+    written = writeToUart(data, len);
+    if (written == len) {
+      return;
+    }
+  }
+  stats_.would_block_count++;
+  const size_t remaining = len - written;
+  if (remaining > CAPACITY - size_) {
+    stats_.dropped_bytes += remaining;
+    stats_.dropped_writes++;
+    return;
+  }
+  enqueue(data + written, remaining);
+}
+
+void TxQueue::pump() {
+  while (size_ > 0) {
+    // Up to the end of the buffer, the wrapped part goes on the next pass.
+    const size_t contiguous = std::min(size_, CAPACITY - head_);
+    const size_t written = writeToUart(buffer_ + head_, contiguous);
+    head_ = (head_ + written) % CAPACITY;
+    size_ -= written;
+    if (written < contiguous) {
+      return;
+    }
+  }
+}
+
+size_t TxQueue::writeToUart(const uint8_t* data, size_t len) {
+  const size_t len_to_write = std::min(available_for_write_(), len);
+  if (len_to_write > 0) {
+    write_(data, len_to_write);
+  }
+  return len_to_write;
+}
+
+void TxQueue::enqueue(const uint8_t* data, size_t len) {
+  size_t tail = (head_ + size_) % CAPACITY;
+  const size_t first = std::min(len, CAPACITY - tail);
+  memcpy(buffer_ + tail, data, first);
+  memcpy(buffer_, data + first, len - first);
+  size_ += len;
+  if (size_ > stats_.high_water_bytes) {
+    stats_.high_water_bytes = size_;
+  }
+}
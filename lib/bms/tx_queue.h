@@ -0,0 +1,76 @@
+#ifndef TX_QUEUE_H
+#define TX_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+struct TxQueueStats {
+  TxQueueStats()
+      : high_water_bytes(0),
+        would_block_count(0),
+        dropped_bytes(0),
+        dropped_writes(0) {}
+  // Most bytes ever waiting in the queue.
+  uint32_t high_water_bytes;
+  // Writes that the UART couldn't take in full right away, i.e. the ones
+  // that would have stalled a blocking write. Dropped writes count here too.
+  uint32_t would_block_count;
+  // Data dropped because the queue was full.
+  uint32_t dropped_bytes;
+  uint32_t dropped_writes;
+};
+
+/**
+ * @brief Bounded queue in front of the UART that never blocks. Data goes
+ * straight to the UART as long as it has room, the rest waits here until
+ * pump() gets it out.
+ */
+class TxQueue {
+ public:
+  static constexpr size_t CAPACITY = 256;
+
+  /**
+   * @brief Returns how many bytes the UART can take without blocking.
+   */
+  typedef std::function<size_t()> AvailableForWrite;
+  /**
+   * @brief Hands data to the UART, only ever called with as many bytes as
+   * AvailableForWrite allowed.
+   */
+  typedef std::function<void(const uint8_t* data, size_t len)> Write;
+
+  TxQueue(const AvailableForWrite& availableForWrite, const Write& write)
+      : available_for_write_(availableForWrite), write_(write) {}
+
+  /**
+   * @brief Sends or queues the data. A write that doesn't fit into the queue
+   * is dropped as a whole, so a packet written at once never goes out
+   * truncated. With cut-through forwarding a packet comes in several writes
+   * though, and dropping a later one leaves the MB a truncated packet.
+   */
+  void write(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Moves queued data to the UART as far as it has room. Must be
+   * called continuously.
+   */
+  void pump();
+
+  size_t size() const { return size_; }
+  const TxQueueStats& getStats() const { return stats_; }
+
+ private:
+  // Writes out up to len bytes without blocking, returns how many went out.
+  size_t writeToUart(const uint8_t* data, size_t len);
+  void enqueue(const uint8_t* data, size_t len);
+
+  const AvailableForWrite available_for_write_;
+  const Write write_;
+  uint8_t buffer_[CAPACITY];
+  size_t head_ = 0;
+  size_t size_ = 0;
+  TxQueueStats stats_;
+};
+
+#endif  // TX_QUEUE_H
@@ -0,0 +1,62 @@
+#include "tx_scheduler.h"
+
+namespace {
+
+// The MB shuts down quickly without these, everything else follows in type
+// order.
+constexpr uint8_t PRIORITY_TYPES[] = {0, 3};
+
+bool isDue(uint32_t due, uint8_t type) { return (due >> type) & 1; }
+
+}  // namespace
+
+void TxScheduler::schedule(uint8_t type, unsigned long deadline) {
+  deadlines_.schedule(type, deadline);
+  due_ &= ~((uint32_t)1 << type);
+}
+
+unsigned long TxScheduler::frameMillis(uint8_t type) {
+  return (PACKET_LENGTHS_BY_TYPE[type] * BYTE_MICROS + 999) / 1000;
+}
+
+int TxScheduler::nextReplay(const BusState& bus) {
+  while (!deadlines_.empty() &&
+         (int32_t)(bus.now_millis - deadlines_.topDeadline()) >= 0) {
+    const uint8_t type = deadlines_.top();
+    due_ |= (uint32_t)1 << type;
+    due_millis_[type] = deadlines_.topDeadline();
+    deadlines_.pop();
+  }
+  if (due_ == 0 || bus.mid_packet || bus.quiet_millis < MIN_QUIET_MILLIS ||
+      (replayed_ &&
+       bus.now_millis - last_replay_millis_ < REPLAY_SPACING_MILLIS)) {
+    return -1;
+  }
+
+  int type = -1;
+  for (uint8_t priorityType : PRIORITY_TYPES) {
+    if (isDue(due_, priorityType)) {
+      type = priorityType;
+      break;
+    }
+  }
+  if (type < 0) {
+    for (uint8_t t = 0; t < NUM_PACKET_TYPES; t++) {
+      if (isDue(due_, t)) {
+        type = t;
+        break;
+      }
+    }
+  }
+  // Leaves a millisecond for the BMS being a little early.
+  const bool fits = frameMillis(type) + 1 <= bus.millis_until_next_packet;
+  const bool overdue =
+      bus.now_millis - due_millis_[type] >= MAX_REPLAY_DELAY_MILLIS;
+  if (!fits && !overdue) {
+    return -1;
+  }
+  due_ &= ~((uint32_t)1 << type);
+  replayed_ = true;
+  last_replay_millis_ = bus.now_millis;
+  return type;
+}
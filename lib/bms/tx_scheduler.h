@@ -0,0 +1,72 @@
+#ifndef TX_SCHEDULER_H
+#define TX_SCHEDULER_H
+
+#include <cstdint>
+
+#include "deadline_queue.h"
+#include "packet_tracker.h"
+
+// What the relay knows about the MB line when it's looking for a place to
+// put a replayed packet.
+struct BusState {
+  unsigned long now_millis;
+  // Time since the last byte came in from the BMS.
+  unsigned long quiet_millis;
+  // Part of a packet was received, the rest of it is still to come.
+  bool mid_packet;
+  // Until the BMS most likely sends its next packet, see
+  // PacketTracker::millisUntilNextPacket().
+  unsigned long millis_until_next_packet;
+};
+
+/**
+ * @brief Decides when stored packets get replayed to the MB. Replays become
+ * due once their type timed out, and then wait for a gap in the live traffic
+ * that's long enough to fit them. At most one goes out at a time, status and
+ * SOC packets first.
+ */
+class TxScheduler {
+ public:
+  // Bus has to be quiet for this long before anything is replayed.
+  static constexpr unsigned long MIN_QUIET_MILLIS = 2;
+  // Minimum time between two replays.
+  static constexpr unsigned long REPLAY_SPACING_MILLIS = 20;
+  // Replays that waited this long stop waiting for a predicted gap and go
+  // out at the next packet boundary.
+  static constexpr unsigned long MAX_REPLAY_DELAY_MILLIS = 200;
+  // One byte at 115200 baud, 8N1.
+  static constexpr uint32_t BYTE_MICROS = 87;
+
+  /**
+   * @brief Replay the type at the deadline unless it gets scheduled again
+   * before. Clears a pending replay of the type.
+   */
+  void schedule(uint8_t type, unsigned long deadline);
+
+  /**
+   * @return packet type to replay right now, -1 if nothing should go out.
+   */
+  int nextReplay(const BusState& bus);
+
+  /**
+   * @brief Whether nextReplay() could return anything at this time.
+   */
+  bool hasDueReplays(unsigned long now_millis) const {
+    return due_ != 0 ||
+           (!deadlines_.empty() &&
+            (int32_t)(now_millis - deadlines_.topDeadline()) >= 0);
+  }
+
+ private:
+  // Whole milliseconds the packet occupies the line for, rounded up.
+  static unsigned long frameMillis(uint8_t type);
+
+  DeadlineQueue<NUM_PACKET_TYPES> deadlines_;
+  static_assert(NUM_PACKET_TYPES <= 32, "Due types are kept in a bitmask");
+  uint32_t due_ = 0;
+  unsigned long due_millis_[NUM_PACKET_TYPES];
+  bool replayed_ = false;
+  unsigned long last_replay_millis_ = 0;
+};
+
+#endif  // TX_SCHEDULER_H
@@ -0,0 +1,60 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+std::atomic<uint64_t> bytesInUse(0);
+std::atomic<uint64_t> bytesPeak(0);
+
+// Every block starts with its size, padded so that the rest stays aligned
+// like malloc would have it.
+constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+
+}  // namespace
+
+uint64_t allocationCount() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t heapBytesInUse() { return bytesInUse.load(std::memory_order_relaxed); }
+
+uint64_t heapBytesPeak() { return bytesPeak.load(std::memory_order_relaxed); }
+
+void resetHeapPeak() {
+  bytesPeak.store(heapBytesInUse(), std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = malloc(HEADER_SIZE + size)) {
+    *(size_t*)p = size;
+    const uint64_t inUse =
+        bytesInUse.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = bytesPeak.load(std::memory_order_relaxed);
+    while (inUse > peak && !bytesPeak.compare_exchange_weak(
+                               peak, inUse, std::memory_order_relaxed)) {
+    }
+    return (char*)p + HEADER_SIZE;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void* p) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  void* const block = (char*)p - HEADER_SIZE;
+  bytesInUse.fetch_sub(*(size_t*)block, std::memory_order_relaxed);
+  free(block);
+}
+
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
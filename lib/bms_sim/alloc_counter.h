@@ -0,0 +1,19 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+/**
+ * @brief Number of heap allocations through operator new so far. Linking
+ * bms_sim replaces the global operator new and delete to count them, which
+ * is why it's a native only library.
+ */
+uint64_t allocationCount();
+
+// Bytes currently allocated through operator new.
+uint64_t heapBytesInUse();
+// Most bytes ever in use at once since the last resetHeapPeak().
+uint64_t heapBytesPeak();
+void resetHeapPeak();
+
+#endif  // ALLOC_COUNTER_H
@@ -0,0 +1,390 @@
+#include "board_sim.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "alloc_counter.h"
+#include "bms_relay_core.h"
+#include "flash_emulator.h"
+#include "nvs.h"
+#include "packet.h"
+#include "spsc_ring.h"
+#include "tx_scheduler.h"
+
+const PacketSchedule PINT_PACKET_SCHEDULE[] = {
+    {0, 100, 5},    {5, 100, 5},    {2, 1000, 20},  {3, 1000, 20},
+    {4, 1000, 20},  {6, 1000, 20},  {7, 1000, 20},  {8, 1000, 20},
+    {9, 1000, 20},  {11, 0, 0},     {12, 1000, 20}, {13, 1000, 20},
+    {15, 1000, 20}, {16, 1000, 20}, {17, 1000, 20}};
+const size_t PINT_PACKET_SCHEDULE_SIZE =
+    sizeof(PINT_PACKET_SCHEDULE) / sizeof(PINT_PACKET_SCHEDULE[0]);
+
+namespace {
+
+// Same as the ESP8266's.
+constexpr size_t UART_TX_FIFO_SIZE = 128;
+// The settings sectors, see src/settings.cpp.
+constexpr size_t FLASH_SECTOR_SIZE = 4096;
+constexpr size_t FLASH_SECTORS = 4;
+constexpr int32_t CURRENT_UNIT_MILLIAMPS = 55;
+constexpr int32_t PACK_CAPACITY_MILLIAMP_SECONDS = 3500 * 3600;
+
+struct WireByte {
+  uint64_t micros;
+  uint8_t b;
+};
+
+// Where the ride is at.
+struct Ride {
+  int32_t current_milliamps = 0;
+  // Positive is discharging, like the BMS reports it.
+  int64_t milliamp_seconds_used = PACK_CAPACITY_MILLIAMP_SECONDS / 10;
+  bool charging = false;
+  uint64_t last_update_micros = 0;
+};
+
+}  // namespace
+
+struct BoardSim::Board {
+  struct Source {
+    Board* board;
+    size_t operator()(uint8_t* buffer, size_t maxLen) const {
+      return board->uart_rx.pop(buffer, maxLen);
+    }
+    uint32_t takeDroppedBytes() const {
+      const uint32_t dropped = board->uart_rx_dropped;
+      board->uart_rx_dropped = 0;
+      return dropped;
+    }
+  };
+  struct Sink {
+    Board* board;
+    void operator()(const uint8_t* data, size_t len) const {
+      board->tx_queue.write(data, len);
+    }
+  };
+  // 32 bits like the ESP8266's, micros() wraps every 71.6 minutes.
+  struct Clock {
+    const BoardSim* sim;
+    unsigned long millis() const { return (uint32_t)sim->millis(); }
+    unsigned long micros() const { return (uint32_t)sim->micros(); }
+    bool hasMicros() const { return true; }
+  };
+  typedef BmsRelayCore<Source, Sink, Clock> Relay;
+
+  explicit Board(BoardSim* sim)
+      : tx_queue([this]() { return UART_TX_FIFO_SIZE - uart_tx_fifo; },
+                 [this, sim](const uint8_t*, size_t len) {
+                   uart_tx_fifo += len;
+                   sim->stats_.bytes_to_mb += len;
+                 }),
+        relay(Source{this}, Sink{this}, Clock{sim}),
+        task_queue([sim]() { return (uint32_t)sim->millis(); }),
+        flash(FLASH_SECTOR_SIZE, FLASH_SECTORS),
+        storage(&flash, FLASH_SECTOR_SIZE, FLASH_SECTORS) {}
+
+  // The fields of saveSettings() that change, in a batch like it does.
+  bool saveSettings() {
+    const FuelGaugeState& state = relay.getBatteryFuelGauge().getState();
+    storage.startBatch();
+    bool ok =
+        storage.setUint64("quick_power_cycle_count", quick_power_cycle_count);
+    ok = storage.setUint64("has_battery_state", 1) && ok;
+    ok = storage.setInt64("bottom_milliamp_seconds",
+                          state.bottomMilliampSeconds) &&
+         ok;
+    ok = storage.setInt64("current_milliamp_seconds",
+                          state.currentMilliampSeconds) &&
+         ok;
+    ok = storage.setInt64("top_soc", state.topSoc) && ok;
+    ok = storage.setInt64("bottom_soc", state.bottomSoc) && ok;
+    return storage.commitBatch() && ok;
+  }
+
+  // Bytes on their way from the BMS, with their arrival times.
+  SpscRing<WireByte, 1024> wire;
+  uint64_t wire_free_micros = 0;
+  // The UART receive buffer, see uart_rx.cpp.
+  SpscRing<uint8_t, 512> uart_rx;
+  uint32_t uart_rx_dropped = 0;
+  // Bytes the UART still has to shift out.
+  size_t uart_tx_fifo = 0;
+  uint64_t uart_tx_drained_micros = 0;
+
+  TxQueue tx_queue;
+  Relay relay;
+  TaskQueueType task_queue;
+  FlashEmulator flash;
+  NonVolatileStorage storage;
+  unsigned long last_save_millis = 0;
+  uint32_t quick_power_cycle_count = 0;
+
+  uint8_t packets[sizeof(PACKET_LENGTHS_BY_TYPE)][MAX_PACKET_LENGTH];
+  uint64_t next_send_micros[sizeof(PINT_PACKET_SCHEDULE) /
+                            sizeof(PINT_PACKET_SCHEDULE[0])];
+  Ride ride;
+};
+
+template <class Write>
+void BoardSim::save(const Write& write) {
+  const uint64_t allocationsBefore = allocationCount();
+  stats_.settings_saves++;
+  if (!write()) {
+    stats_.failed_settings_saves++;
+  }
+  stats_.settings_allocations += allocationCount() - allocationsBefore;
+}
+
+void BoardSim::saveSettings() {
+  save([this]() { return board_->saveSettings(); });
+}
+
+BoardSim::BoardSim(const Config& config)
+    : config_(config), rng_(config.seed), board_(new Board(this)) {
+  for (const auto& packet : PINT_PACKETS) {
+    memcpy(board_->packets[packet[3]], packet.data(), packet.size());
+  }
+  for (size_t i = 0; i < PINT_PACKET_SCHEDULE_SIZE; i++) {
+    // Spread out over the first period.
+    board_->next_send_micros[i] =
+        1000ULL * rng_.below(PINT_PACKET_SCHEDULE[i].period_millis + 1);
+  }
+  Board* const board = board_.get();
+  board_->relay.setCutThroughForwarding(true);
+  board_->task_queue.postRecurringTask([board]() {
+    board->tx_queue.pump();
+    board->relay.loop();
+  });
+
+  // Boots like main.cpp: counts the power cycle and resets the count 5s in.
+  if (!board_->storage.begin()) {
+    board_->storage.format(0);
+  }
+  board_->quick_power_cycle_count = 1;
+  saveSettings();
+  board_->task_queue.postOneShotTask(
+      [this, board]() {
+        board->quick_power_cycle_count = 0;
+        saveSettings();
+      },
+      5000);
+  if (config_.settings_save_millis > 0) {
+    board_->task_queue.postRecurringTask([this, board]() {
+      if ((uint32_t)(millis() - board->last_save_millis) <
+          config_.settings_save_millis) {
+        return;
+      }
+      board->last_save_millis = millis();
+      saveSettings();
+    });
+  }
+}
+
+BoardSim::~BoardSim() = default;
+
+BmsRelay& BoardSim::relay() { return board_->relay; }
+
+const BmsRelay& BoardSim::relay() const { return board_->relay; }
+
+TaskQueueType& BoardSim::taskQueue() { return board_->task_queue; }
+
+const TxQueue& BoardSim::txQueue() const { return board_->tx_queue; }
+
+const FlashEmulator& BoardSim::flash() const { return board_->flash; }
+
+const NonVolatileStorage& BoardSim::storage() const {
+  return board_->storage;
+}
+
+void BoardSim::run(uint64_t millis) {
+  const uint64_t allocationsBefore =
+      allocationCount() - stats_.settings_allocations;
+  const uint64_t heapBefore = heapBytesInUse();
+  resetHeapPeak();
+
+  const uint64_t end = now_micros_ + millis * 1000;
+  Board& board = *board_;
+  while (true) {
+    for (size_t i = 0; i < PINT_PACKET_SCHEDULE_SIZE; i++) {
+      if (board.next_send_micros[i] <= now_micros_) {
+        sendPacket(i);
+      }
+    }
+    WireByte byte;
+    while (board.wire.front(&byte) && byte.micros <= now_micros_) {
+      if (!board.uart_rx.push(byte.b)) {
+        board.uart_rx_dropped++;
+      }
+      board.wire.pop(&byte, 1);
+    }
+    const uint64_t drained =
+        (now_micros_ - board.uart_tx_drained_micros) / TxScheduler::BYTE_MICROS;
+    board.uart_tx_drained_micros += drained * TxScheduler::BYTE_MICROS;
+    board.uart_tx_fifo -= std::min<uint64_t>(drained, board.uart_tx_fifo);
+    if (board.uart_tx_fifo == 0) {
+      board.uart_tx_drained_micros = now_micros_;
+    }
+
+    // The firmware's loop().
+    board.task_queue.process();
+    stats_.loops++;
+
+    if (now_micros_ >= end) {
+      break;
+    }
+    now_micros_ = std::min(nextEventMicros(), end);
+  }
+
+  stats_.allocations +=
+      allocationCount() - stats_.settings_allocations - allocationsBefore;
+  stats_.heap_peak_bytes =
+      std::max(stats_.heap_peak_bytes, heapBytesPeak() - heapBefore);
+  stats_.heap_growth_bytes += (int64_t)heapBytesInUse() - (int64_t)heapBefore;
+}
+
+uint64_t BoardSim::nextEventMicros() const {
+  uint64_t next = now_micros_ + config_.max_loop_micros;
+  for (size_t i = 0; i < PINT_PACKET_SCHEDULE_SIZE; i++) {
+    next = std::min(next, board_->next_send_micros[i]);
+  }
+  return std::max(next, now_micros_ + 1);
+}
+
+void BoardSim::sendPacket(size_t scheduleIndex) {
+  const PacketSchedule& schedule = PINT_PACKET_SCHEDULE[scheduleIndex];
+  Board& board = *board_;
+  uint64_t& nextSend = board.next_send_micros[scheduleIndex];
+  if (schedule.period_millis == 0) {
+    nextSend = UINT64_MAX;
+  } else {
+    const int32_t jitter =
+        (int32_t)rng_.below(2 * schedule.jitter_millis + 1) -
+        (int32_t)schedule.jitter_millis;
+    nextSend += 1000 * (int64_t)(schedule.period_millis + jitter);
+  }
+  if (rng_.below(1000) < config_.skip_per_mille) {
+    stats_.packets_skipped++;
+    return;
+  }
+
+  updateRide();
+  uint8_t* const data = board.packets[schedule.type];
+  const uint8_t len = PACKET_LENGTHS_BY_TYPE[schedule.type];
+  Packet packet(data, len);
+  const Ride& ride = board.ride;
+  const int32_t soc =
+      100 - ride.milliamp_seconds_used * 100 / PACK_CAPACITY_MILLIAMP_SECONDS;
+  switch (schedule.type) {
+    case 0:
+      packet.setDataByte(0, ride.charging ? 0x20 : 0);
+      break;
+    case 2: {
+      // Linear enough between 3.3V and 4.15V, a little sag under load and
+      // cells that aren't perfectly balanced.
+      const int32_t ocv = 3300 + 850 * soc / 100;
+      for (int i = 0; i < 15; i++) {
+        const int32_t millivolts = ocv - ride.current_milliamps / 50 +
+                                   (i % 5) * 2 + (int32_t)rng_.below(3);
+        packet.setDataByte(2 * i, millivolts >> 8);
+        packet.setDataByte(2 * i + 1, millivolts & 0xFF);
+      }
+      break;
+    }
+    case 3:
+      packet.setDataByte(0, std::max<int32_t>(0, std::min<int32_t>(100, soc)));
+      break;
+    case 4:
+      for (int i = 0; i < 5; i++) {
+        packet.setDataByte(
+            i, 22 + std::abs(ride.current_milliamps) / 2000 + rng_.below(2));
+      }
+      break;
+    case 5: {
+      const int16_t current = ride.current_milliamps / CURRENT_UNIT_MILLIAMPS;
+      packet.setDataByte(0, (uint16_t)current >> 8);
+      packet.setDataByte(1, current & 0xFF);
+      break;
+    }
+  }
+
+  const uint64_t start = std::max(now_micros_, board.wire_free_micros);
+  for (uint8_t i = 0; i < len; i++) {
+    if (!board.wire.push(
+            WireByte{start + (i + 1) * TxScheduler::BYTE_MICROS, data[i]})) {
+      // The BMS can't send faster than the wire goes.
+      break;
+    }
+  }
+  board.wire_free_micros = start + len * TxScheduler::BYTE_MICROS;
+  stats_.packets_sent++;
+  stats_.bytes_from_bms += len;
+}
+
+void BoardSim::updateRide() {
+  Ride& ride = board_->ride;
+  const uint64_t elapsedMillis = (now_micros_ - ride.last_update_micros) / 1000;
+  ride.last_update_micros += elapsedMillis * 1000;
+  ride.milliamp_seconds_used += ride.current_milliamps * elapsedMillis / 1000;
+
+  // Riding for half of the cycle, then parked, then on the charger.
+  const uint64_t phase = now_micros_ / 1000 % config_.ride_cycle_millis;
+  if (phase < config_.ride_cycle_millis / 2) {
+    // Wandering around 2A, up to 20A going up hills and down to -5A of
+    // regen.
+    ride.current_milliamps += (int32_t)rng_.below(801) - 400;
+    ride.current_milliamps += (2000 - ride.current_milliamps) / 50;
+    ride.current_milliamps =
+        std::max(-5000, std::min(20000, ride.current_milliamps));
+    ride.charging = false;
+  } else if (phase < config_.ride_cycle_millis * 3 / 4) {
+    ride.current_milliamps = 50;
+    ride.charging = false;
+  } else {
+    ride.charging = ride.milliamp_seconds_used > 0;
+    ride.current_milliamps = ride.charging ? -2000 : 0;
+  }
+  ride.milliamp_seconds_used =
+      std::max<int64_t>(0, std::min<int64_t>(PACK_CAPACITY_MILLIAMP_SECONDS,
+                                             ride.milliamp_seconds_used));
+}
+
+void printBoardSimStats(const BoardSim& sim) {
+  const BoardSimStats& stats = sim.stats();
+  const GlobalStats& global =
+      sim.relay().getPacketTracker().getGlobalStats();
+  const TxQueueStats& tx = sim.txQueue().getStats();
+  printf("board time          %10.1f h\n", sim.micros() / 3.6e9);
+  printf("loops               %10llu\n", (unsigned long long)stats.loops);
+  printf("packets sent        %10llu (%llu skipped)\n",
+         (unsigned long long)stats.packets_sent,
+         (unsigned long long)stats.packets_skipped);
+  printf("bytes from BMS      %10llu\n",
+         (unsigned long long)stats.bytes_from_bms);
+  printf("bytes to MB         %10llu\n", (unsigned long long)stats.bytes_to_mb);
+  printf("checksum mismatches %10u\n",
+         (unsigned)global.total_packet_checksum_mismatches);
+  printf("rx bytes dropped    %10u\n", (unsigned)global.total_rx_bytes_dropped);
+  printf("tx high water       %10u bytes, %u dropped\n",
+         (unsigned)tx.high_water_bytes, (unsigned)tx.dropped_bytes);
+  printf("allocations         %10llu\n", (unsigned long long)stats.allocations);
+  printf("heap peak           %10llu bytes\n",
+         (unsigned long long)stats.heap_peak_bytes);
+  printf("heap growth         %10lld bytes\n",
+         (long long)stats.heap_growth_bytes);
+  const FlashEmulator& flash = sim.flash();
+  uint64_t maxEraseCount = 0;
+  for (size_t sector = 0; sector < flash.sectorCount(); sector++) {
+    maxEraseCount = std::max(maxEraseCount, flash.eraseCount(sector));
+  }
+  printf("settings saves      %10llu (%llu failed, %llu allocations)\n",
+         (unsigned long long)stats.settings_saves,
+         (unsigned long long)stats.failed_settings_saves,
+         (unsigned long long)stats.settings_allocations);
+  printf("flash programmed    %10llu bytes, %llu erases, %llu most per "
+         "sector\n",
+         (unsigned long long)flash.stats().bytes_programmed,
+         (unsigned long long)flash.stats().erases,
+         (unsigned long long)maxEraseCount);
+}
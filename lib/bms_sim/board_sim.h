@@ -0,0 +1,121 @@
+#ifndef BOARD_SIM_H
+#define BOARD_SIM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "bms_relay.h"
+#include "task_queue_type.h"
+#include "tx_queue.h"
+#include "workload.h"
+
+// How often the BMS sends a packet type, and how much that varies.
+struct PacketSchedule {
+  uint8_t type;
+  uint32_t period_millis;
+  uint32_t jitter_millis;
+};
+
+// Rough periods of a Pint BMS. Type 11 only comes once after power up.
+extern const PacketSchedule PINT_PACKET_SCHEDULE[];
+extern const size_t PINT_PACKET_SCHEDULE_SIZE;
+
+struct BoardSimStats {
+  uint64_t loops = 0;
+  uint64_t packets_sent = 0;
+  uint64_t packets_skipped = 0;
+  uint64_t bytes_from_bms = 0;
+  uint64_t bytes_to_mb = 0;
+  // Heap use of everything the run() calls did but save settings, the
+  // simulator's own buffers are all allocated up front.
+  uint64_t allocations = 0;
+  // Most bytes the run() calls had on the heap on top of what was there
+  // before them.
+  uint64_t heap_peak_bytes = 0;
+  // Left on the heap by the run() calls, should stay flat over a soak.
+  int64_t heap_growth_bytes = 0;
+  uint64_t settings_saves = 0;
+  uint64_t failed_settings_saves = 0;
+  // NonVolatileStorage builds batches on the heap.
+  uint64_t settings_allocations = 0;
+};
+
+class FlashEmulator;
+class NonVolatileStorage;
+
+/**
+ * @brief The board on a virtual clock. A simulated BMS sends every packet
+ * type at its own rate, with jitter and the values of a ride going on. The
+ * relay, TxQueue and TaskQueueType in between are wired up like
+ * bms_main.cpp does it, and both UART lines move data at 115200 baud.
+ * Settings are saved to NonVolatileStorage on a FlashEmulator the size of
+ * the board's settings sectors.
+ *
+ * The clock jumps straight to the next thing that happens rather than
+ * ticking through every loop, so days of board time take seconds. Heap use
+ * and allocations of whatever runs on the board are tracked along the way.
+ */
+class BoardSim {
+ public:
+  struct Config {
+    uint32_t seed = 1;
+    // Longest the main loop goes without running, the clock steps at least
+    // this often even if nothing happens.
+    uint32_t max_loop_micros = 1000;
+    // Scheduled packets the BMS doesn't send, per thousand, for replays to
+    // cover.
+    uint32_t skip_per_mille = 0;
+    // A ride profile cycles through riding, parking and charging this often.
+    uint32_t ride_cycle_millis = 4 * 3600 * 1000;
+    // How often the settings are saved with the fuel gauge state, like the
+    // power off callback in bms_main.cpp would. 0 only saves them for the
+    // quick power cycle count at boot.
+    uint32_t settings_save_millis = 10 * 60 * 1000;
+  };
+
+  explicit BoardSim(const Config& config);
+  ~BoardSim();
+
+  BmsRelay& relay();
+  const BmsRelay& relay() const;
+  // For posting more tasks, like the firmware does.
+  TaskQueueType& taskQueue();
+  const TxQueue& txQueue() const;
+  // The settings sectors and what's stored in them.
+  const FlashEmulator& flash() const;
+  const NonVolatileStorage& storage() const;
+
+  // Board time since the simulation started.
+  uint64_t micros() const { return now_micros_; }
+  unsigned long millis() const { return now_micros_ / 1000; }
+
+  /**
+   * @brief Runs for the given board time, stats accumulate over all calls.
+   */
+  void run(uint64_t millis);
+  const BoardSimStats& stats() const { return stats_; }
+
+  // Needs to see the simulator's privates.
+  struct Board;
+
+ private:
+  // Puts a packet of PINT_PACKET_SCHEDULE[scheduleIndex] on the wire.
+  void sendPacket(size_t scheduleIndex);
+  void updateRide();
+  void saveSettings();
+  // Calls write(), counting it as a settings save.
+  template <class Write>
+  void save(const Write& write);
+  uint64_t nextEventMicros() const;
+
+  const Config config_;
+  WorkloadRng rng_;
+  uint64_t now_micros_ = 0;
+  BoardSimStats stats_;
+  std::unique_ptr<Board> board_;
+};
+
+void printBoardSimStats(const BoardSim& sim);
+
+#endif  // BOARD_SIM_H
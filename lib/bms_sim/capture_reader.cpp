@@ -0,0 +1,103 @@
+#include "capture_reader.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "capture_recorder.h"
+
+namespace {
+
+uint32_t littleEndian32(const uint8_t* data) {
+  return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+bool readVarint(const uint8_t** data, const uint8_t* end, uint32_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 32; shift += 7) {
+    if (*data == end) {
+      return false;
+    }
+    const uint8_t b = *(*data)++;
+    *value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool parseCapture(const uint8_t* data, size_t len, Capture* capture) {
+  if (len < CaptureRecorder::CAPTURE_HEADER_SIZE ||
+      memcmp(data, "OWCP", 4) != 0 ||
+      data[4] != CaptureRecorder::CAPTURE_VERSION) {
+    return false;
+  }
+  uint32_t micros = littleEndian32(&data[8]);
+  capture->lost_records = littleEndian32(&data[12]);
+  capture->frames.clear();
+  const uint8_t* const end = data + len;
+  data += CaptureRecorder::CAPTURE_HEADER_SIZE;
+  while (data < end) {
+    Capture::Frame frame;
+    frame.flags = *data++;
+    uint32_t delta;
+    uint32_t frameLen;
+    if (!readVarint(&data, end, &delta) ||
+        !readVarint(&data, end, &frameLen) || end - data < frameLen) {
+      return false;
+    }
+    micros += delta;
+    frame.micros = micros;
+    frame.data.assign(data, data + frameLen);
+    data += frameLen;
+    capture->frames.push_back(std::move(frame));
+  }
+  return true;
+}
+
+bool readCaptureFile(const std::string& path, Capture* capture) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + len);
+  }
+  fclose(file);
+  return parseCapture(data.data(), data.size(), capture);
+}
+
+Workload workloadFromCapture(const Capture& capture, const std::string& name) {
+  Workload workload;
+  workload.name = name;
+  bool first = true;
+  uint32_t startMicros = 0;
+  for (const Capture::Frame& frame : capture.frames) {
+    if (frame.flags & CAPTURE_TO_MB) {
+      continue;
+    }
+    if (first) {
+      startMicros = frame.micros;
+      first = false;
+    }
+    // Recorded when the first byte came in, the workload wants the end.
+    const uint32_t micros = frame.micros - startMicros +
+                            frame.data.size() * WIRE_BYTE_MICROS;
+    const uint32_t end = workload.endMicros();
+    if (micros > end + 1000) {
+      // Idle polls, up to a millisecond before the frame.
+      workload.addIdle(micros - end - 1000);
+    }
+    workload.bytes.insert(workload.bytes.end(), frame.data.begin(),
+                          frame.data.end());
+    workload.chunks.push_back(Workload::Chunk{
+        micros > workload.endMicros() ? micros : workload.endMicros(),
+        (uint32_t)frame.data.size()});
+  }
+  return workload;
+}
@@ -0,0 +1,39 @@
+#ifndef CAPTURE_READER_H
+#define CAPTURE_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "workload.h"
+
+/**
+ * @brief A capture downloaded from the board, see CaptureRecorder for the
+ * format.
+ */
+struct Capture {
+  struct Frame {
+    // Absolute, in the board's micros() time.
+    uint32_t micros;
+    // CaptureFlags.
+    uint8_t flags;
+    std::vector<uint8_t> data;
+  };
+
+  uint32_t lost_records = 0;
+  std::vector<Frame> frames;
+};
+
+// Returns false if the data isn't a complete capture.
+bool parseCapture(const uint8_t* data, size_t len, Capture* capture);
+bool readCaptureFile(const std::string& path, Capture* capture);
+
+/**
+ * @brief What came from the BMS, packets and unknown data, at the times it
+ * came in and with idle polls in between, so that a capture from a ride can
+ * go through RelayReplay like the generated workloads.
+ */
+Workload workloadFromCapture(const Capture& capture, const std::string& name);
+
+#endif  // CAPTURE_READER_H
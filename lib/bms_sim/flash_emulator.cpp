@@ -0,0 +1,72 @@
+#include "flash_emulator.h"
+
+#include <cstring>
+
+FlashEmulator::FlashEmulator(size_t sector_size, size_t sector_count)
+    : sector_size_(sector_size),
+      sector_count_(sector_count),
+      data_(sector_size * sector_count, 0xFF),
+      erase_counts_(sector_count, 0) {}
+
+bool FlashEmulator::step() {
+  if (steps_ == cut_at_) {
+    powered_off_ = true;
+    return false;
+  }
+  steps_++;
+  return true;
+}
+
+bool FlashEmulator::read(size_t address, uint8_t* data, size_t len) {
+  if (powered_off_ || address + len > data_.size()) {
+    return false;
+  }
+  memcpy(data, &data_[address], len);
+  return true;
+}
+
+bool FlashEmulator::program(size_t address, const uint8_t* data, size_t len) {
+  if (powered_off_ || address + len > data_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] != 0xFF && (data_[address + i] & data[i]) != data[i]) {
+      stats_.violations++;
+      return false;
+    }
+  }
+  stats_.program_calls++;
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == 0xFF) {
+      continue;
+    }
+    if (!step()) {
+      return false;
+    }
+    data_[address + i] &= data[i];
+    stats_.bytes_programmed++;
+  }
+  return true;
+}
+
+bool FlashEmulator::eraseSector(size_t sector) {
+  if (powered_off_ || sector >= sector_count_) {
+    return false;
+  }
+  uint8_t* const start = &data_[sector * sector_size_];
+  if (!step()) {
+    memset(start, 0xFF, sector_size_ / 2);
+    return false;
+  }
+  memset(start, 0xFF, sector_size_);
+  erase_counts_[sector]++;
+  stats_.erases++;
+  return true;
+}
+
+void FlashEmulator::cutPowerAfter(uint64_t steps) { cut_at_ = steps_ + steps; }
+
+void FlashEmulator::powerOn() {
+  powered_off_ = false;
+  cut_at_ = ~0ull;
+}
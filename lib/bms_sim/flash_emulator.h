@@ -0,0 +1,67 @@
+#ifndef FLASH_EMULATOR_H
+#define FLASH_EMULATOR_H
+
+#include <cstdint>
+#include <vector>
+
+#include "nvs_flash.h"
+
+struct FlashEmulatorStats {
+  uint64_t program_calls = 0;
+  // Bytes that weren't 0xFF in program calls, what actually got programmed.
+  uint64_t bytes_programmed = 0;
+  uint64_t erases = 0;
+  // Program calls refused for wanting a bit back from 0 to 1.
+  uint64_t violations = 0;
+};
+
+/**
+ * @brief NOR flash in RAM. Erases work on whole sectors, programming only
+ * clears bits, 0xFF bytes in a program call leave the byte as it is, like
+ * the SDK's padding of unaligned writes relies on. Anything else that
+ * would need a 1 where there's a 0 is refused and counted.
+ *
+ * Power can be cut at any step, a step being one programmed byte or one
+ * sector erase. Programs write their bytes in order, so a cut leaves the
+ * first part of it. An erase cut short leaves the sector half erased.
+ */
+class FlashEmulator : public NvsFlash {
+ public:
+  FlashEmulator(size_t sector_size, size_t sector_count);
+
+  bool read(size_t address, uint8_t* data, size_t len) override;
+  bool program(size_t address, const uint8_t* data, size_t len) override;
+  bool eraseSector(size_t sector) override;
+
+  /**
+   * @brief Power goes off after this many more steps, every call fails
+   * from then on until powerOn().
+   */
+  void cutPowerAfter(uint64_t steps);
+  void powerOn();
+  bool poweredOff() const { return powered_off_; }
+  // Steps so far, see cutPowerAfter().
+  uint64_t steps() const { return steps_; }
+
+  size_t sectorSize() const { return sector_size_; }
+  size_t sectorCount() const { return sector_count_; }
+  uint64_t eraseCount(size_t sector) const { return erase_counts_[sector]; }
+  const FlashEmulatorStats& stats() const { return stats_; }
+  std::vector<uint8_t>& data() { return data_; }
+
+ private:
+  // Returns false, and powers off, if the cut point is reached.
+  bool step();
+
+  const size_t sector_size_;
+  const size_t sector_count_;
+  std::vector<uint8_t> data_;
+  std::vector<uint64_t> erase_counts_;
+  uint64_t steps_ = 0;
+  // No cut while this is ~0.
+  uint64_t cut_at_ = ~0ull;
+  bool powered_off_ = false;
+  FlashEmulatorStats stats_;
+};
+
+#endif  // FLASH_EMULATOR_H
@@ -0,0 +1,227 @@
+#include "fuel_gauge_sim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "battery_fuel_gauge.h"
+
+namespace {
+
+constexpr int TENTHS = 10;
+
+class Simulation {
+ public:
+  explicit Simulation(const FuelGaugeSimConfig& config)
+      : config_(config),
+        pack_(config.pack, config.start_soc, config.seed),
+        rng_(config.seed + 1) {}
+
+  FuelGaugeSimReport run() {
+    for (uint32_t cycle = 0; cycle < config_.cycles; cycle++) {
+      const double rideDown = 10 + rng_.below(41);
+      session(/*charging=*/false, std::max(5.0, pack_.soc() - rideDown));
+      rest();
+      const double chargeUp = 20 + rng_.below(41);
+      session(/*charging=*/true, std::min(100.0, pack_.soc() + chargeUp));
+      rest();
+    }
+    return finish();
+  }
+
+ private:
+  struct SessionError {
+    double abs_error_sum;
+    uint32_t samples;
+  };
+
+  void session(bool charging, double targetSoc) {
+    BatteryFuelGauge gauge;
+    if (report_.sessions > 0) {
+      gauge.restoreState(saved_);
+    }
+    gauge.updateChargingStatus(charging);
+    double rideMilliamps = config_.ride_milliamps;
+    const uint32_t stepMillis = config_.current_period_millis;
+    const double stepSeconds = stepMillis / 1000.0;
+    // Last time the error was out of tolerance, -1 if never.
+    int64_t lastOutMillis = -1;
+    bool outAtEnd = false;
+    SessionError error = {0, 0};
+    int64_t nextVoltageMillis = 0;
+    int64_t millis = 0;
+    while (charging ? pack_.soc() < targetSoc : pack_.soc() > targetSoc) {
+      double milliamps = -config_.charge_milliamps;
+      if (!charging) {
+        // Hills, braking and everything in between.
+        rideMilliamps += (config_.ride_milliamps - rideMilliamps) / 50 +
+                         ((double)rng_.below(2001) - 1000);
+        rideMilliamps = std::max(-5000.0, std::min(25000.0, rideMilliamps));
+        milliamps = rideMilliamps;
+      }
+      pack_.step(milliamps, stepSeconds);
+      millis += stepMillis;
+      if (millis >= nextVoltageMillis) {
+        nextVoltageMillis += config_.voltage_period_millis;
+        gauge.updateVoltage(pack_.measuredCellMillivolts(), millis);
+        const double e = gauge.getSoc() - pack_.soc();
+        error.abs_error_sum += std::abs(e);
+        error.samples++;
+        squared_error_sum_ += e * e;
+        report_.max_abs_error = std::max(report_.max_abs_error, std::abs(e));
+        outAtEnd = std::abs(e) > config_.convergence_tolerance;
+        if (outAtEnd) {
+          lastOutMillis = millis;
+        }
+      }
+      gauge.updateCurrent(pack_.measuredCurrentMilliamps(), millis);
+    }
+    saved_ = gauge.getState();
+
+    const double convergenceSeconds =
+        lastOutMillis < 0 ? 0 : lastOutMillis / 1000.0;
+    if (report_.sessions == 0) {
+      report_.first_boot_convergence_seconds = convergenceSeconds;
+    }
+    if (outAtEnd) {
+      report_.unconverged_sessions++;
+    } else {
+      convergence_sum_ += convergenceSeconds;
+      converged_sessions_++;
+      report_.max_convergence_seconds =
+          std::max(report_.max_convergence_seconds, convergenceSeconds);
+    }
+    report_.sessions++;
+    report_.hours += millis / 3.6e6;
+    errors_.push_back(error);
+  }
+
+  void rest() { pack_.step(0, 60.0 * (10 + rng_.below(111))); }
+
+  FuelGaugeSimReport finish() {
+    double absErrorSum = 0;
+    uint32_t samples = 0;
+    report_.error_by_tenth.assign(TENTHS, 0);
+    std::vector<uint32_t> tenthSamples(TENTHS, 0);
+    for (size_t i = 0; i < errors_.size(); i++) {
+      const size_t tenth = i * TENTHS / errors_.size();
+      report_.error_by_tenth[tenth] += errors_[i].abs_error_sum;
+      tenthSamples[tenth] += errors_[i].samples;
+      absErrorSum += errors_[i].abs_error_sum;
+      samples += errors_[i].samples;
+    }
+    for (int i = 0; i < TENTHS; i++) {
+      if (tenthSamples[i] > 0) {
+        report_.error_by_tenth[i] /= tenthSamples[i];
+      }
+    }
+    if (samples > 0) {
+      report_.mean_abs_error = absErrorSum / samples;
+      report_.rms_error = std::sqrt(squared_error_sum_ / samples);
+    }
+    if (converged_sessions_ > 0) {
+      report_.mean_convergence_seconds = convergence_sum_ / converged_sessions_;
+    }
+    report_.final_capacity_mah = pack_.capacityMah();
+    report_.full_equivalent_cycles = pack_.fullEquivalentCycles();
+    return report_;
+  }
+
+  const FuelGaugeSimConfig config_;
+  PackModel pack_;
+  WorkloadRng rng_;
+  FuelGaugeState saved_;
+  FuelGaugeSimReport report_;
+  std::vector<SessionError> errors_;
+  double squared_error_sum_ = 0;
+  double convergence_sum_ = 0;
+  uint32_t converged_sessions_ = 0;
+};
+
+struct Sample {
+  int32_t millis;
+  int32_t value;
+};
+
+template <class F>
+double nanosPerCall(const std::vector<Sample>& samples, F call) {
+  constexpr int REPETITIONS = 20;
+  // Fastest of a few runs, like RelayReplay.
+  double best = 1e30;
+  for (int r = 0; r < REPETITIONS; r++) {
+    BatteryFuelGauge gauge;
+    gauge.updateVoltage(3800, 0);
+    const auto start = std::chrono::steady_clock::now();
+    for (const Sample& sample : samples) {
+      call(gauge, sample);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(end - start).count());
+  }
+  return best * 1e9 / samples.size();
+}
+
+}  // namespace
+
+FuelGaugeSimReport runFuelGaugeSim(const FuelGaugeSimConfig& config) {
+  return Simulation(config).run();
+}
+
+FuelGaugeCost measureFuelGaugeCost(const PackParams& params, uint32_t seed) {
+  // An hour of riding, as the BMS reports it.
+  PackModel pack(params, 90, seed);
+  WorkloadRng rng(seed);
+  std::vector<Sample> voltages;
+  std::vector<Sample> currents;
+  double milliamps = 5000;
+  for (int32_t millis = 100; millis <= 3600 * 1000; millis += 100) {
+    milliamps += (5000 - milliamps) / 50 + ((double)rng.below(2001) - 1000);
+    pack.step(milliamps, 0.1);
+    currents.push_back(Sample{millis, pack.measuredCurrentMilliamps()});
+    if (millis % 1000 == 0) {
+      voltages.push_back(Sample{millis, pack.measuredCellMillivolts()});
+    }
+  }
+
+  FuelGaugeCost cost;
+  cost.nanos_per_voltage_update = nanosPerCall(
+      voltages, [](BatteryFuelGauge& gauge, const Sample& sample) {
+        gauge.updateVoltage(sample.value, sample.millis);
+      });
+  cost.nanos_per_current_update = nanosPerCall(
+      currents, [](BatteryFuelGauge& gauge, const Sample& sample) {
+        gauge.updateCurrent(sample.value, sample.millis);
+      });
+  volatile int32_t soc;
+  cost.nanos_per_get_soc = nanosPerCall(
+      currents, [&soc](BatteryFuelGauge& gauge, const Sample& sample) {
+        soc = gauge.getSoc();
+      });
+  return cost;
+}
+
+void printFuelGaugeSimReport(const std::string& name,
+                             const FuelGaugeSimReport& report) {
+  printf("%s: %u sessions, %.0f hours on, %.0f cycles, %.0f mAh left\n",
+         name.c_str(), report.sessions, report.hours,
+         report.full_equivalent_cycles, report.final_capacity_mah);
+  printf("  SOC error       mean %.2f%%  rms %.2f%%  max %.1f%%\n",
+         report.mean_abs_error, report.rms_error, report.max_abs_error);
+  printf("  by tenth       ");
+  for (double error : report.error_by_tenth) {
+    printf(" %.2f", error);
+  }
+  printf("\n");
+  printf(
+      "  convergence     first boot %.0fs  mean %.0fs  max %.0fs  "
+      "never %u\n",
+      report.first_boot_convergence_seconds, report.mean_convergence_seconds,
+      report.max_convergence_seconds, report.unconverged_sessions);
+}
+
+void printFuelGaugeCost(const FuelGaugeCost& cost) {
+  printf("updateVoltage %.1f ns, updateCurrent %.1f ns, getSoc %.1f ns\n",
+         cost.nanos_per_voltage_update, cost.nanos_per_current_update,
+         cost.nanos_per_get_soc);
+}
@@ -0,0 +1,72 @@
+#ifndef FUEL_GAUGE_SIM_H
+#define FUEL_GAUGE_SIM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pack_model.h"
+
+struct FuelGaugeSimConfig {
+  PackParams pack;
+  uint32_t seed = 1;
+  // Each cycle is a ride down by 10 to 50% and a charge up by 20 to 60%,
+  // with the board off for a while after each.
+  uint32_t cycles = 1000;
+  double start_soc = 60;
+  // How often the BMS reports, see PINT_PACKET_SCHEDULE.
+  uint32_t voltage_period_millis = 1000;
+  uint32_t current_period_millis = 100;
+  // Ride current wanders around this, charging is constant.
+  double ride_milliamps = 5000;
+  double charge_milliamps = 2000;
+  // Closer than this to the true SOC, in percent, counts as converged.
+  double convergence_tolerance = 5;
+};
+
+struct FuelGaugeSimReport {
+  uint32_t sessions = 0;
+  // Time the board was on.
+  double hours = 0;
+  // Gauge SOC minus the true SOC in percent, sampled on every voltage
+  // update.
+  double mean_abs_error = 0;
+  double rms_error = 0;
+  double max_abs_error = 0;
+  // Mean absolute error over each tenth of the run, how it develops as the
+  // pack ages.
+  std::vector<double> error_by_tenth;
+  // From the restoreState() at every boot until the error stays within the
+  // tolerance for the rest of the session. The first boot starts from a
+  // blank state like a fresh install.
+  double first_boot_convergence_seconds = 0;
+  double mean_convergence_seconds = 0;
+  double max_convergence_seconds = 0;
+  // Sessions that ended without converging.
+  uint32_t unconverged_sessions = 0;
+  double final_capacity_mah = 0;
+  double full_equivalent_cycles = 0;
+};
+
+/**
+ * @brief Rides and charges a simulated pack in accelerated time, with the
+ * gauge seeing it the way the relay does: every board start restores the
+ * state saved at the previous shutdown and millis start over.
+ */
+FuelGaugeSimReport runFuelGaugeSim(const FuelGaugeSimConfig& config);
+
+struct FuelGaugeCost {
+  double nanos_per_voltage_update = 0;
+  double nanos_per_current_update = 0;
+  double nanos_per_get_soc = 0;
+};
+
+// Times the gauge calls on a recorded ride, nothing else in the loop.
+FuelGaugeCost measureFuelGaugeCost(const PackParams& pack,
+                                   uint32_t seed = 1);
+
+void printFuelGaugeSimReport(const std::string& name,
+                             const FuelGaugeSimReport& report);
+void printFuelGaugeCost(const FuelGaugeCost& cost);
+
+#endif  // FUEL_GAUGE_SIM_H
@@ -0,0 +1,359 @@
+#include "nvs_sim.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "flash_emulator.h"
+#include "nvs.h"
+#include "workload.h"
+
+namespace {
+
+using nvs_record::ValueType;
+
+struct Key {
+  const char* name;
+  ValueType type;
+};
+
+// The settings fields, see src/settings.cpp.
+enum KeyId {
+  QUICK_POWER_CYCLE_COUNT,
+  AP_NAME,
+  AP_PASSWORD,
+  GRACEFUL_SHUTDOWN_COUNT,
+  AP_SELF_PASSWORD,
+  WIFI_POWER,
+  IS_LOCKED,
+  LOCKING_ENABLED,
+  BOTTOM_MILLIAMP_SECONDS,
+  CURRENT_MILLIAMP_SECONDS,
+  TOP_SOC,
+  BOTTOM_SOC,
+  KEY_COUNT,
+};
+
+const Key KEYS[KEY_COUNT] = {
+    {"quick_power_cycle_count", nvs_record::UINT64},
+    {"ap_name", nvs_record::BYTES},
+    {"ap_password", nvs_record::BYTES},
+    {"graceful_shutdown_count", nvs_record::SINT64},
+    {"ap_self_password", nvs_record::BYTES},
+    {"wifi_power", nvs_record::SINT64},
+    {"is_locked", nvs_record::UINT64},
+    {"locking_enabled", nvs_record::UINT64},
+    {"bottom_milliamp_seconds", nvs_record::SINT64},
+    {"current_milliamp_seconds", nvs_record::SINT64},
+    {"top_soc", nvs_record::SINT64},
+    {"bottom_soc", nvs_record::SINT64},
+};
+
+struct Value {
+  bool present = false;
+  uint64_t number = 0;
+  std::string bytes;
+
+  bool operator==(const Value& other) const {
+    return present == other.present && number == other.number &&
+           bytes == other.bytes;
+  }
+};
+
+// What the storage should hold.
+typedef std::vector<Value> Model;
+
+struct Change {
+  KeyId key;
+  // Not present erases the key.
+  Value value;
+};
+
+typedef std::vector<Change> Save;
+
+std::string randomString(WorkloadRng& rng) {
+  std::string s(1 + rng.below(nvs_record::MAX_NAME_LENGTH), ' ');
+  for (char& c : s) {
+    c = 'a' + rng.below(26);
+  }
+  return s;
+}
+
+Value number(uint64_t n) {
+  Value value;
+  value.present = true;
+  value.number = n;
+  return value;
+}
+
+Value signedNumber(int64_t n) { return number((uint64_t)n); }
+
+std::vector<Save> generateSaves(const NvsSimConfig& config) {
+  WorkloadRng rng(config.seed);
+  std::vector<Save> saves;
+  saves.reserve(config.saves);
+  int64_t shutdowns = 0;
+  bool locked = false;
+  for (uint32_t i = 0; i < config.saves; i++) {
+    Save save;
+    const uint32_t kind = rng.below(100);
+    if (kind < 60) {
+      // Shutdown: a counter and the fuel gauge state.
+      save.push_back({GRACEFUL_SHUTDOWN_COUNT, signedNumber(++shutdowns)});
+      save.push_back({BOTTOM_MILLIAMP_SECONDS,
+                      signedNumber(-(int64_t)rng.below(1000000))});
+      save.push_back({CURRENT_MILLIAMP_SECONDS,
+                      signedNumber(rng.below(10000000))});
+      save.push_back({TOP_SOC, signedNumber(80 + rng.below(21))});
+      save.push_back({BOTTOM_SOC, signedNumber(rng.below(20))});
+    } else if (kind < 85) {
+      save.push_back({QUICK_POWER_CYCLE_COUNT, number(rng.below(4))});
+    } else if (kind < 95) {
+      locked = !locked;
+      save.push_back({IS_LOCKED, number(locked)});
+      save.push_back({LOCKING_ENABLED, number(1)});
+    } else if (kind < 99) {
+      Value name;
+      name.present = true;
+      name.bytes = randomString(rng);
+      Value password = name;
+      password.bytes = randomString(rng);
+      save.push_back({AP_NAME, name});
+      save.push_back({AP_PASSWORD, password});
+      save.push_back({WIFI_POWER, signedNumber(8 + rng.below(10))});
+      password.bytes = randomString(rng);
+      save.push_back({AP_SELF_PASSWORD, password});
+    } else {
+      save.push_back({AP_SELF_PASSWORD, Value()});
+    }
+    saves.push_back(save);
+  }
+  return saves;
+}
+
+bool writeChange(NonVolatileStorage& storage, const Change& change) {
+  const Key& key = KEYS[change.key];
+  const Value& value = change.value;
+  if (!value.present) {
+    return storage.erase(key.name);
+  }
+  switch (key.type) {
+    case nvs_record::UINT64:
+      return storage.setUint64(key.name, value.number);
+    case nvs_record::SINT64:
+      return storage.setInt64(key.name, (int64_t)value.number);
+    case nvs_record::BYTES:
+      return storage.setBytes(key.name, (const uint8_t*)value.bytes.data(),
+                              value.bytes.size());
+    default:
+      return false;
+  }
+}
+
+// Like saveSettings(), one batch.
+bool writeSave(NonVolatileStorage& storage, const Save& save) {
+  storage.startBatch();
+  bool ok = true;
+  for (const Change& change : save) {
+    ok = writeChange(storage, change) && ok;
+  }
+  return storage.commitBatch() && ok;
+}
+
+// Returns the value bytes of what changed.
+uint64_t applySave(Model& model, const Save& save) {
+  uint64_t bytes = 0;
+  for (const Change& change : save) {
+    Value& value = model[change.key];
+    if (value == change.value) {
+      continue;
+    }
+    value = change.value;
+    // The numbers are all int32 in SettingsMsg.
+    bytes += KEYS[change.key].type == nvs_record::BYTES ? value.bytes.size()
+                                                        : 4;
+  }
+  return bytes;
+}
+
+Value readKey(const NonVolatileStorage& storage, const Key& key) {
+  Value value;
+  int64_t i;
+  uint8_t bytes[nvs_record::MAX_BYTES_LENGTH];
+  size_t len;
+  switch (key.type) {
+    case nvs_record::UINT64:
+      value.present = storage.getUint64(key.name, &value.number);
+      break;
+    case nvs_record::SINT64:
+      value.present = storage.getInt64(key.name, &i);
+      value.number = value.present ? (uint64_t)i : 0;
+      break;
+    case nvs_record::BYTES:
+      value.present = storage.getBytes(key.name, bytes, sizeof(bytes), &len);
+      if (value.present) {
+        value.bytes.assign((const char*)bytes, len);
+      }
+      break;
+    default:
+      break;
+  }
+  return value;
+}
+
+bool matches(const NonVolatileStorage& storage, const Model& model) {
+  for (int key = 0; key < KEY_COUNT; key++) {
+    if (!(readKey(storage, KEYS[key]) == model[key])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+NvsSimReport runNvsSim(const NvsSimConfig& config) {
+  const std::vector<Save> saves = generateSaves(config);
+  FlashEmulator flash(config.sector_size, config.sector_count);
+  NonVolatileStorage storage(&flash, config.sector_size, config.sector_count);
+  storage.begin();
+  storage.format(0);
+  Model model(KEY_COUNT);
+  NvsSimReport report;
+  for (const Save& save : saves) {
+    report.saves++;
+    if (!writeSave(storage, save)) {
+      report.failed_saves++;
+    }
+    report.user_bytes += applySave(model, save);
+  }
+  NonVolatileStorage restarted(&flash, config.sector_size,
+                               config.sector_count);
+  report.restart_ok = restarted.begin() && matches(restarted, model);
+
+  const FlashEmulatorStats& stats = flash.stats();
+  report.bytes_programmed = stats.bytes_programmed;
+  report.erases = stats.erases;
+  report.min_erase_count = flash.eraseCount(0);
+  for (size_t sector = 0; sector < config.sector_count; sector++) {
+    report.min_erase_count =
+        std::min(report.min_erase_count, flash.eraseCount(sector));
+    report.max_erase_count =
+        std::max(report.max_erase_count, flash.eraseCount(sector));
+  }
+  const double userBytes = std::max<uint64_t>(report.user_bytes, 1);
+  report.write_amplification = report.bytes_programmed / userBytes;
+  report.erase_amplification =
+      (double)report.erases * config.sector_size / userBytes;
+  const double savesPerYear = config.saves_per_day * 365;
+  const double erasesPerSave =
+      std::max<uint64_t>(report.max_erase_count, 1) / (double)report.saves;
+  report.lifetime_years =
+      config.endurance_cycles / erasesPerSave / savesPerYear;
+  // Every commit erases the next of its sectors.
+  report.eeprom_rotate_erase_amplification =
+      (double)report.saves * config.sector_size / userBytes;
+  report.eeprom_rotate_lifetime_years =
+      (double)config.endurance_cycles * config.sector_count / savesPerYear;
+  return report;
+}
+
+NvsPowerCutReport checkPowerCuts(const NvsSimConfig& config,
+                                 uint64_t stride) {
+  const std::vector<Save> saves = generateSaves(config);
+  uint64_t totalSteps;
+  {
+    FlashEmulator flash(config.sector_size, config.sector_count);
+    NonVolatileStorage storage(&flash, config.sector_size,
+                               config.sector_count);
+    storage.begin();
+    storage.format(0);
+    for (const Save& save : saves) {
+      writeSave(storage, save);
+    }
+    totalSteps = flash.steps();
+  }
+
+  NvsPowerCutReport report;
+  for (uint64_t cut = 0; cut < totalSteps; cut += stride) {
+    report.cut_points++;
+    FlashEmulator flash(config.sector_size, config.sector_count);
+    flash.cutPowerAfter(cut);
+    Model before(KEY_COUNT);
+    Model after(KEY_COUNT);
+    {
+      NonVolatileStorage storage(&flash, config.sector_size,
+                                 config.sector_count);
+      storage.begin();
+      storage.format(0);
+      for (const Save& save : saves) {
+        if (flash.poweredOff()) {
+          break;
+        }
+        before = after;
+        applySave(after, save);
+        writeSave(storage, save);
+      }
+    }
+    flash.powerOn();
+
+    NonVolatileStorage recovered(&flash, config.sector_size,
+                                 config.sector_count);
+    if (!recovered.begin()) {
+      recovered.format(0);
+    }
+    bool ok = false;
+    Model expected;
+    if (matches(recovered, after)) {
+      expected = after;
+      ok = true;
+    } else if (matches(recovered, before)) {
+      expected = before;
+      ok = true;
+    }
+    if (ok) {
+      report.consistent++;
+      const Save probe = {{GRACEFUL_SHUTDOWN_COUNT, signedNumber(-1)}};
+      applySave(expected, probe);
+      writeSave(recovered, probe);
+      NonVolatileStorage restarted(&flash, config.sector_size,
+                                   config.sector_count);
+      ok = restarted.begin() && matches(restarted, expected);
+    }
+    if (ok) {
+      report.writable++;
+    } else if (report.first_failure < 0) {
+      report.first_failure = cut;
+    }
+  }
+  return report;
+}
+
+void printNvsSimReport(const std::string& name, const NvsSimReport& report) {
+  printf("%s: %u saves, %u failed, %llu user bytes\n", name.c_str(),
+         report.saves, report.failed_saves,
+         (unsigned long long)report.user_bytes);
+  printf("  programmed %llu bytes, %llu erases, erase count %llu..%llu\n",
+         (unsigned long long)report.bytes_programmed,
+         (unsigned long long)report.erases,
+         (unsigned long long)report.min_erase_count,
+         (unsigned long long)report.max_erase_count);
+  printf("  write amplification %.2f, erase amplification %.2f\n",
+         report.write_amplification, report.erase_amplification);
+  printf("  lifetime %.0f years (EEPROM_Rotate: erase amplification %.1f, "
+         "%.0f years)\n",
+         report.lifetime_years, report.eeprom_rotate_erase_amplification,
+         report.eeprom_rotate_lifetime_years);
+}
+
+void printNvsPowerCutReport(const std::string& name,
+                            const NvsPowerCutReport& report) {
+  printf("%s: %llu cut points, %llu consistent, %llu writable after",
+         name.c_str(), (unsigned long long)report.cut_points,
+         (unsigned long long)report.consistent,
+         (unsigned long long)report.writable);
+  if (report.first_failure >= 0) {
+    printf(", first failure at step %lld", (long long)report.first_failure);
+  }
+  printf("\n");
+}
@@ -0,0 +1,69 @@
+#ifndef NVS_SIM_H
+#define NVS_SIM_H
+
+#include <cstdint>
+#include <string>
+
+struct NvsSimConfig {
+  uint32_t seed = 1;
+  size_t sector_size = 4096;
+  // As many as the settings get.
+  size_t sector_count = 4;
+  // saveSettings() calls, each a batch of the fields it changed: shutdown
+  // counters and battery state most of the time, now and then a power
+  // cycle, the lock or the wifi settings.
+  uint32_t saves = 100000;
+  // For the lifetime projection, erase cycles the flash is rated for.
+  uint32_t endurance_cycles = 100000;
+  double saves_per_day = 20;
+};
+
+struct NvsSimReport {
+  uint32_t saves = 0;
+  uint32_t failed_saves = 0;
+  // Value bytes of the fields that actually changed.
+  uint64_t user_bytes = 0;
+  uint64_t bytes_programmed = 0;
+  uint64_t erases = 0;
+  uint64_t min_erase_count = 0;
+  uint64_t max_erase_count = 0;
+  // Bytes programmed and erased per user byte.
+  double write_amplification = 0;
+  double erase_amplification = 0;
+  // Until the most worn sector reaches the rated endurance.
+  double lifetime_years = 0;
+  // The same saves as full sector commits through EEPROM_Rotate.
+  double eeprom_rotate_erase_amplification = 0;
+  double eeprom_rotate_lifetime_years = 0;
+  // Whether a restart at the end read back every value.
+  bool restart_ok = false;
+};
+
+/**
+ * @brief Runs the settings workload against NonVolatileStorage on a
+ * FlashEmulator and measures what it costs the flash.
+ */
+NvsSimReport runNvsSim(const NvsSimConfig& config);
+
+struct NvsPowerCutReport {
+  uint64_t cut_points = 0;
+  // Came back with the values from before the interrupted save or after it.
+  uint64_t consistent = 0;
+  // Then took another save and restart.
+  uint64_t writable = 0;
+  // First cut point, in flash steps, that wasn't both. -1 if none.
+  int64_t first_failure = -1;
+};
+
+/**
+ * @brief Runs the workload from a blank flash again and again, cutting
+ * power at every stride-th step, and restarts after each cut.
+ */
+NvsPowerCutReport checkPowerCuts(const NvsSimConfig& config,
+                                 uint64_t stride = 1);
+
+void printNvsSimReport(const std::string& name, const NvsSimReport& report);
+void printNvsPowerCutReport(const std::string& name,
+                            const NvsPowerCutReport& report);
+
+#endif  // NVS_SIM_H
@@ -0,0 +1,70 @@
+#include "pack_model.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ocv_table.h"
+
+PackModel::PackModel(const PackParams& params, double soc, uint32_t seed)
+    : params_(params),
+      rng_(seed),
+      capacity_mah_(params.capacity_mah),
+      charge_mah_(params.capacity_mah * soc / 100) {}
+
+void PackModel::step(double currentMilliamps, double seconds) {
+  const double mah = currentMilliamps * seconds / 3600;
+  charge_mah_ = std::max(0.0, std::min(capacity_mah_, charge_mah_ - mah));
+  throughput_mah_ += std::abs(mah);
+  // A full equivalent cycle moves twice the capacity.
+  capacity_mah_ -= params_.fade_per_cycle * std::abs(mah) / 2;
+  charge_mah_ = std::min(charge_mah_, capacity_mah_);
+  current_milliamps_ = currentMilliamps;
+  // Exact for a constant current over the step.
+  const double target = currentMilliamps * params_.polarization_milliohms / 1000;
+  const double decay = std::exp(-seconds / params_.relaxation_seconds);
+  polarization_millivolts_ =
+      target + (polarization_millivolts_ - target) * decay;
+}
+
+double PackModel::ocvMillivolts(double soc) const {
+  typedef DefaultOcvCurve Curve;
+  constexpr double STEP_MILLIVOLTS =
+      (double)(Curve::MAX_MILLIVOLTS - Curve::MIN_MILLIVOLTS) /
+      (Curve::NUM_POINTS - 1);
+  soc = std::max(0.0, std::min(100.0, soc));
+  // The first segment that rises to soc, flat stretches are skipped over.
+  uint8_t i = 0;
+  while (i + 2 < Curve::NUM_POINTS &&
+         (Curve::POINTS[i + 1] < soc ||
+          Curve::POINTS[i + 1] == Curve::POINTS[i])) {
+    i++;
+  }
+  const double rise = Curve::POINTS[i + 1] - Curve::POINTS[i];
+  const double fraction =
+      rise > 0 ? std::min(1.0, (soc - Curve::POINTS[i]) / rise) : 0;
+  return Curve::MIN_MILLIVOLTS + (i + fraction) * STEP_MILLIVOLTS +
+         params_.ocv_offset_millivolts;
+}
+
+int32_t PackModel::measuredCellMillivolts() {
+  const double millivolts =
+      ocvMillivolts(soc()) -
+      current_milliamps_ * params_.series_milliohms / 1000 -
+      polarization_millivolts_ - params_.imbalance_millivolts +
+      gaussian() * params_.voltage_noise_millivolts;
+  return std::lround(millivolts);
+}
+
+int32_t PackModel::measuredCurrentMilliamps() {
+  const double milliamps =
+      current_milliamps_ + gaussian() * params_.current_noise_milliamps;
+  const int32_t resolution = params_.current_resolution_milliamps;
+  return std::lround(milliamps / resolution) * resolution;
+}
+
+double PackModel::gaussian() {
+  // Box-Muller, one of the pair is plenty.
+  const double u1 = (rng_.next() + 1.0) / 4294967297.0;
+  const double u2 = rng_.next() / 4294967296.0;
+  return std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+}
@@ -0,0 +1,69 @@
+#ifndef PACK_MODEL_H
+#define PACK_MODEL_H
+
+#include <cstdint>
+
+#include "workload.h"
+
+struct PackParams {
+  double capacity_mah = 3500;
+  // Capacity lost per full equivalent cycle, as a fraction of the original.
+  double fade_per_cycle = 0.0002;
+  // Per cell group, the part that shows up right away under load.
+  double series_milliohms = 15;
+  // Per cell group, the part that builds up and relaxes with the time constant.
+  double polarization_milliohms = 10;
+  double relaxation_seconds = 60;
+  // Added to the gauge's own curve, for chemistries it doesn't know.
+  double ocv_offset_millivolts = 0;
+  // Between the average and the lowest cell, the gauge sees the lowest one.
+  double imbalance_millivolts = 5;
+  // Standard deviations of the BMS readings.
+  double voltage_noise_millivolts = 2;
+  double current_noise_milliamps = 50;
+  // Current comes in whole units of this.
+  int32_t current_resolution_milliamps = 55;
+};
+
+/**
+ * @brief A series pack of identical cells. The open circuit voltage is the
+ * inverse of DefaultOcvCurve plus an offset, with a series resistance and a
+ * single RC branch in front of it. Capacity fades with the charge that went
+ * through. What the BMS reports is quantized and noisy.
+ */
+class PackModel {
+ public:
+  PackModel(const PackParams& params, double soc, uint32_t seed = 1);
+
+  /**
+   * @brief Runs the given current for a while, positive discharges like
+   * the BMS reports it. Zero is the pack resting.
+   */
+  void step(double currentMilliamps, double seconds);
+
+  // True state of charge in percent of the current capacity.
+  double soc() const { return 100 * charge_mah_ / capacity_mah_; }
+  double capacityMah() const { return capacity_mah_; }
+  double fullEquivalentCycles() const {
+    return throughput_mah_ / 2 / params_.capacity_mah;
+  }
+
+  // Open circuit voltage of a cell at the given SOC.
+  double ocvMillivolts(double soc) const;
+  // Lowest cell voltage and current as the BMS would report them right now.
+  int32_t measuredCellMillivolts();
+  int32_t measuredCurrentMilliamps();
+
+ private:
+  double gaussian();
+
+  const PackParams params_;
+  WorkloadRng rng_;
+  double capacity_mah_;
+  double charge_mah_;
+  double throughput_mah_ = 0;
+  double current_milliamps_ = 0;
+  double polarization_millivolts_ = 0;
+};
+
+#endif  // PACK_MODEL_H
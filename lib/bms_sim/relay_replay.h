@@ -0,0 +1,54 @@
+#ifndef RELAY_REPLAY_H
+#define RELAY_REPLAY_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "bms_relay.h"
+#include "workload.h"
+
+struct ReplayResult {
+  std::string name;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  // Everything that looked like a packet, checksum mismatches included.
+  uint64_t packets = 0;
+  uint64_t replayed_bytes = 0;
+  uint64_t allocations = 0;
+  // Wall clock time spent in BmsRelay::loop().
+  double seconds = 0;
+
+  double bytesPerSecond() const { return bytes_in / seconds; }
+  double packetsPerSecond() const { return packets / seconds; }
+  double nanosPerPacket() const { return seconds * 1e9 / packets; }
+  double allocationsPerPacket() const {
+    return packets ? (double)allocations / packets : 0;
+  }
+};
+
+/**
+ * @brief Feeds a workload through the same BmsRelayCore template the
+ * firmware uses, as fast as it goes. The relay's clock is virtual and set
+ * to each chunk's arrival time, so timeouts, replays and latency tracking
+ * behave like on the board no matter how fast the host is.
+ */
+class RelayReplay {
+ public:
+  // Gets to configure every fresh relay before the run.
+  typedef std::function<void(BmsRelay* relay)> Setup;
+
+  /**
+   * @brief Runs the workload on a new relay repetitions times and reports
+   * the fastest run, which is the most reproducible one on a busy machine.
+   * Cut through forwarding is on like in the firmware unless setup says
+   * otherwise.
+   */
+  static ReplayResult run(const Workload& workload, int repetitions = 3,
+                          const Setup& setup = nullptr);
+};
+
+void printReplayResultHeader();
+void printReplayResult(const ReplayResult& result);
+
+#endif  // RELAY_REPLAY_H
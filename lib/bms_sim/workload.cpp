@@ -0,0 +1,135 @@
+#include "workload.h"
+
+#include <algorithm>
+#include <cstdio>
+
+const std::vector<std::vector<uint8_t>> PINT_PACKETS = {
+    {0xff, 0x55, 0xaa, 0x00, 0x80, 0x02, 0x7e},
+    {0xff, 0x55, 0xaa, 0x02, 0x0f, 0x28, 0x0f, 0x2c, 0x0f, 0x2b,
+     0x0f, 0x29, 0x0f, 0x2a, 0x0f, 0x2b, 0x0f, 0x2a, 0x0f, 0x2c,
+     0x0f, 0x29, 0x0f, 0x2b, 0x0f, 0x29, 0x0f, 0x2a, 0x0f, 0x22,
+     0x0f, 0x2a, 0x0f, 0x2a, 0x00, 0x2a, 0x05, 0x7b},
+    {0xff, 0x55, 0xaa, 0x03, 0x29, 0x02, 0x2a},
+    {0xff, 0x55, 0xaa, 0x04, 0x16, 0x17, 0x17, 0x17, 0x18, 0x02, 0x75},
+    {0xff, 0x55, 0xaa, 0x05, 0x00, 0x01, 0x02, 0x04},
+    {0xFF, 0x55, 0xAA, 0x6, 0x8, 0x4, 0x2, 0x1, 0x2, 0x13},
+    {0xff, 0x55, 0xaa, 0x07, 0x10, 0xcc, 0x10, 0x57, 0x09, 0xc4, 0x50, 0x04,
+     0x65},
+    {0xff, 0x55, 0xaa, 0x08, 0x06, 0x02, 0x0c},
+    {0xff, 0x55, 0xaa, 0x09, 0x03, 0x02, 0x0a},
+    {0xff, 0x55, 0xaa, 0x0b, 0x0b, 0xc0, 0x02, 0xd4},
+    {0xff, 0x55, 0xaa, 0x0c, 0x00, 0x00, 0x02, 0x0a},
+    {0xff, 0x55, 0xaa, 0x0d, 0x02, 0xda, 0x47, 0x03, 0x2e},
+    {0xff, 0x55, 0xaa, 0x0f, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0f},
+    {0xff, 0x55, 0xaa, 0x10, 0x03, 0x03, 0x0b, 0x03, 0x03, 0x03, 0x03, 0x03,
+     0x03, 0x03, 0x02, 0x34},
+    {0xff, 0x55, 0xaa, 0x11, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0f}};
+
+void Workload::addBytes(const uint8_t* data, size_t len, size_t chunkSize) {
+  bytes.insert(bytes.end(), data, data + len);
+  uint32_t micros = endMicros();
+  while (len > 0) {
+    const uint32_t chunkLen = std::min(len, chunkSize);
+    micros += chunkLen * WIRE_BYTE_MICROS;
+    chunks.push_back(Chunk{micros, chunkLen});
+    len -= chunkLen;
+  }
+}
+
+void Workload::addIdle(uint32_t idleMicros, uint32_t pollMicros) {
+  const uint32_t micros = endMicros();
+  for (uint32_t idle = pollMicros; idle < idleMicros; idle += pollMicros) {
+    chunks.push_back(Chunk{micros + idle, 0});
+  }
+  chunks.push_back(Chunk{micros + idleMicros, 0});
+}
+
+namespace {
+
+void appendAll(std::vector<uint8_t>* data) {
+  for (const auto& packet : PINT_PACKETS) {
+    data->insert(data->end(), packet.begin(), packet.end());
+  }
+}
+
+}  // namespace
+
+Workload cleanTrafficWorkload(size_t size) {
+  std::vector<uint8_t> data;
+  while (data.size() < size) {
+    appendAll(&data);
+  }
+  Workload workload;
+  workload.name = "clean";
+  workload.addBytes(data);
+  return workload;
+}
+
+Workload heavyGarbageWorkload(size_t size, uint32_t seed) {
+  WorkloadRng rng(seed);
+  std::vector<uint8_t> data;
+  while (data.size() < size) {
+    for (const auto& packet : PINT_PACKETS) {
+      for (uint32_t i = rng.below(2 * packet.size()); i > 0; i--) {
+        // Preamble bytes half of the time.
+        const uint32_t r = rng.next();
+        const uint8_t b = (r & 3) == 0 ? 0xFF : ((r & 3) == 1 ? 0x55 : r >> 8);
+        data.push_back(b);
+      }
+      data.insert(data.end(), packet.begin(), packet.end());
+    }
+  }
+  Workload workload;
+  workload.name = "garbage";
+  workload.addBytes(data);
+  return workload;
+}
+
+Workload crcFailureWorkload(size_t size, uint32_t seed) {
+  WorkloadRng rng(seed);
+  std::vector<uint8_t> data;
+  bool corrupt = false;
+  while (data.size() < size) {
+    for (const auto& packet : PINT_PACKETS) {
+      const size_t start = data.size();
+      data.insert(data.end(), packet.begin(), packet.end());
+      if (corrupt) {
+        // Anywhere between the type and the checksum.
+        data[start + 4 + rng.below(packet.size() - 6)] ^= 1 + rng.below(255);
+      }
+      corrupt = !corrupt;
+    }
+  }
+  Workload workload;
+  workload.name = "crc failures";
+  workload.addBytes(data);
+  return workload;
+}
+
+Workload replayIdleWorkload(uint32_t cycles) {
+  Workload workload;
+  workload.name = "replay idle";
+  std::vector<uint8_t> data;
+  for (uint32_t cycle = 0; cycle < cycles; cycle++) {
+    data.clear();
+    appendAll(&data);
+    workload.addBytes(data);
+    workload.addIdle(1000000 - workload.endMicros() % 1000000);
+    workload.addIdle(10000000);
+  }
+  return workload;
+}
+
+Workload singlePacketWorkload(const std::vector<uint8_t>& packet,
+                              size_t size) {
+  std::vector<uint8_t> data;
+  while (data.size() < size) {
+    data.insert(data.end(), packet.begin(), packet.end());
+  }
+  Workload workload;
+  char name[16];
+  snprintf(name, sizeof(name), "type %X", packet[3]);
+  workload.name = name;
+  workload.addBytes(data);
+  return workload;
+}
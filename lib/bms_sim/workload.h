@@ -0,0 +1,80 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One of every packet type seen on a Pint, as captured from the wire.
+extern const std::vector<std::vector<uint8_t>> PINT_PACKETS;
+
+// One byte at 115200 baud, 8N1.
+constexpr uint32_t WIRE_BYTE_MICROS = 87;
+
+/**
+ * @brief A BMS byte stream with the times its pieces arrived, the way a
+ * UART would hand it over. Recorded or made up by the generators below.
+ */
+struct Workload {
+  struct Chunk {
+    // Arrival of the chunk's last byte.
+    uint32_t micros;
+    // Zero for a poll that found nothing, i.e. time passing.
+    uint32_t len;
+  };
+
+  std::string name;
+  std::vector<uint8_t> bytes;
+  std::vector<Chunk> chunks;
+
+  /**
+   * @brief Appends data as if it came in back to back right after what's
+   * already there, in chunks of at most chunkSize bytes.
+   */
+  void addBytes(const uint8_t* data, size_t len, size_t chunkSize = 32);
+  void addBytes(const std::vector<uint8_t>& data, size_t chunkSize = 32) {
+    addBytes(data.data(), data.size(), chunkSize);
+  }
+  // Polls every pollMicros that find nothing, for idleMicros in total.
+  // The last one is exactly idleMicros after the current end.
+  void addIdle(uint32_t idleMicros, uint32_t pollMicros = 1000);
+
+  uint32_t endMicros() const {
+    return chunks.empty() ? 0 : chunks.back().micros;
+  }
+};
+
+// Small and fast xorshift generator, so that workloads are the same on
+// every machine.
+class WorkloadRng {
+ public:
+  explicit WorkloadRng(uint32_t seed) : state_(seed ? seed : 1) {}
+  uint32_t next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+  uint32_t below(uint32_t bound) { return next() % bound; }
+
+ private:
+  uint32_t state_;
+};
+
+// All Pint packet types in a loop.
+Workload cleanTrafficWorkload(size_t size);
+// Packets with runs of random bytes in between, half of them preamble bytes
+// so that the relay has to resynchronize a lot. About half of the stream is
+// garbage.
+Workload heavyGarbageWorkload(size_t size, uint32_t seed = 1);
+// Every other packet has a corrupted payload byte.
+Workload crcFailureWorkload(size_t size, uint32_t seed = 1);
+// A second of traffic followed by ten seconds of silence, over and over, so
+// that most of the time goes to replaying packets.
+Workload replayIdleWorkload(uint32_t cycles);
+// Just the given packet, over and over.
+Workload singlePacketWorkload(const std::vector<uint8_t>& packet,
+                              size_t size);
+
+#endif  // WORKLOAD_H
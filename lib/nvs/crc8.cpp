@@ -6,10 +6,69 @@
 
 #include <stdint.h>
 
-/* Return CRC-8 of the data, using x^8 + x^2 + x + 1 polynomial.  A
- * table-based algorithm would be faster, but for only a few bytes it isn't
- * worth the code size. */
-uint8_t Crc8(const uint8_t* data, size_t len) {
+#include <array>
+
+#ifdef ARDUINO
+#include <pgmspace.h>
+#else
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_byte
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#endif
+#endif
+
+namespace {
+
+typedef std::array<uint8_t, 256> Crc8Lookup;
+typedef std::array<Crc8Lookup, 4> Crc8Slices;
+
+constexpr uint8_t crc8OfByte(uint8_t byte) {
+  unsigned crc = byte << 8;
+  for (int i = 0; i < 8; i++) {
+    if (crc & 0x8000) crc ^= (0x1070 << 3);
+    crc <<= 1;
+  }
+  return (uint8_t)(crc >> 8);
+}
+
+constexpr Crc8Lookup generateLookup() {
+  Crc8Lookup table{};
+  for (int i = 0; i < 256; i++) {
+    table[i] = crc8OfByte(i);
+  }
+  return table;
+}
+
+#if CRC8_TABLES >= 4 || !defined(ARDUINO)
+// Slice k is the crc of a byte followed by k zero bytes. The crc is linear,
+// so four bytes at once are the four slices xored together.
+constexpr Crc8Slices generateSlices() {
+  const Crc8Lookup lookup = generateLookup();
+  Crc8Slices slices{};
+  slices[0] = lookup;
+  for (int k = 1; k < 4; k++) {
+    for (int i = 0; i < 256; i++) {
+      slices[k][i] = lookup[slices[k - 1][i]];
+    }
+  }
+  return slices;
+}
+
+constexpr Crc8Slices CRC8_SLICES PROGMEM = generateSlices();
+#endif
+
+static_assert(generateLookup()[1] == 0x07, "x^8 + x^2 + x + 1");
+
+#if CRC8_TABLES >= 1 || !defined(ARDUINO)
+constexpr Crc8Lookup CRC8_LOOKUP PROGMEM = generateLookup();
+#endif
+
+}  // namespace
+
+/* Return CRC-8 of the data, using x^8 + x^2 + x + 1 polynomial. */
+uint8_t Crc8Bitwise(const uint8_t* data, size_t len) {
   unsigned crc = 0;
   size_t i, j;
   for (j = len; j; j--, data++) {
@@ -21,3 +80,40 @@ uint8_t Crc8(const uint8_t* data, size_t len) {
   }
   return (uint8_t)(crc >> 8);
 }
+
+#if CRC8_TABLES >= 1 || !defined(ARDUINO)
+uint8_t Crc8Table(const uint8_t* data, size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc = pgm_read_byte(&CRC8_LOOKUP[crc ^ data[i]]);
+  }
+  return crc;
+}
+#endif
+
+#if CRC8_TABLES >= 4 || !defined(ARDUINO)
+uint8_t Crc8SliceBy4(const uint8_t* data, size_t len) {
+  uint8_t crc = 0;
+  const uint8_t* const end = data + len;
+  for (; end - data >= 4; data += 4) {
+    crc = pgm_read_byte(&CRC8_SLICES[3][crc ^ data[0]]) ^
+          pgm_read_byte(&CRC8_SLICES[2][data[1]]) ^
+          pgm_read_byte(&CRC8_SLICES[1][data[2]]) ^
+          pgm_read_byte(&CRC8_SLICES[0][data[3]]);
+  }
+  for (; data < end; data++) {
+    crc = pgm_read_byte(&CRC8_SLICES[0][crc ^ *data]);
+  }
+  return crc;
+}
+#endif
+
+uint8_t Crc8(const uint8_t* data, size_t len) {
+#if CRC8_TABLES >= 4
+  return Crc8SliceBy4(data, len);
+#elif CRC8_TABLES >= 1
+  return Crc8Table(data, len);
+#else
+  return Crc8Bitwise(data, len);
+#endif
+}
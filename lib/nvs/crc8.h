@@ -2,4 +2,27 @@
 
 #include <stddef.h>
 #include <stdint.h>
-uint8_t Crc8(const uint8_t* vptr, size_t len);
\ No newline at end of file
+
+// How many 256 byte tables Crc8() gets to use. 0 computes it bit by bit, 1
+// looks up a byte at a time and 4 takes four bytes at a time (slice-by-4).
+// The ESP8266 keeps its table in flash and doesn't have the room to spare
+// for four.
+#ifndef CRC8_TABLES
+#ifdef ARDUINO
+#define CRC8_TABLES 1
+#else
+#define CRC8_TABLES 4
+#endif
+#endif
+
+uint8_t Crc8(const uint8_t* vptr, size_t len);
+
+// What Crc8() picks from, all give the same result. The ESP8266 only gets
+// the tables it uses, the native build all of them to compare.
+uint8_t Crc8Bitwise(const uint8_t* data, size_t len);
+#if CRC8_TABLES >= 1 || !defined(ARDUINO)
+uint8_t Crc8Table(const uint8_t* data, size_t len);
+#endif
+#if CRC8_TABLES >= 4 || !defined(ARDUINO)
+uint8_t Crc8SliceBy4(const uint8_t* data, size_t len);
+#endif
@@ -0,0 +1,358 @@
+#include "nvs.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "page.h"
+
+using nvs_record::PAGE_DATA_START;
+using nvs_record::ValueType;
+using nvs_record::ValueUpdate;
+
+bool NonVolatileStorage::begin() {
+  entries_.clear();
+  active_sector_ = -1;
+  seq_no_ = 0;
+  uint8_t start[PAGE_DATA_START];
+  std::vector<bool> headerless(sector_count_, false);
+  int32_t maxEraseCount = 0;
+  for (size_t sector = 0; sector < sector_count_; sector++) {
+    nvs_record::PageHeader header;
+    if (!flash_->read(sector * sector_size_, start, sizeof(start)) ||
+        !nvs_record::decodePageStart(start, sizeof(start), &header)) {
+      headerless[sector] = true;
+      continue;
+    }
+    erase_counts_[sector] = header.erase_count;
+    maxEraseCount = std::max(maxEraseCount, header.erase_count);
+    if (active_sector_ < 0 || header.seq_no > seq_no_) {
+      active_sector_ = sector;
+      seq_no_ = header.seq_no;
+    }
+  }
+  // Next to a page, a sector without a header was never used or lost it to
+  // an erase for a compaction that didn't finish. Compactions go to the least
+  // worn sector, so it has been erased at most once more than the most worn
+  // one. Counting that keeps an interrupted sector from being picked again
+  // and again.
+  for (size_t sector = 0; sector < sector_count_; sector++) {
+    if (active_sector_ >= 0 && headerless[sector]) {
+      erase_counts_[sector] =
+          std::max(erase_counts_[sector], maxEraseCount + 1);
+    }
+  }
+  if (active_sector_ < 0) {
+    return false;
+  }
+
+  std::vector<uint8_t> buffer(sector_size_);
+  NVSPage page(sector_size_);
+  if (!flash_->read(active_sector_ * sector_size_, buffer.data(),
+                    sector_size_) ||
+      !page.load(buffer.data())) {
+    active_sector_ = -1;
+    return false;
+  }
+  entries_.resize(page.idCount());
+  for (size_t id = 0; id < page.idCount(); id++) {
+    const char* name;
+    size_t len;
+    ValueUpdate update;
+    // Ids never named on the page have nothing to look them up by.
+    if (!page.name(id, &name, &len) || !page.value(id, &update)) {
+      continue;
+    }
+    Entry& entry = entries_[id];
+    entry.name.assign(name, len);
+    entry.named = true;
+    entry.type = update.type;
+    entry.number = update.number;
+    entry.bytes.assign((const char*)update.bytes, update.bytes_length);
+  }
+  write_offset_ = page.dataEnd();
+  // A torn write leaves bytes we can't program over.
+  page_dirty_ = !page.isClean();
+  return true;
+}
+
+bool NonVolatileStorage::format(size_t sector) {
+  // Tombstones and ids without a name have nothing left to say.
+  size_t kept = 0;
+  for (size_t id = 0; id < entries_.size(); id++) {
+    if (entries_[id].type == nvs_record::TOMBSTONE ||
+        entries_[id].name.empty()) {
+      continue;
+    }
+    if (kept != id) {
+      entries_[kept] = std::move(entries_[id]);
+    }
+    kept++;
+  }
+  entries_.resize(kept);
+
+  if ((int)sector == active_sector_) {
+    // Rotation is off, the page is gone until the new one is done.
+    active_sector_ = -1;
+  }
+  if (!flash_->eraseSector(sector)) {
+    return false;
+  }
+  erase_counts_[sector]++;
+  stats_.sector_erases++;
+  const size_t base = sector * sector_size_;
+  size_t offset = PAGE_DATA_START;
+  uint8_t record[nvs_record::MAX_RECORD_SIZE];
+  for (size_t id = 0; id < entries_.size(); id++) {
+    entries_[id].named = false;
+    const size_t size = nvs_record::encodeValueUpdate(update(id), record);
+    if (offset + size > sector_size_ ||
+        !flash_->program(base + offset, record, size)) {
+      return false;
+    }
+    entries_[id].named = true;
+    offset += size;
+    stats_.records_written++;
+    stats_.bytes_written += size;
+  }
+  // Only now does the page count.
+  uint8_t start[PAGE_DATA_START];
+  const int32_t seqNo = seq_no_ + 1;
+  nvs_record::encodePageStart(
+      {nvs_record::PAGE_VERSION, seqNo, erase_counts_[sector]}, start);
+  if (!flash_->program(base, start, sizeof(start))) {
+    return false;
+  }
+  stats_.bytes_written += sizeof(start);
+  active_sector_ = sector;
+  seq_no_ = seqNo;
+  write_offset_ = offset;
+  page_dirty_ = false;
+  return true;
+}
+
+bool NonVolatileStorage::setRotation(bool enabled) {
+  rotation_ = enabled;
+  if (enabled || active_sector_ <= 0) {
+    return true;
+  }
+  stats_.compactions++;
+  return format(0);
+}
+
+bool NonVolatileStorage::compact() {
+  stats_.compactions++;
+  return format(rotation_ ? leastWornSector() : 0);
+}
+
+size_t NonVolatileStorage::leastWornSector() const {
+  // Going round the ring from the active page, so ties go to the sector that
+  // has waited longest.
+  size_t best = 0;
+  bool found = false;
+  for (size_t i = 1; i <= sector_count_; i++) {
+    const size_t sector = (active_sector_ + i) % sector_count_;
+    if ((int)sector == active_sector_ && sector_count_ > 1) {
+      continue;
+    }
+    if (!found || erase_counts_[sector] < erase_counts_[best]) {
+      best = sector;
+      found = true;
+    }
+  }
+  return best;
+}
+
+ValueUpdate NonVolatileStorage::update(size_t id) const {
+  const Entry& entry = entries_[id];
+  ValueUpdate update = {};
+  update.id = id;
+  if (!entry.named) {
+    update.name = entry.name.data();
+    update.name_length = entry.name.size();
+  }
+  update.type = entry.type;
+  update.number = entry.number;
+  update.bytes = (const uint8_t*)entry.bytes.data();
+  update.bytes_length = entry.bytes.size();
+  return update;
+}
+
+bool NonVolatileStorage::program(const uint8_t* record, size_t size) {
+  if (page_dirty_ || write_offset_ + size > sector_size_) {
+    return false;
+  }
+  if (!flash_->program(active_sector_ * sector_size_ + write_offset_, record,
+                       size)) {
+    page_dirty_ = true;
+    return false;
+  }
+  write_offset_ += size;
+  stats_.records_written++;
+  stats_.bytes_written += size;
+  return true;
+}
+
+bool NonVolatileStorage::append(size_t id) {
+  if (batching_) {
+    entries_[id].pending = true;
+    return true;
+  }
+  if (active_sector_ < 0) {
+    // Kept in RAM until format().
+    return true;
+  }
+  uint8_t record[nvs_record::MAX_RECORD_SIZE];
+  const size_t size = nvs_record::encodeValueUpdate(update(id), record);
+  if (program(record, size)) {
+    entries_[id].named = true;
+    return true;
+  }
+  return compact();
+}
+
+bool NonVolatileStorage::commitBatch() {
+  batching_ = false;
+  std::vector<ValueUpdate> updates;
+  for (size_t id = 0; id < entries_.size(); id++) {
+    if (entries_[id].pending) {
+      entries_[id].pending = false;
+      updates.push_back(update(id));
+    }
+  }
+  if (updates.empty() || active_sector_ < 0) {
+    return true;
+  }
+  std::vector<uint8_t> record(nvs_record::maxBatchRecordSize(updates.size()));
+  const size_t size =
+      nvs_record::encodeBatch(updates.data(), updates.size(), record.data());
+  if (!program(record.data(), size)) {
+    // The fresh page has all of it or nothing.
+    return compact();
+  }
+  for (const ValueUpdate& written : updates) {
+    entries_[written.id].named = true;
+  }
+  return true;
+}
+
+bool NonVolatileStorage::write(const char* key, ValueType type,
+                               uint64_t number, const uint8_t* bytes,
+                               size_t len) {
+  const size_t nameLength = strlen(key);
+  if (nameLength == 0 || nameLength > nvs_record::MAX_NAME_LENGTH ||
+      len > nvs_record::MAX_BYTES_LENGTH) {
+    return false;
+  }
+  size_t id = 0;
+  while (id < entries_.size() && entries_[id].name != key) {
+    id++;
+  }
+  if (id == entries_.size()) {
+    if (type == nvs_record::TOMBSTONE) {
+      return true;
+    }
+    if (id == nvs_record::MAX_IDS) {
+      return false;
+    }
+    entries_.push_back(Entry{key, type, 0, std::string(), false, false});
+  } else {
+    const Entry& entry = entries_[id];
+    if (entry.type == type && entry.number == number &&
+        entry.bytes.size() == len &&
+        (len == 0 || memcmp(entry.bytes.data(), bytes, len) == 0)) {
+      return true;
+    }
+  }
+  Entry& entry = entries_[id];
+  entry.type = type;
+  entry.number = number;
+  entry.bytes.assign((const char*)bytes, len);
+  return append(id);
+}
+
+bool NonVolatileStorage::setUint64(const char* key, uint64_t value) {
+  return write(key, nvs_record::UINT64, value, nullptr, 0);
+}
+
+bool NonVolatileStorage::setInt64(const char* key, int64_t value) {
+  return write(key, nvs_record::SINT64, (uint64_t)value, nullptr, 0);
+}
+
+bool NonVolatileStorage::setFixed32(const char* key, uint32_t value) {
+  return write(key, nvs_record::FIXED32, value, nullptr, 0);
+}
+
+bool NonVolatileStorage::setFixed64(const char* key, uint64_t value) {
+  return write(key, nvs_record::FIXED64, value, nullptr, 0);
+}
+
+bool NonVolatileStorage::setBytes(const char* key, const uint8_t* data,
+                                  size_t len) {
+  return write(key, nvs_record::BYTES, 0, data, len);
+}
+
+bool NonVolatileStorage::setString(const char* key, const char* value) {
+  return setBytes(key, (const uint8_t*)value, strlen(value));
+}
+
+bool NonVolatileStorage::erase(const char* key) {
+  return write(key, nvs_record::TOMBSTONE, 0, nullptr, 0);
+}
+
+const NonVolatileStorage::Entry* NonVolatileStorage::find(
+    const char* key, ValueType type) const {
+  for (const Entry& entry : entries_) {
+    if (entry.name == key) {
+      return entry.type == type ? &entry : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+bool NonVolatileStorage::getUint64(const char* key, uint64_t* value) const {
+  const Entry* entry = find(key, nvs_record::UINT64);
+  if (entry == nullptr) {
+    return false;
+  }
+  *value = entry->number;
+  return true;
+}
+
+bool NonVolatileStorage::getInt64(const char* key, int64_t* value) const {
+  const Entry* entry = find(key, nvs_record::SINT64);
+  if (entry == nullptr) {
+    return false;
+  }
+  *value = (int64_t)entry->number;
+  return true;
+}
+
+bool NonVolatileStorage::getFixed32(const char* key, uint32_t* value) const {
+  const Entry* entry = find(key, nvs_record::FIXED32);
+  if (entry == nullptr) {
+    return false;
+  }
+  *value = entry->number;
+  return true;
+}
+
+bool NonVolatileStorage::getFixed64(const char* key, uint64_t* value) const {
+  const Entry* entry = find(key, nvs_record::FIXED64);
+  if (entry == nullptr) {
+    return false;
+  }
+  *value = entry->number;
+  return true;
+}
+
+bool NonVolatileStorage::getBytes(const char* key, uint8_t* data,
+                                  size_t maxLen, size_t* len) const {
+  const Entry* entry = find(key, nvs_record::BYTES);
+  if (entry == nullptr || entry->bytes.size() > maxLen) {
+    return false;
+  }
+  memcpy(data, entry->bytes.data(), entry->bytes.size());
+  *len = entry->bytes.size();
+  return true;
+}
@@ -3,15 +3,120 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <string>
+#include <vector>
+
+#include "nvs_flash.h"
+#include "nvs_record.h"
+
+struct NvsStats {
+  uint32_t records_written = 0;
+  uint32_t bytes_written = 0;
+  uint32_t compactions = 0;
+  uint32_t sector_erases = 0;
+};
+
+/**
+ * @brief Key value storage as a log of ValueUpdate records, see
+ * nvs_record.h for the layout.
+ *
+ * Only the newest page, by seq_no, is live. Every write appends a record to
+ * it, a write that changes nothing appends nothing. When the page fills the
+ * live values are compacted into a fresh page in the least worn of the other
+ * sectors, with the header written last so that the old page stays the
+ * newest until the new one is complete.
+ */
 class NonVolatileStorage {
  public:
-  NonVolatileStorage(size_t sector_size, size_t sector_count)
-      : sector_size_(sector_size), sector_count_(sector_count){};
-  // Loads, parses and verifies up to sector_size_ * sector_count_ bytes from
-  // provided buffer.
-  void load(const uint8_t* data);
+  NonVolatileStorage(NvsFlash* flash, size_t sector_size, size_t sector_count)
+      : flash_(flash),
+        sector_size_(sector_size),
+        sector_count_(sector_count),
+        erase_counts_(sector_count, 0){};
+
+  /**
+   * @brief Finds the newest page and loads its values.
+   * @return false if there's no page. Until format() starts one, writes only
+   * change the values in RAM.
+   */
+  bool begin();
+  /**
+   * @brief Starts a fresh page in the given sector holding every current
+   * value.
+   */
+  bool format(size_t sector);
+  /**
+   * @brief With rotation off every compaction goes to sector 0, erasing the
+   * page in place once it fills. Turning it off moves the page there.
+   */
+  bool setRotation(bool enabled);
+
+  /**
+   * @brief Holds back writes until commitBatch() appends them as a single
+   * Batch record, so after a power loss either all of them are there or
+   * none.
+   */
+  void startBatch() { batching_ = true; }
+  bool commitBatch();
+
+  bool setUint64(const char* key, uint64_t value);
+  bool setInt64(const char* key, int64_t value);
+  bool setFixed32(const char* key, uint32_t value);
+  bool setFixed64(const char* key, uint64_t value);
+  bool setBytes(const char* key, const uint8_t* data, size_t len);
+  bool setString(const char* key, const char* value);
+  bool erase(const char* key);
+
+  // The getters return false if the key isn't there with that type.
+  bool getUint64(const char* key, uint64_t* value) const;
+  bool getInt64(const char* key, int64_t* value) const;
+  bool getFixed32(const char* key, uint32_t* value) const;
+  bool getFixed64(const char* key, uint64_t* value) const;
+  // Also false if the value is longer than maxLen.
+  bool getBytes(const char* key, uint8_t* data, size_t maxLen,
+                size_t* len) const;
+
+  // -1 while there's no page.
+  int activeSector() const { return active_sector_; }
+  int32_t eraseCount(size_t sector) const { return erase_counts_[sector]; }
+  // Where the next record goes in the active page.
+  size_t writeOffset() const { return write_offset_; }
+  const NvsStats& stats() const { return stats_; }
 
  private:
-  size_t sector_size_;
-  size_t sector_count_;
-};
\ No newline at end of file
+  struct Entry {
+    std::string name;
+    nvs_record::ValueType type;
+    uint64_t number;
+    std::string bytes;
+    // Whether the active page has a record naming it.
+    bool named;
+    // Changed since startBatch().
+    bool pending;
+  };
+
+  bool write(const char* key, nvs_record::ValueType type, uint64_t number,
+             const uint8_t* bytes, size_t len);
+  const Entry* find(const char* key, nvs_record::ValueType type) const;
+  bool append(size_t id);
+  nvs_record::ValueUpdate update(size_t id) const;
+  bool program(const uint8_t* record, size_t size);
+  bool compact();
+  size_t leastWornSector() const;
+
+  NvsFlash* const flash_;
+  const size_t sector_size_;
+  const size_t sector_count_;
+  // Indexed by record id.
+  std::vector<Entry> entries_;
+  std::vector<int32_t> erase_counts_;
+  int active_sector_ = -1;
+  int32_t seq_no_ = 0;
+  size_t write_offset_ = 0;
+  // Set when the active page can't take more records, after a failed or torn
+  // write.
+  bool page_dirty_ = false;
+  bool rotation_ = true;
+  bool batching_ = false;
+  NvsStats stats_;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The sectors NonVolatileStorage keeps its pages in, with NOR flash
+ * semantics: erasing sets a whole sector to 0xFF, programming can only clear
+ * bits and bytes that stay 0xFF can be programmed later.
+ *
+ * Addresses are relative to the first sector.
+ */
+class NvsFlash {
+ public:
+  virtual ~NvsFlash() = default;
+  virtual bool read(size_t address, uint8_t* data, size_t len) = 0;
+  virtual bool program(size_t address, const uint8_t* data, size_t len) = 0;
+  virtual bool eraseSector(size_t sector) = 0;
+};
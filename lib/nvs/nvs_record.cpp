@@ -0,0 +1,374 @@
+#include "nvs_record.h"
+
+#include <string.h>
+
+#include "crc8.h"
+
+namespace nvs_record {
+namespace {
+
+// Field numbers and wire types from nvs.proto.
+enum WireType : uint8_t {
+  WIRE_VARINT = 0,
+  WIRE_FIXED64 = 1,
+  WIRE_BYTES = 2,
+  WIRE_FIXED32 = 5,
+};
+
+constexpr uint8_t tag(uint8_t field, WireType type) {
+  return (field << 3) | type;
+}
+
+constexpr uint8_t HEADER_VERSION_TAG = tag(1, WIRE_VARINT);
+constexpr uint8_t HEADER_SEQ_NO_TAG = tag(2, WIRE_VARINT);
+constexpr uint8_t HEADER_ERASE_COUNT_TAG = tag(3, WIRE_VARINT);
+
+constexpr uint8_t ID_TAG = tag(1, WIRE_VARINT);
+constexpr uint8_t NAME_TAG = tag(2, WIRE_BYTES);
+constexpr uint8_t UINT64_TAG = tag(3, WIRE_VARINT);
+constexpr uint8_t SINT64_TAG = tag(4, WIRE_VARINT);
+constexpr uint8_t FIXED64_TAG = tag(5, WIRE_FIXED64);
+constexpr uint8_t FIXED32_TAG = tag(6, WIRE_FIXED32);
+constexpr uint8_t BYTES_TAG = tag(7, WIRE_BYTES);
+
+constexpr uint8_t BATCH_UPDATE_TAG = tag(15, WIRE_BYTES);
+
+size_t putVarint(uint64_t value, uint8_t* out) {
+  size_t i = 0;
+  while (value >= 0x80) {
+    out[i++] = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  out[i++] = (uint8_t)value;
+  return i;
+}
+
+// Five bytes no matter the value, continuation bits on the padding.
+void putPaddedVarint(uint32_t value, uint8_t* out) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = (uint8_t)(value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  out[4] = (uint8_t)value;
+}
+
+size_t getVarint(const uint8_t* data, size_t len, uint64_t* value) {
+  // Ids, lengths and most settings fit in a byte.
+  if (len > 0 && data[0] < 0x80) {
+    *value = data[0];
+    return 1;
+  }
+  uint64_t result = 0;
+  if (len >= 10) {
+    // No need to check the length on every byte.
+    for (size_t i = 0; i < 10; i++) {
+      result |= (uint64_t)(data[i] & 0x7F) << (7 * i);
+      if ((data[i] & 0x80) == 0) {
+        *value = result;
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+  for (size_t i = 0; i < len; i++) {
+    result |= (uint64_t)(data[i] & 0x7F) << (7 * i);
+    if ((data[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+void putLittleEndian(uint64_t value, size_t size, uint8_t* out) {
+  for (size_t i = 0; i < size; i++) {
+    out[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+uint64_t getLittleEndian(const uint8_t* data, size_t size) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; i++) {
+    value |= (uint64_t)data[i] << (8 * i);
+  }
+  return value;
+}
+
+// Length prefix and crc around the message already at out + offset.
+size_t finishRecord(uint8_t* out, size_t offset, size_t messageLength) {
+  uint8_t prefix[3];
+  const size_t prefixLength = putVarint(messageLength, prefix);
+  if (prefixLength != offset) {
+    memmove(out + prefixLength, out + offset, messageLength);
+  }
+  memcpy(out, prefix, prefixLength);
+  const size_t end = prefixLength + messageLength;
+  out[end] = Crc8(out + prefixLength, messageLength);
+  return end + 1;
+}
+
+}  // namespace
+
+size_t checkRecord(const uint8_t* data, size_t len, size_t* messageStart,
+                   size_t* messageLength) {
+  uint64_t length;
+  const size_t prefixLength = getVarint(data, len, &length);
+  if (prefixLength == 0 || length == 0 || length + 1 > len - prefixLength) {
+    return 0;
+  }
+  if (Crc8(data + prefixLength, length + 1) != 0) {
+    return 0;
+  }
+  *messageStart = prefixLength;
+  *messageLength = length;
+  return prefixLength + length + 1;
+}
+
+void encodePageStart(const PageHeader& header, uint8_t* out) {
+  memcpy(out, MAGIC, sizeof(MAGIC));
+  uint8_t* record = out + sizeof(MAGIC);
+  record[0] = HEADER_MESSAGE_SIZE;
+  uint8_t* field = record + 1;
+  const uint8_t tags[] = {HEADER_VERSION_TAG, HEADER_SEQ_NO_TAG,
+                          HEADER_ERASE_COUNT_TAG};
+  const int32_t values[] = {header.version, header.seq_no,
+                            header.erase_count};
+  for (int i = 0; i < 3; i++) {
+    field[0] = tags[i];
+    putPaddedVarint((uint32_t)values[i], field + 1);
+    field += HEADER_FIELD_SIZE;
+  }
+  *field = Crc8(record + 1, HEADER_MESSAGE_SIZE);
+}
+
+bool decodePageStart(const uint8_t* data, size_t len, PageHeader* header) {
+  if (len < PAGE_DATA_START || data[0] != MAGIC[0] || data[1] != MAGIC[1]) {
+    return false;
+  }
+  size_t start;
+  size_t messageLength;
+  if (!checkRecord(data + sizeof(MAGIC), len - sizeof(MAGIC), &start,
+                   &messageLength) ||
+      messageLength != HEADER_MESSAGE_SIZE) {
+    return false;
+  }
+  const uint8_t* field = data + sizeof(MAGIC) + start;
+  int32_t* const values[] = {&header->version, &header->seq_no,
+                             &header->erase_count};
+  for (int i = 0; i < 3; i++) {
+    uint64_t value;
+    if ((field[0] >> 3) != i + 1 ||
+        getVarint(field + 1, 5, &value) != 5) {
+      return false;
+    }
+    *values[i] = (int32_t)value;
+    field += HEADER_FIELD_SIZE;
+  }
+  return header->version == PAGE_VERSION;
+}
+
+namespace {
+
+// Just the message, returns its length or 0.
+size_t encodeMessage(const ValueUpdate& update, uint8_t* out) {
+  uint8_t* p = out;
+  *p++ = ID_TAG;
+  p += putVarint((uint32_t)update.id, p);
+  if (update.name != nullptr) {
+    if (update.name_length > MAX_NAME_LENGTH) {
+      return 0;
+    }
+    *p++ = NAME_TAG;
+    *p++ = update.name_length;
+    memcpy(p, update.name, update.name_length);
+    p += update.name_length;
+  }
+  switch (update.type) {
+    case TOMBSTONE:
+      break;
+    case UINT64:
+      *p++ = UINT64_TAG;
+      p += putVarint(update.number, p);
+      break;
+    case SINT64: {
+      const int64_t value = (int64_t)update.number;
+      *p++ = SINT64_TAG;
+      p += putVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63), p);
+      break;
+    }
+    case FIXED64:
+      *p++ = FIXED64_TAG;
+      putLittleEndian(update.number, 8, p);
+      p += 8;
+      break;
+    case FIXED32:
+      *p++ = FIXED32_TAG;
+      putLittleEndian(update.number, 4, p);
+      p += 4;
+      break;
+    case BYTES:
+      if (update.bytes_length > MAX_BYTES_LENGTH) {
+        return 0;
+      }
+      *p++ = BYTES_TAG;
+      *p++ = update.bytes_length;
+      memcpy(p, update.bytes, update.bytes_length);
+      p += update.bytes_length;
+      break;
+  }
+  return p - out;
+}
+
+}  // namespace
+
+size_t encodeValueUpdate(const ValueUpdate& update, uint8_t* out) {
+  // Leave room for the longest length prefix, finishRecord() moves the
+  // message back if it didn't need it.
+  constexpr size_t OFFSET = 2;
+  const size_t messageLength = encodeMessage(update, out + OFFSET);
+  if (messageLength == 0) {
+    return 0;
+  }
+  return finishRecord(out, OFFSET, messageLength);
+}
+
+size_t encodeBatch(const ValueUpdate* updates, size_t count, uint8_t* out) {
+  constexpr size_t OFFSET = 3;
+  uint8_t* p = out + OFFSET;
+  for (size_t i = 0; i < count; i++) {
+    // Updates are short enough for a two byte length, leave room for that.
+    uint8_t* const message = p + 3;
+    const size_t messageLength = encodeMessage(updates[i], message);
+    if (messageLength == 0) {
+      return 0;
+    }
+    *p++ = BATCH_UPDATE_TAG;
+    const size_t prefixLength = putVarint(messageLength, p);
+    memmove(p + prefixLength, message, messageLength);
+    p += prefixLength + messageLength;
+  }
+  return finishRecord(out, OFFSET, p - (out + OFFSET));
+}
+
+size_t decodeValueUpdate(const uint8_t* data, size_t len,
+                         ValueUpdate* update) {
+  size_t start;
+  size_t messageLength;
+  const size_t size = checkRecord(data, len, &start, &messageLength);
+  if (size == 0 || !parseValueUpdate(data + start, messageLength, update)) {
+    return 0;
+  }
+  return size;
+}
+
+bool parseValueUpdate(const uint8_t* message, size_t len,
+                      ValueUpdate* update) {
+  *update = ValueUpdate{};
+  update->id = -1;
+  const uint8_t* p = message;
+  const uint8_t* const end = message + len;
+  while (p < end) {
+    const uint8_t fieldTag = *p++;
+    uint64_t value = 0;
+    size_t used = 0;
+    switch (fieldTag) {
+      case ID_TAG:
+      case UINT64_TAG:
+      case SINT64_TAG:
+        used = getVarint(p, end - p, &value);
+        if (used == 0) {
+          return false;
+        }
+        break;
+      case FIXED64_TAG:
+        used = 8;
+        break;
+      case FIXED32_TAG:
+        used = 4;
+        break;
+      case NAME_TAG:
+      case BYTES_TAG:
+        if (p == end || *p > end - p - 1) {
+          return false;
+        }
+        used = 1 + *p;
+        break;
+      default:
+        // Nothing else is written, a tag we don't know means garbage.
+        return false;
+    }
+    if (used > (size_t)(end - p)) {
+      return false;
+    }
+    switch (fieldTag) {
+      case ID_TAG:
+        update->id = (int32_t)value;
+        break;
+      case NAME_TAG:
+        if (*p > MAX_NAME_LENGTH) {
+          return false;
+        }
+        update->name = (const char*)p + 1;
+        update->name_length = *p;
+        break;
+      case UINT64_TAG:
+        update->type = UINT64;
+        update->number = value;
+        break;
+      case SINT64_TAG:
+        update->type = SINT64;
+        update->number = (value >> 1) ^ (~(value & 1) + 1);
+        break;
+      case FIXED64_TAG:
+        update->type = FIXED64;
+        update->number = getLittleEndian(p, 8);
+        break;
+      case FIXED32_TAG:
+        update->type = FIXED32;
+        update->number = getLittleEndian(p, 4);
+        break;
+      case BYTES_TAG:
+        update->type = BYTES;
+        update->bytes = p + 1;
+        update->bytes_length = *p;
+        break;
+    }
+    p += used;
+  }
+  return update->id >= 0;
+}
+
+UpdateIterator::UpdateIterator(const uint8_t* message, size_t len)
+    : pos_(message),
+      end_(message + len),
+      is_batch_(len > 0 && message[0] == BATCH_UPDATE_TAG) {}
+
+bool UpdateIterator::next(ValueUpdate* update, const uint8_t** message,
+                          size_t* len) {
+  if (pos_ == end_ || failed_) {
+    return false;
+  }
+  if (is_batch_) {
+    uint64_t length;
+    const size_t left = end_ - pos_ - 1;
+    const size_t prefixLength =
+        *pos_ == BATCH_UPDATE_TAG ? getVarint(pos_ + 1, left, &length) : 0;
+    if (prefixLength == 0 || length > left - prefixLength) {
+      failed_ = true;
+      return false;
+    }
+    *message = pos_ + 1 + prefixLength;
+    *len = length;
+  } else {
+    *message = pos_;
+    *len = end_ - pos_;
+  }
+  pos_ = *message + *len;
+  if (!parseValueUpdate(*message, *len, update)) {
+    failed_ = true;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace nvs_record
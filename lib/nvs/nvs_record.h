@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Page and record layout shared by NonVolatileStorage and NVSPage. A page is
+// one flash sector:
+//
+//   0xFA 0xDE  magic
+//   record     PageHeader, fixed size, written after everything else
+//   record...  ValueUpdate or Batch
+//   0xFF...    erased rest of the sector
+//
+// A record is varint(n) | n bytes of an nvs.proto message | crc8, with the
+// crc8 chosen so that the crc of the message and it together is zero.
+// Erased flash doesn't parse as a record, so the log ends at the first
+// record that doesn't. The crc8 is what commits a record, a torn Batch is
+// dropped as a whole.
+namespace nvs_record {
+
+constexpr uint8_t MAGIC[] = {0xFA, 0xDE};
+// Every PageHeader field is a padded five byte varint so that the header
+// can be filled in last, in a spot of known size.
+constexpr size_t HEADER_FIELD_SIZE = 1 + 5;
+constexpr size_t HEADER_MESSAGE_SIZE = 3 * HEADER_FIELD_SIZE;
+constexpr size_t HEADER_RECORD_SIZE = 1 + HEADER_MESSAGE_SIZE + 1;
+// Where the first ValueUpdate goes.
+constexpr size_t PAGE_DATA_START = sizeof(MAGIC) + HEADER_RECORD_SIZE;
+constexpr uint8_t MAX_NAME_LENGTH = 31;
+constexpr uint8_t MAX_BYTES_LENGTH = 127;
+constexpr size_t MAX_RECORD_SIZE = 2 + 6 + 2 + MAX_NAME_LENGTH + 11 + 2 +
+                                   MAX_BYTES_LENGTH + 1;
+
+constexpr int32_t PAGE_VERSION = 1;
+// Keys on a page, ids go from 0 to MAX_IDS - 1.
+constexpr size_t MAX_IDS = 64;
+
+enum ValueType : uint8_t {
+  TOMBSTONE = 0,
+  UINT64,
+  SINT64,
+  FIXED64,
+  FIXED32,
+  BYTES,
+};
+
+struct PageHeader {
+  int32_t version;
+  int32_t seq_no;
+  int32_t erase_count;
+};
+
+// A ValueUpdate, pointing into the buffer it was parsed from.
+struct ValueUpdate {
+  int32_t id;
+  // nullptr unless the record names the id.
+  const char* name;
+  uint8_t name_length;
+  ValueType type;
+  // Everything but bytes, fixed32 and sint64 included.
+  uint64_t number;
+  const uint8_t* bytes;
+  uint8_t bytes_length;
+};
+
+// Writes the PAGE_DATA_START bytes every page starts with.
+void encodePageStart(const PageHeader& header, uint8_t* out);
+// Returns false unless data starts with a valid page start.
+bool decodePageStart(const uint8_t* data, size_t len, PageHeader* header);
+
+// Returns the record size, at most MAX_RECORD_SIZE, or 0 if the name or
+// bytes are too long.
+size_t encodeValueUpdate(const ValueUpdate& update, uint8_t* out);
+/**
+ * @brief Checks the length and crc of the record at the start of data.
+ * @return Record size, 0 if there's no valid record.
+ */
+size_t checkRecord(const uint8_t* data, size_t len, size_t* messageStart,
+                   size_t* messageLength);
+// Parses a ValueUpdate message that passed checkRecord().
+bool parseValueUpdate(const uint8_t* message, size_t len,
+                      ValueUpdate* update);
+// Both of the above, returns the record size or 0.
+size_t decodeValueUpdate(const uint8_t* data, size_t len,
+                         ValueUpdate* update);
+
+// Worst case record size for a batch of count updates.
+constexpr size_t maxBatchRecordSize(size_t count) {
+  return 3 + count * (MAX_RECORD_SIZE + 1) + 1;
+}
+/**
+ * @brief Writes the updates as one Batch record, out has to hold
+ * maxBatchRecordSize(count).
+ * @return Record size, 0 if an update doesn't fit nvs.options.
+ */
+size_t encodeBatch(const ValueUpdate* updates, size_t count, uint8_t* out);
+
+/**
+ * @brief Walks the ValueUpdates in a message that passed checkRecord(), the
+ * one of a plain record or all of a Batch.
+ */
+class UpdateIterator {
+ public:
+  UpdateIterator(const uint8_t* message, size_t len);
+
+  /**
+   * @brief Parses the next update, message and length are where it is.
+   * @return false at the end or if the message is broken, see failed().
+   */
+  bool next(ValueUpdate* update, const uint8_t** message, size_t* len);
+  bool failed() const { return failed_; }
+
+ private:
+  const uint8_t* pos_;
+  const uint8_t* const end_;
+  const bool is_batch_;
+  bool failed_ = false;
+};
+
+}  // namespace nvs_record
@@ -2,39 +2,62 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include <memory>
-#include <string>
 #include <vector>
 
-#include "nvs.pb.h"
-
-class NVSValue {
- public:
-  bool is_tombstone = false;
-  std::string string_val;
-  union {
-    uint32_t uint32_val;
-    int32_t int32_val;
-    uint64_t uint64_val;
-    int64_t int64_val;
-    float float_val;
-    double double_val;
-  } numeric_vals;
-};
+#include "nvs_record.h"
 
+/**
+ * @brief Reads a page in place. load() scans the records once and indexes
+ * where the latest value and the name of every id are, values are only
+ * decoded when asked for. The buffer has to outlive the page, nothing is
+ * copied out of it.
+ */
 class NVSPage {
  public:
-  NVSPage(size_t size) : size_(size){};
+  // The index holds max_ids ids and is the only allocation.
+  NVSPage(size_t size, size_t max_ids = nvs_record::MAX_IDS)
+      : size_(size), index_(max_ids){};
 
+  /**
+   * @return false if data doesn't start with a page header or has ids past
+   * max_ids.
+   */
   bool load(const uint8_t* data);
 
+  // One past the highest id on the page.
+  size_t idCount() const { return id_count_; }
+  // Returns -1 if no record on the page names it.
+  int32_t find(const char* name, size_t len) const;
+  // False unless a record names the id, the name is not null terminated.
+  bool name(size_t id, const char** name, size_t* len) const;
+  /**
+   * @brief Decodes the latest value of the id.
+   * @return false if the id has no value on the page.
+   */
+  bool value(size_t id, nvs_record::ValueUpdate* value) const;
+
+  int32_t sequenceNumber() const { return sequence_number_; }
+  int32_t eraseCount() const { return erase_count_; }
+  // Where the records end, the next one would go.
+  size_t dataEnd() const { return data_end_; }
+  // Whether there's nothing but erased flash after the records.
+  bool isClean() const { return is_clean_; }
+
  private:
-  void parse_value_update(const ValueUpdate&);
-  std::vector<std::string> dictionary_;
-  std::vector<std::unique_ptr<NVSValue>> values_;
+  // Offsets into the page, zero for none.
+  struct IndexEntry {
+    uint16_t value_offset;
+    uint16_t name_offset;
+    uint8_t value_length;
+    uint8_t name_length;
+  };
 
   const size_t size_;
-  size_t sequence_number_;
-  size_t erase_count_;
-  bool is_finalized_;
+  const uint8_t* data_ = nullptr;
+  std::vector<IndexEntry> index_;
+  size_t id_count_ = 0;
+  int32_t sequence_number_ = 0;
+  int32_t erase_count_ = 0;
+  size_t data_end_ = 0;
+  bool is_clean_ = false;
 };
@@ -1,11 +1,18 @@
 #include <Arduino.h>
 
+#include <vector>
+
 #include "battery_fuel_gauge.h"
+#include "bms_main.h"
 #include "bms_relay.h"
+#include "bms_relay_core.h"
+#include "capture_recorder.h"
 #include "network.h"
 #include "packet.h"
 #include "settings.h"
 #include "task_queue.h"
+#include "tx_queue.h"
+#include "uart_rx.h"
 
 // UART RX is connected to the *BMS* White line
 // UART TX is connected to the *MB* White line
@@ -24,20 +31,59 @@ void IRAM_ATTR txPinFallInterrupt() { digitalWrite(TX_INVERSE_OUT_PIN, 1); }
 #ifdef NO_GLOBAL_INSTANCES
 HardwareSerial Serial(0);
 #endif
+
+// A few seconds of traffic.
+constexpr size_t CAPTURE_BUFFER_SIZE = 8 * 1024;
+
+TxQueue *txQueue;
+CaptureRecorder *captureRecorder;
+
+struct UartSource {
+  size_t operator()(uint8_t *buffer, size_t maxLen) const {
+    return uartRxRead(buffer, maxLen);
+  }
+  unsigned long receivedMicros() const { return uartRxLastReadMicros(); }
+  uint32_t takeDroppedBytes() const { return uartRxTakeDroppedBytes(); }
+};
+
+struct LockableUartSink {
+  void operator()(const uint8_t *data, size_t len) const {
+    // This if statement is what implements locking.
+    if (!Settings->is_locked) {
+      txQueue->write(data, len);
+    }
+  }
+};
+
+struct ArduinoClock {
+  unsigned long millis() const { return ::millis(); }
+  unsigned long micros() const { return ::micros(); }
+  bool hasMicros() const { return true; }
+};
+
+typedef BmsRelayCore<UartSource, LockableUartSink, ArduinoClock> UartBmsRelay;
+UartBmsRelay *uartRelay;
 }  // namespace
 
 BmsRelay *relay;
 
+const TxQueue &getTxQueue() { return *txQueue; }
+
+CaptureRecorder &getCaptureRecorder() { return *captureRecorder; }
+
 void bms_setup() {
-  relay = new BmsRelay([]() { return Serial.read(); },
-                       [](uint8_t b) {
-                         // This if statement is what implements locking.
-                         if (!Settings->is_locked) {
-                           Serial.write(b);
-                         }
-                       },
-                       millis);
+  txQueue = new TxQueue([]() { return (size_t)Serial.availableForWrite(); },
+                        [](const uint8_t *data, size_t len) {
+                          Serial.write(data, len);
+                        });
+  uartRelay =
+      new UartBmsRelay(UartSource(), LockableUartSink(), ArduinoClock());
+  relay = uartRelay;
+  relay->setCutThroughForwarding(true);
+  captureRecorder = new CaptureRecorder(CAPTURE_BUFFER_SIZE);
+  relay->setCaptureRecorder(captureRecorder);
   Serial.begin(115200);
+  uartRxBegin(115200);
 
   // The B line idle is 0
   digitalWrite(TX_INVERSE_OUT_PIN, 0);
@@ -51,7 +97,8 @@ void bms_setup() {
   attachInterrupt(digitalPinToInterrupt(TX_INPUT_PIN), txPinFallInterrupt,
                   FALLING);
 
-  relay->addReceivedPacketCallback([](BmsRelay *, Packet *packet) {
+  // Repeats of the same packet don't tell the web clients anything new.
+  relay->addChangedPacketCallback([](BmsRelay *, Packet *packet) {
     static uint8_t ledState = 0;
     digitalWrite(LED_BUILTIN, ledState);
     ledState = 1 - ledState;
@@ -95,5 +142,8 @@ void bms_setup() {
 
   setupWifi();
   setupWebServer(relay);
-  TaskQueue.postRecurringTask([]() { relay->loop(); });
+  TaskQueue.postRecurringTask([]() {
+    txQueue->pump();
+    uartRelay->loop();
+  });
 }
@@ -8,6 +8,7 @@
 
 #include "ArduinoJson.h"
 #include "async_ota.h"
+#include "bms_main.h"
 #include "bms_relay.h"
 #include "data.h"
 #include "settings.h"
@@ -23,10 +24,23 @@ BmsRelay *relay;
 
 const String owie_version = "2.0.0-dev";
 
+// A /capture download holds the recording still, so only one runs at a
+// time. Numbered so a download that's over can't resume the next one.
+uint32_t captureDownloadId = 0;
+bool captureDownloadRunning = false;
+
+void endCaptureDownload(uint32_t id) {
+  if (captureDownloadRunning && id == captureDownloadId) {
+    captureDownloadRunning = false;
+    getCaptureRecorder().setPaused(false);
+  }
+}
+
 String renderPacketStatsTable() {
   String result(
-      PSTR("<table><tr><th>ID</th><th>Period</th><th>Deviation</th><th>Count</"
-           "th></tr>"));
+      PSTR("<table><tr><th>ID</th><th>Period</th><th>Deviation</th><th>Period "
+           "Min/Max</th><th>Count</th><th>Missed</th><th>Unchanged</"
+           "th><th>Fwd Latency us (avg/max)</th></tr>"));
   for (const IndividualPacketStat &stat :
        relay->getPacketTracker().getIndividualPacketStats()) {
     if (stat.id < 0) {
@@ -43,22 +57,140 @@ String renderPacketStatsTable() {
     result.concat(PSTR("</td><td>"));
     result.concat(stat.deviation_millis());
     result.concat(PSTR("</td><td>"));
+    result.concat(stat.min_period_millis);
+    result.concat('/');
+    result.concat(stat.max_period_millis);
+    result.concat(PSTR("</td><td>"));
     result.concat(stat.total_num);
+    result.concat(PSTR("</td><td>"));
+    result.concat(stat.missed_num);
+    result.concat(PSTR("</td><td>"));
+    result.concat(stat.unchanged_num);
+    result.concat(PSTR("</td><td>"));
+    result.concat(stat.avg_forwarding_latency_micros);
+    result.concat('/');
+    result.concat(stat.max_forwarding_latency_micros);
     result.concat(PSTR("</td></tr>"));
   }
 
-  result.concat(PSTR(
-      "<tr><th>Unknown Bytes</th><th>Checksum Mismatches</th></tr><tr><td>"));
+  const GlobalStats &globalStats = relay->getPacketTracker().getGlobalStats();
   result.concat(
-      relay->getPacketTracker().getGlobalStats().total_unknown_bytes_received);
+      PSTR("<tr><th>Unknown Bytes</th><th>Checksum Mismatches</th><th>Resync "
+           "Recovered</th><th>Resync Lost</th><th>RX Dropped "
+           "Bytes</th></tr><tr><td>"));
+  result.concat(globalStats.total_unknown_bytes_received);
+  result.concat(PSTR("</td><td>"));
+  result.concat(globalStats.total_packet_checksum_mismatches);
+  result.concat(PSTR("</td><td>"));
+  result.concat(globalStats.total_packets_recovered_by_resync);
   result.concat(PSTR("</td><td>"));
-  result.concat(relay->getPacketTracker()
-                    .getGlobalStats()
-                    .total_packet_checksum_mismatches);
+  result.concat(globalStats.total_partial_packets_discarded);
+  result.concat(PSTR("</td><td>"));
+  result.concat(globalStats.total_rx_bytes_dropped);
+  result.concat(PSTR("</td></tr>"));
+
+  const TxQueueStats &txStats = getTxQueue().getStats();
+  result.concat(
+      PSTR("<tr><th>TX Queue High Water</th><th>TX Would Block</th><th>TX "
+           "Dropped Bytes</th><th>TX Dropped Writes</th></tr><tr><td>"));
+  result.concat(txStats.high_water_bytes);
+  result.concat(PSTR("</td><td>"));
+  result.concat(txStats.would_block_count);
+  result.concat(PSTR("</td><td>"));
+  result.concat(txStats.dropped_bytes);
+  result.concat(PSTR("</td><td>"));
+  result.concat(txStats.dropped_writes);
   result.concat(PSTR("</td></tr></table>"));
   return result;
 }
 
+void concatBusCounters(String *result, const char *title,
+                       const BusCounters &counters, bool perSecond) {
+  result->concat(PSTR("<tr><td>"));
+  result->concat(FPSTR(title));
+  for (uint32_t count :
+       {counters.bytes_in, counters.bytes_out, counters.replayed_bytes,
+        counters.swallowed_bytes, counters.unknown_bytes}) {
+    result->concat(PSTR("</td><td>"));
+    result->concat(count);
+  }
+  for (uint32_t count : {counters.bytes_in, counters.bytes_out}) {
+    result->concat(PSTR("</td><td>"));
+    if (perSecond) {
+      result->concat(count * 100 / BusUtilization::MAX_BYTES_PER_SECOND);
+      result->concat('%');
+    }
+  }
+  result->concat(PSTR("</td></tr>"));
+}
+
+String renderBusUtilizationTable() {
+  const BusUtilization &bus = relay->getBusUtilization();
+  String result(
+      PSTR("<table><tr><th>Bytes</th><th>In</th><th>Out</th><th>Replayed</"
+           "th><th>Swallowed</th><th>Unknown</th><th>In Load</th><th>Out "
+           "Load</th></tr>"));
+  concatBusCounters(&result, PSTR("Last Second"), bus.lastSecond(), true);
+  concatBusCounters(&result, PSTR("Peak Second"), bus.peakSecond(), true);
+  concatBusCounters(&result, PSTR("Total"), bus.total(), false);
+  result.concat(PSTR("</table>"));
+
+  // Single row, columns are the lower bounds of the histogram buckets.
+  typedef BusUtilization::IdleGapHistogram Histogram;
+  const Histogram gaps = bus.idleGapMicros();
+  result.concat(PSTR("<table><tr><th>Idle Gap us</th>"));
+  for (uint8_t bucket = 0; bucket < Histogram::numBuckets(); bucket++) {
+    result.concat(PSTR("<th>"));
+    result.concat(Histogram::bucketLowerBound(bucket));
+    if (bucket == Histogram::numBuckets() - 1) {
+      result.concat('+');
+    }
+    result.concat(PSTR("</th>"));
+  }
+  result.concat(PSTR("</tr><tr><td>Last 1-2 min"));
+  for (uint8_t bucket = 0; bucket < Histogram::numBuckets(); bucket++) {
+    result.concat(PSTR("</td><td>"));
+    result.concat(gaps.count(bucket));
+  }
+  result.concat(PSTR("</td></tr></table>"));
+  return result;
+}
+
+// One row per packet type, columns are the lower bounds of the histogram
+// buckets.
+template <class Histogram>
+String renderHistogramTable(const char *title,
+                            Histogram IndividualPacketStat::*histogram) {
+  String result(PSTR("<table><tr><th>"));
+  result.concat(FPSTR(title));
+  result.concat(PSTR("</th>"));
+  for (uint8_t bucket = 0; bucket < Histogram::numBuckets(); bucket++) {
+    result.concat(PSTR("<th>"));
+    result.concat(Histogram::bucketLowerBound(bucket));
+    if (bucket == Histogram::numBuckets() - 1) {
+      result.concat('+');
+    }
+    result.concat(PSTR("</th>"));
+  }
+  result.concat(PSTR("</tr>"));
+  for (const IndividualPacketStat &stat :
+       relay->getPacketTracker().getIndividualPacketStats()) {
+    if ((stat.*histogram).total() == 0) {
+      continue;
+    }
+    char buffer[16];
+    snprintf_P(buffer, sizeof(buffer), PSTR("<tr><td>%X"), stat.id);
+    result.concat(buffer);
+    for (uint8_t bucket = 0; bucket < Histogram::numBuckets(); bucket++) {
+      result.concat(PSTR("</td><td>"));
+      result.concat((stat.*histogram).count(bucket));
+    }
+    result.concat(PSTR("</td></tr>"));
+  }
+  result.concat(PSTR("</table>"));
+  return result;
+}
+
 String uptimeString() {
   const unsigned long nowSecs = millis() / 1000;
   const int hrs = nowSecs / 3600;
@@ -178,6 +310,14 @@ String templateProcessor(const String &var) {
     return Settings->locking_enabled ? "1" : "";
   } else if (var == "PACKET_STATS_TABLE") {
     return renderPacketStatsTable();
+  } else if (var == "BUS_UTILIZATION_TABLE") {
+    return renderBusUtilizationTable();
+  } else if (var == "RELAY_LATENCY_TABLE") {
+    return renderHistogramTable(PSTR("Relay Latency us"),
+                                &IndividualPacketStat::relay_latency_micros);
+  } else if (var == "PACKET_PERIOD_TABLE") {
+    return renderHistogramTable(PSTR("Period ms"),
+                                &IndividualPacketStat::period_millis);
   } else if (var == "CELL_VOLTAGE_TABLE") {
     const uint16_t *cellMillivolts = relay->getCellMillivolts();
     String out;
@@ -333,6 +473,32 @@ void setupWebServer(BmsRelay *bmsRelay) {
     request->send_P(200, "text/html", MONITOR_HTML_PROGMEM_ARRAY,
                     MONITOR_HTML_SIZE, templateProcessor);
   });
+  webServer.on("/capture", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (captureDownloadRunning) {
+      request->send(409, "text/plain", "A capture download is running.");
+      return;
+    }
+    // Held still until the last piece went out or the client gave up.
+    CaptureRecorder &capture = getCaptureRecorder();
+    const uint32_t id = ++captureDownloadId;
+    captureDownloadRunning = true;
+    capture.setPaused(true);
+    const size_t size = capture.captureSize();
+    AsyncWebServerResponse *response = request->beginResponse(
+        "application/octet-stream", size,
+        [&capture, size, id](uint8_t *buffer, size_t maxLen,
+                             size_t index) -> size_t {
+          const size_t len = capture.readCapture(index, buffer, maxLen);
+          if (index + len >= size) {
+            endCaptureDownload(id);
+          }
+          return len;
+        });
+    response->addHeader("Content-Disposition",
+                        "attachment; filename=owie_capture.bin");
+    request->onDisconnect([id]() { endCaptureDownload(id); });
+    request->send(response);
+  });
   webServer.on("/settings", HTTP_ANY, [](AsyncWebServerRequest *request) {
     switch (request->method()) {
       case HTTP_GET:
@@ -1,35 +1,206 @@
 #include "settings.h"
 
 #include <Esp.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include "EEPROM_Rotate.h"
 #include "dprint.h"
+#include "nvs.h"
 #include "pb_decode.h"
-#include "pb_encode.h"
 #include "spi_flash_geometry.h"
 #include "task_queue.h"
-#include "nvs.h"
 
 namespace {
 SettingsMsg __settings = SettingsMsg_init_default;
 
 SettingsMsg DEFAULT_SETTINGS = SettingsMsg_init_default;
 
+// The sectors EEPROM_Rotate used, settings saved before NonVolatileStorage
+// are moved over from there once.
+const size_t FLASH_SECTORS = 4;
 // 3 bytes needed by EEPROM_Rotate + 2 byte proto message size
 const size_t MAX_SETTINGS_SIZE = SPI_FLASH_SEC_SIZE - 5;
 
+// Sector i is the i-th one below the EEPROM sector, the same order
+// EEPROM_Rotate uses. Sector 0 is the only one OTA doesn't overwrite.
+class SettingsFlash : public NvsFlash {
+ public:
+  SettingsFlash(uint32_t base_sector) : base_sector_(base_sector) {}
+
+  bool read(size_t address, uint8_t* data, size_t len) override {
+    while (len > 0) {
+      const size_t n = chunk(address, len);
+      if (!ESP.flashRead(aligned(address), words_, alignedSize(address, n))) {
+        return false;
+      }
+      memcpy(data, (uint8_t*)words_ + address % 4, n);
+      address += n;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool program(size_t address, const uint8_t* data, size_t len) override {
+    while (len > 0) {
+      const size_t n = chunk(address, len);
+      // Programming 0xFF leaves the neighbouring bytes as they are.
+      memset(words_, 0xFF, sizeof(words_));
+      memcpy((uint8_t*)words_ + address % 4, data, n);
+      if (!ESP.flashWrite(aligned(address), words_,
+                          alignedSize(address, n))) {
+        return false;
+      }
+      address += n;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool eraseSector(size_t sector) override {
+    return ESP.flashEraseSector(base_sector_ - sector);
+  }
+
+ private:
+  // The SDK only moves whole, aligned words.
+  size_t chunk(size_t address, size_t len) const {
+    const size_t inSector =
+        SPI_FLASH_SEC_SIZE - address % SPI_FLASH_SEC_SIZE;
+    return std::min(std::min(len, sizeof(words_) - address % 4), inSector);
+  }
+  uint32_t aligned(size_t address) const {
+    const size_t sector = address / SPI_FLASH_SEC_SIZE;
+    return (base_sector_ - sector) * SPI_FLASH_SEC_SIZE +
+           (address % SPI_FLASH_SEC_SIZE & ~3u);
+  }
+  static size_t alignedSize(size_t address, size_t n) {
+    return (address % 4 + n + 3) & ~3u;
+  }
+
+  const uint32_t base_sector_;
+  uint32_t words_[16];
+};
+
 EEPROM_Rotate& getEeprom() {
-  new NonVolatileStorage(0,0);
   static EEPROM_Rotate e;
-  static bool initialized = false;
-  if (!initialized) {
-    e.size(4);
-    e.offset(MAX_SETTINGS_SIZE);
-    e.begin(SPI_FLASH_SEC_SIZE);
-    initialized = true;
-  }
   return e;
 }
+
+NonVolatileStorage& getStorage() {
+  static SettingsFlash flash(getEeprom().base());
+  static NonVolatileStorage storage(&flash, SPI_FLASH_SEC_SIZE, FLASH_SECTORS);
+  return storage;
+}
+
+enum FieldType { UINT32_FIELD, INT32_FIELD, BOOL_FIELD, STRING_FIELD };
+
+struct SettingsField {
+  const char* key;
+  FieldType type;
+  size_t offset;
+  // Of the field in SettingsMsg, strings including their NUL.
+  size_t size;
+};
+
+// Each field is its own key, so saving one that changed writes just that.
+#define FIELD(name, type) \
+  { #name, type, offsetof(SettingsMsg, name), sizeof(SettingsMsg::name) }
+#define BATTERY_FIELD(name)                                         \
+  {                                                                 \
+    #name, INT32_FIELD, offsetof(SettingsMsg, battery_state.name), \
+        sizeof(int32_t)                                             \
+  }
+const SettingsField SETTINGS_FIELDS[] = {
+    FIELD(quick_power_cycle_count, UINT32_FIELD),
+    FIELD(ap_name, STRING_FIELD),
+    FIELD(ap_password, STRING_FIELD),
+    FIELD(graceful_shutdown_count, INT32_FIELD),
+    FIELD(ap_self_password, STRING_FIELD),
+    FIELD(ap_self_name, STRING_FIELD),
+    FIELD(wifi_power, INT32_FIELD),
+    FIELD(is_locked, BOOL_FIELD),
+    FIELD(locking_enabled, BOOL_FIELD),
+    FIELD(has_battery_state, BOOL_FIELD),
+    BATTERY_FIELD(bottom_milliamp_seconds),
+    BATTERY_FIELD(current_milliamp_seconds),
+    BATTERY_FIELD(top_soc),
+    BATTERY_FIELD(bottom_soc),
+};
+#undef FIELD
+#undef BATTERY_FIELD
+
+void readField(const NonVolatileStorage& storage, const SettingsField& field) {
+  uint8_t* const value = (uint8_t*)&__settings + field.offset;
+  uint64_t u;
+  int64_t i;
+  size_t len;
+  switch (field.type) {
+    case UINT32_FIELD:
+      if (storage.getUint64(field.key, &u)) {
+        *(uint32_t*)value = u;
+      }
+      break;
+    case INT32_FIELD:
+      if (storage.getInt64(field.key, &i)) {
+        *(int32_t*)value = i;
+      }
+      break;
+    case BOOL_FIELD:
+      if (storage.getUint64(field.key, &u)) {
+        *(bool*)value = u != 0;
+      }
+      break;
+    case STRING_FIELD:
+      // Leaves room for the NUL, settings.options sizes count it.
+      if (storage.getBytes(field.key, value, field.size - 1, &len)) {
+        value[len] = 0;
+      }
+      break;
+  }
+}
+
+bool writeField(NonVolatileStorage& storage, const SettingsField& field) {
+  const uint8_t* const value = (const uint8_t*)&__settings + field.offset;
+  switch (field.type) {
+    case UINT32_FIELD:
+      return storage.setUint64(field.key, *(const uint32_t*)value);
+    case INT32_FIELD:
+      return storage.setInt64(field.key, *(const int32_t*)value);
+    case BOOL_FIELD:
+      return storage.setUint64(field.key, *(const bool*)value);
+    case STRING_FIELD:
+      return storage.setBytes(
+          field.key, value,
+          strnlen((const char*)value, field.size - 1));
+  }
+  return false;
+}
+
+// Reads what EEPROM_Rotate saved last. Returns the sector the first page can
+// go to without erasing it.
+size_t loadLegacySettings() {
+  auto& e = getEeprom();
+  e.size(FLASH_SECTORS);
+  e.offset(MAX_SETTINGS_SIZE);
+  e.begin(SPI_FLASH_SEC_SIZE);
+  uint16_t len = *(uint16_t*)e.getConstDataPtr();
+  auto istream = pb_istream_from_buffer(e.getConstDataPtr() + 2,
+                                        min<uint16_t>(len, MAX_SETTINGS_SIZE));
+  if (pb_decode(&istream, &SettingsMsg_msg, &__settings)) {
+    DPRINTF("Read and decoded legacy settings, size = %d bytes.", len);
+  } else {
+    DPRINTLN("Failed to decode legacy settings, resetting.");
+    __settings = DEFAULT_SETTINGS;
+  }
+  const size_t spare = (e.base() - e.current() + 1) % FLASH_SECTORS;
+  // Frees the sector sized buffer, nothing to commit.
+  e.end();
+  return spare;
+}
 }  // namespace
 
 SettingsMsg * const Settings = &__settings;
@@ -47,30 +218,45 @@ void sanitizeWifiPowerSetting() {
 }
 
 void loadSettings() {
-  auto& e = getEeprom();
-  uint16_t len = *(uint16_t*)e.getConstDataPtr();
-  auto istream = pb_istream_from_buffer(getEeprom().getConstDataPtr() + 2,
-                                        min<uint16_t>(len, MAX_SETTINGS_SIZE));
-  if (pb_decode(&istream, &SettingsMsg_msg, Settings)) {
-    DPRINTF("Read and decoded settings, size = %d bytes.", len);
+  auto& storage = getStorage();
+  if (storage.begin()) {
+    *Settings = DEFAULT_SETTINGS;
+    for (const SettingsField& field : SETTINGS_FIELDS) {
+      readField(storage, field);
+    }
+    DPRINTF("Loaded settings from sector %d.", storage.activeSector());
     sanitizeWifiPowerSetting();
     return;
   }
-  DPRINTLN("Failed to decode settings, resetting.");
-  nukeSettings();  // nukeSettings() calls saveSettings()
+  // First start on NonVolatileStorage. The old settings stay where they are
+  // until the first page is complete.
+  const size_t sector = loadLegacySettings();
+  sanitizeWifiPowerSetting();
+  for (const SettingsField& field : SETTINGS_FIELDS) {
+    writeField(storage, field);
+  }
+  if (!storage.format(sector)) {
+    DPRINTLN("Failed to write settings.");
+  }
 }
 
 int32_t saveSettings() {
-  auto& e = getEeprom();
-  auto stream = pb_ostream_from_buffer(e.getDataPtr() + 2, MAX_SETTINGS_SIZE);
-  if (!pb_encode(&stream, &SettingsMsg_msg, Settings)) {
-    DPRINTLN("Failed to encode settings.");
+  auto& storage = getStorage();
+  const uint32_t before = storage.stats().bytes_written;
+  // Fields saved together, like is_locked and locking_enabled or the battery
+  // state, go to flash together.
+  storage.startBatch();
+  bool ok = true;
+  for (const SettingsField& field : SETTINGS_FIELDS) {
+    ok = writeField(storage, field) && ok;
+  }
+  if (!storage.commitBatch() || !ok) {
+    DPRINTLN("Failed to write settings.");
     return -1;
   }
-  *(int16_t*)e.getDataPtr() = (int16_t)stream.bytes_written;
-  e.commit();
-  DPRINTF("Serialized settings, size = %d bytes.", stream.bytes_written);
-  return stream.bytes_written;
+  const int32_t written = storage.stats().bytes_written - before;
+  DPRINTF("Saved settings, %d bytes written.", written);
+  return written;
 }
 
 int32_t saveSettingsAndRestartSoon() {
@@ -79,7 +265,7 @@ int32_t saveSettingsAndRestartSoon() {
   return code;
 }
 
-void disableFlashPageRotation() { getEeprom().rotate(false); }
+void disableFlashPageRotation() { getStorage().setRotation(false); }
 
 void nukeSettings() {
   *Settings = DEFAULT_SETTINGS;
@@ -0,0 +1,100 @@
+#include "uart_rx.h"
+
+#include <Arduino.h>
+#include <esp8266_peri.h>
+
+#include "spsc_ring.h"
+
+namespace {
+
+// Interrupt once this many bytes wait in the hardware FIFO, or when the line
+// has been quiet for RX_TIMEOUT_BYTE_TIMES after the last byte.
+constexpr uint32_t RX_FIFO_FULL_THRESHOLD = 16;
+constexpr uint32_t RX_TIMEOUT_BYTE_TIMES = 2;
+constexpr uint32_t UART_FIFO_SIZE = 128;
+
+// About 45ms of back to back bytes at 115200 baud.
+SpscRing<uint8_t, 512> rxBytes;
+
+struct RxBatch {
+  // Estimated arrival of the batch's first byte.
+  uint32_t first_byte_micros;
+  // rxBytes.totalPushed() right after the batch.
+  uint32_t end;
+};
+SpscRing<RxBatch, 32> rxBatches;
+
+uint32_t byteMicros = 0;
+// Only written by the interrupt handler, the main loop keeps track of how
+// much of it it has reported.
+volatile uint32_t droppedTotal = 0;
+uint32_t droppedReported = 0;
+unsigned long lastReadMicros = 0;
+
+void IRAM_ATTR uartRxIsr(void *, void *) {
+  const uint32_t status = USIS(0);
+  const uint32_t now = micros();
+  uint8_t fifo[UART_FIFO_SIZE];
+  const uint32_t len = (USS(0) >> USRXC) & 0xFF;
+  for (uint32_t i = 0; i < len; i++) {
+    fifo[i] = USF(0);
+  }
+  uint32_t dropped = len - rxBytes.push(fifo, len);
+  if (status & (1 << UIOF)) {
+    // At least one byte, the hardware doesn't say how many.
+    dropped++;
+  }
+  if (dropped > 0) {
+    droppedTotal = droppedTotal + dropped;
+  }
+  if (len > 0) {
+    // The bytes came in back to back, the last one just now if the FIFO
+    // filled up or a few byte times ago if the line went quiet.
+    uint32_t byteTimes = len - 1;
+    if (!(status & (1 << UIFF))) {
+      byteTimes += RX_TIMEOUT_BYTE_TIMES;
+    }
+    // If this doesn't fit the batch gets the time of a later one.
+    rxBatches.push(RxBatch{now - byteTimes * byteMicros, rxBytes.totalPushed()});
+  }
+  USIC(0) = status;
+}
+
+}  // namespace
+
+void uartRxBegin(unsigned long baud) {
+  // 8N1 with a start bit.
+  byteMicros = 10 * 1000000 / baud;
+  ETS_UART_INTR_DISABLE();
+  USC1(0) = (RX_FIFO_FULL_THRESHOLD << UCFFT) |
+            (RX_TIMEOUT_BYTE_TIMES << UCTOT) | (1 << UCTOE);
+  USIC(0) = 0xFFFF;
+  USIE(0) = (1 << UIFF) | (1 << UITO) | (1 << UIOF);
+  ETS_UART_INTR_ATTACH(uartRxIsr, nullptr);
+  ETS_UART_INTR_ENABLE();
+}
+
+size_t uartRxRead(uint8_t *buffer, size_t maxLen) {
+  const uint32_t first = rxBytes.totalPopped();
+  const size_t len = rxBytes.pop(buffer, maxLen);
+  if (len == 0) {
+    return 0;
+  }
+  // Batches that ended before the first byte read are done with.
+  RxBatch batch;
+  while (rxBatches.front(&batch) && (int32_t)(batch.end - first) <= 0) {
+    rxBatches.pop(&batch, 1);
+  }
+  lastReadMicros =
+      rxBatches.front(&batch) ? batch.first_byte_micros : micros();
+  return len;
+}
+
+unsigned long uartRxLastReadMicros() { return lastReadMicros; }
+
+uint32_t uartRxTakeDroppedBytes() {
+  const uint32_t total = droppedTotal;
+  const uint32_t dropped = total - droppedReported;
+  droppedReported = total;
+  return dropped;
+}
@@ -72,12 +72,33 @@ void testSimpleChargeAndHalfwayDischarge() {
   TEST_ASSERT_EQUAL(0, gauge->getMilliampSecondsRecharged());
 }
 
+void testSocIsRoundedToNearest() {
+  FuelGaugeState state;
+  state.topSoc = 68;
+  state.bottomSoc = 18;
+  state.bottomMilliampSeconds = 3;
+  state.currentMilliampSeconds = 1;
+  gauge->restoreState(state);
+  // 68 - 50 / 3 = 51.33
+  TEST_ASSERT_EQUAL(51, gauge->getSoc());
+  state.currentMilliampSeconds = 2;
+  gauge->restoreState(state);
+  // 68 - 100 / 3 = 34.67
+  TEST_ASSERT_EQUAL(35, gauge->getSoc());
+  // A full 10Ah pack doesn't overflow.
+  state.bottomMilliampSeconds = 36000000;
+  state.currentMilliampSeconds = 18000000;
+  gauge->restoreState(state);
+  TEST_ASSERT_EQUAL(43, gauge->getSoc());
+}
+
 int main(int argc, char** argv) {
   UNITY_BEGIN();
   RUN_TEST(testUninitializedGauge);
   RUN_TEST(testCurrentRideSpentAndRegeneratedStats);
   RUN_TEST(testSocAfterFirstVoltageMessageAndStateSaving);
   RUN_TEST(testSimpleChargeAndHalfwayDischarge);
+  RUN_TEST(testSocIsRoundedToNearest);
   UNITY_END();
 
   return 0;
@@ -0,0 +1,120 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "bms_relay.h"
+#include "bms_relay_core.h"
+#include "packet.h"
+#include "workload.h"
+
+constexpr size_t STREAM_SIZE = 4 * 1024 * 1024;
+// Roughly what a busy UART FIFO hands over per poll.
+constexpr size_t BULK_READ_SIZE = 32;
+
+std::vector<uint8_t> stream;
+size_t readPos;
+size_t bytesOut;
+unsigned long timeMillis;
+
+void setUp(void) {
+  readPos = 0;
+  bytesOut = 0;
+  timeMillis = 0;
+}
+
+void buildStream() {
+  while (stream.size() < STREAM_SIZE) {
+    for (const auto& packet : PINT_PACKETS) {
+      stream.insert(stream.end(), packet.begin(), packet.end());
+    }
+  }
+}
+
+// The sources below run dry at every 256 byte boundary so that loop()
+// returns periodically, like it does on a real UART.
+size_t pollLimit() {
+  return std::min((readPos / 256 + 1) * 256, stream.size());
+}
+
+double bytesPerSecond(BmsRelay* relay) {
+  const auto start = std::chrono::steady_clock::now();
+  while (readPos < stream.size()) {
+    relay->loop();
+    timeMillis++;
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  // Status and current packets get swallowed, everything else goes through.
+  TEST_ASSERT_GREATER_THAN(stream.size() / 2, bytesOut);
+  return stream.size() / seconds;
+}
+
+void benchPerByteSource() {
+  BmsRelay relay(
+      []() {
+        if (readPos >= pollLimit()) {
+          return -1;
+        }
+        return (int)stream[readPos++];
+      },
+      [](uint8_t b) { bytesOut++; }, []() { return timeMillis; });
+  const double bps = bytesPerSecond(&relay);
+  printf("Per-byte source: %.2f MB/s\n", bps / 1e6);
+}
+
+void benchBulkSource() {
+  BmsRelay relay(
+      [](uint8_t* buffer, size_t maxLen) {
+        const size_t len =
+            std::min(std::min(maxLen, BULK_READ_SIZE), pollLimit() - readPos);
+        memcpy(buffer, &stream[readPos], len);
+        readPos += len;
+        return len;
+      },
+      [](uint8_t b) { bytesOut++; }, []() { return timeMillis; });
+  const double bps = bytesPerSecond(&relay);
+  printf("Bulk source: %.2f MB/s\n", bps / 1e6);
+}
+
+struct StreamSource {
+  size_t operator()(uint8_t* buffer, size_t maxLen) const {
+    const size_t len =
+        std::min(std::min(maxLen, BULK_READ_SIZE), pollLimit() - readPos);
+    memcpy(buffer, &stream[readPos], len);
+    readPos += len;
+    return len;
+  }
+};
+
+struct CountingSink {
+  void operator()(const uint8_t* data, size_t len) const { bytesOut += len; }
+};
+
+struct FakeClock {
+  unsigned long millis() const { return timeMillis; }
+  unsigned long micros() const { return timeMillis * 1000; }
+  bool hasMicros() const { return true; }
+};
+
+void benchCompileTimePolicies() {
+  BmsRelayCore<StreamSource, CountingSink, FakeClock> relay(
+      StreamSource{}, CountingSink{}, FakeClock{});
+  const double bps = bytesPerSecond(&relay);
+  printf("Compile time policies: %.2f MB/s\n", bps / 1e6);
+}
+
+int main(int argc, char** argv) {
+  buildStream();
+  UNITY_BEGIN();
+  RUN_TEST(benchPerByteSource);
+  RUN_TEST(benchBulkSource);
+  RUN_TEST(benchCompileTimePolicies);
+  UNITY_END();
+
+  return 0;
+}
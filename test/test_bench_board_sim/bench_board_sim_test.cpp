@@ -0,0 +1,49 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+
+#include "board_sim.h"
+
+// Long enough for slow leaks to add up, short enough for a bench run.
+constexpr uint64_t SOAK_HOURS = 48;
+
+void setUp(void) {}
+
+void soak(const BoardSim::Config& config) {
+  BoardSim sim(config);
+  // Whatever gets set up on the first packets is not a leak.
+  sim.run(60 * 1000);
+  const BoardSimStats warm = sim.stats();
+  const auto start = std::chrono::steady_clock::now();
+  sim.run(SOAK_HOURS * 3600 * 1000);
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  printBoardSimStats(sim);
+  printf("%.1f board hours per second\n\n", SOAK_HOURS / seconds);
+
+  const BoardSimStats& stats = sim.stats();
+  TEST_ASSERT_EQUAL(warm.allocations, stats.allocations);
+  TEST_ASSERT_EQUAL(warm.heap_growth_bytes, stats.heap_growth_bytes);
+  const GlobalStats& global = sim.relay().getPacketTracker().getGlobalStats();
+  TEST_ASSERT_EQUAL(0, global.total_rx_bytes_dropped);
+  TEST_ASSERT_EQUAL(0, sim.txQueue().getStats().dropped_bytes);
+}
+
+void soakCleanTraffic() { soak(BoardSim::Config{}); }
+
+void soakFlakyBms() {
+  BoardSim::Config config;
+  config.skip_per_mille = 100;
+  soak(config);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(soakCleanTraffic);
+  RUN_TEST(soakFlakyBms);
+  UNITY_END();
+
+  return 0;
+}
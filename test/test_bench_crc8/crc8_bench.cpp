@@ -0,0 +1,70 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "crc8.h"
+
+void setUp(void) {}
+
+// xorshift32, any data will do.
+uint8_t nextRandomByte(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+typedef uint8_t (*Crc8Function)(const uint8_t*, size_t);
+
+// Best of a few runs over 4 MB in pieces of the given length.
+double megabytesPerSecond(Crc8Function crc8, size_t length) {
+  constexpr size_t TOTAL = 4 << 20;
+  uint32_t state = 1;
+  std::vector<uint8_t> data(4096);
+  for (uint8_t& b : data) {
+    b = nextRandomByte(&state);
+  }
+  volatile uint8_t sink;
+  double best = 1e30;
+  for (int r = 0; r < 5; r++) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < TOTAL; done += length) {
+      sink = crc8(&data[done % (data.size() - length + 1)], length);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(end - start).count());
+  }
+  (void)sink;
+  return TOTAL / best / 1e6;
+}
+
+void benchThroughput() {
+  const struct {
+    const char* name;
+    Crc8Function crc8;
+  } variants[] = {{"bitwise", Crc8Bitwise},
+                  {"table", Crc8Table},
+                  {"slice-by-4", Crc8SliceBy4}};
+  // A short record, a long one and a whole page.
+  const size_t lengths[] = {8, 64, 4096};
+  printf("MB/s         %8zu %8zu %8zu\n", lengths[0], lengths[1], lengths[2]);
+  for (const auto& variant : variants) {
+    printf("%-12s", variant.name);
+    for (size_t length : lengths) {
+      printf(" %8.0f", megabytesPerSecond(variant.crc8, length));
+    }
+    printf("\n");
+  }
+  printf("Crc8() uses %d table(s)\n", CRC8_TABLES);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(benchThroughput);
+  UNITY_END();
+
+  return 0;
+}
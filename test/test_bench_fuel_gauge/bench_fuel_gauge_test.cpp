@@ -0,0 +1,50 @@
+#include <unity.h>
+
+#include <cstdio>
+
+#include "fuel_gauge_sim.h"
+
+void setUp(void) {}
+
+void runScenario(const char* name, const FuelGaugeSimConfig& config) {
+  const FuelGaugeSimReport report = runFuelGaugeSim(config);
+  printFuelGaugeSimReport(name, report);
+  TEST_ASSERT_EQUAL(2 * config.cycles, report.sessions);
+}
+
+void benchMatchedPack() { runScenario("matched", FuelGaugeSimConfig{}); }
+
+void benchAgingPack() {
+  FuelGaugeSimConfig config;
+  // Down to about 80% over the run.
+  config.pack.fade_per_cycle = 0.0005;
+  runScenario("aging", config);
+}
+
+void benchNoisySensors() {
+  FuelGaugeSimConfig config;
+  config.pack.voltage_noise_millivolts = 10;
+  config.pack.current_noise_milliamps = 300;
+  runScenario("noisy", config);
+}
+
+void benchOtherChemistry() {
+  FuelGaugeSimConfig config;
+  config.pack.ocv_offset_millivolts = -40;
+  config.pack.series_milliohms = 30;
+  runScenario("mismatched", config);
+}
+
+void benchCpuCost() { printFuelGaugeCost(measureFuelGaugeCost(PackParams{})); }
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(benchMatchedPack);
+  RUN_TEST(benchAgingPack);
+  RUN_TEST(benchNoisySensors);
+  RUN_TEST(benchOtherChemistry);
+  RUN_TEST(benchCpuCost);
+  UNITY_END();
+
+  return 0;
+}
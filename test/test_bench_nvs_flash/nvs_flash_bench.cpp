@@ -0,0 +1,48 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+
+#include "nvs_sim.h"
+
+void setUp(void) {}
+
+void benchSettingsWear() {
+  NvsSimConfig config;
+  config.saves = 1000000;
+  const NvsSimReport report = runNvsSim(config);
+  printNvsSimReport("settings, 4 sectors", report);
+  TEST_ASSERT_TRUE(report.restart_ok);
+}
+
+void benchTwoSectors() {
+  NvsSimConfig config;
+  config.sector_count = 2;
+  config.saves = 1000000;
+  const NvsSimReport report = runNvsSim(config);
+  printNvsSimReport("settings, 2 sectors", report);
+  TEST_ASSERT_TRUE(report.restart_ok);
+}
+
+void benchPowerCuts() {
+  NvsSimConfig config;
+  config.saves = 400;
+  const auto start = std::chrono::steady_clock::now();
+  const NvsPowerCutReport report = checkPowerCuts(config);
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  printNvsPowerCutReport("4 KB sectors, every step", report);
+  printf("%.1f s\n", seconds);
+  TEST_ASSERT_EQUAL(report.cut_points, report.writable);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(benchSettingsWear);
+  RUN_TEST(benchTwoSectors);
+  RUN_TEST(benchPowerCuts);
+  UNITY_END();
+
+  return 0;
+}
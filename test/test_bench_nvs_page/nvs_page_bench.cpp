@@ -0,0 +1,97 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "page.h"
+#include "workload.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr int REPETITIONS = 2000;
+
+void setUp(void) {}
+
+// A settings page after a lot of saves: the keys once with their names,
+// then updates to a few counters that change all the time.
+std::vector<uint8_t> settingsLog() {
+  std::vector<uint8_t> page(PAGE_SIZE, 0xFF);
+  nvs_record::encodePageStart({nvs_record::PAGE_VERSION, 1, 1}, page.data());
+  size_t offset = nvs_record::PAGE_DATA_START;
+  const char* const names[] = {"quick_power_cycle_count", "ap_name",
+                               "ap_password", "graceful_shutdown_count",
+                               "wifi_power", "is_locked", "locking_enabled",
+                               "top_soc", "bottom_soc"};
+  constexpr int32_t KEYS = sizeof(names) / sizeof(names[0]);
+  WorkloadRng rng(1);
+  uint8_t record[nvs_record::MAX_RECORD_SIZE];
+  for (uint32_t i = 0;; i++) {
+    nvs_record::ValueUpdate update = {};
+    update.id = i < KEYS ? i : rng.below(KEYS);
+    if (i < KEYS) {
+      update.name = names[i];
+      update.name_length = strlen(names[i]);
+    }
+    if (update.id == 1 || update.id == 2) {
+      update.type = nvs_record::BYTES;
+      update.bytes = (const uint8_t*)"some wifi network";
+      update.bytes_length = 17;
+    } else {
+      update.type = nvs_record::SINT64;
+      update.number = rng.below(100000);
+    }
+    const size_t size = nvs_record::encodeValueUpdate(update, record);
+    if (offset + size > PAGE_SIZE) {
+      break;
+    }
+    std::copy(record, record + size, &page[offset]);
+    offset += size;
+  }
+  return page;
+}
+
+template <class F>
+double bestNanos(F run) {
+  double best = 1e30;
+  for (int r = 0; r < REPETITIONS; r++) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(end - start).count());
+  }
+  return best * 1e9;
+}
+
+void benchLoad() {
+  const std::vector<uint8_t> log = settingsLog();
+  NVSPage page(PAGE_SIZE);
+  TEST_ASSERT_TRUE(page.load(log.data()));
+  const double kilobytes = page.dataEnd() / 1024.0;
+
+  const uint64_t allocations = allocationCount();
+  const double loadNanos = bestNanos([&]() { page.load(log.data()); });
+  TEST_ASSERT_EQUAL(allocations, allocationCount());
+  volatile uint64_t sum = 0;
+  const double decodeNanos = bestNanos([&]() {
+    nvs_record::ValueUpdate value;
+    for (size_t id = 0; id < page.idCount(); id++) {
+      page.value(id, &value);
+      sum = sum + value.number;
+    }
+  });
+  printf("%.1f KB of log, %u keys\n", kilobytes, (unsigned)page.idCount());
+  printf("load %.0f ns, %.0f ns/KB, no allocations\n", loadNanos,
+         loadNanos / kilobytes);
+  printf("decoding every value %.0f ns\n", decodeNanos);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(benchLoad);
+  UNITY_END();
+
+  return 0;
+}
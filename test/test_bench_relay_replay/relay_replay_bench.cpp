@@ -0,0 +1,71 @@
+#include <unity.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "capture_reader.h"
+#include "relay_replay.h"
+#include "workload.h"
+
+// Big enough to take a good fraction of a second per run.
+constexpr size_t WORKLOAD_SIZE = 4 * 1024 * 1024;
+
+void setUp(void) {}
+
+void benchWorkload(const Workload& workload) {
+  const ReplayResult result = RelayReplay::run(workload);
+  printReplayResult(result);
+  TEST_ASSERT_EQUAL(workload.bytes.size(), result.bytes_in);
+  // The byte path must not touch the heap.
+  TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+void benchCleanTraffic() {
+  benchWorkload(cleanTrafficWorkload(WORKLOAD_SIZE));
+}
+
+void benchHeavyGarbage() {
+  benchWorkload(heavyGarbageWorkload(WORKLOAD_SIZE));
+}
+
+void benchCrcFailures() { benchWorkload(crcFailureWorkload(WORKLOAD_SIZE)); }
+
+void benchReplayIdle() {
+  const Workload workload = replayIdleWorkload(100);
+  const ReplayResult result = RelayReplay::run(workload);
+  printReplayResult(result);
+  TEST_ASSERT_GREATER_THAN(0, result.replayed_bytes);
+  TEST_ASSERT_EQUAL(0, result.allocations);
+}
+
+void benchPerPacketType() {
+  for (const auto& packet : PINT_PACKETS) {
+    benchWorkload(singlePacketWorkload(packet, WORKLOAD_SIZE / 4));
+  }
+}
+
+// Downloaded from /capture on the board, set OWIE_CAPTURE to its path.
+void benchCapture() {
+  const char* path = getenv("OWIE_CAPTURE");
+  if (path == nullptr) {
+    TEST_IGNORE_MESSAGE("OWIE_CAPTURE not set");
+  }
+  Capture capture;
+  TEST_ASSERT_TRUE_MESSAGE(readCaptureFile(path, &capture),
+                           "Not a capture file");
+  benchWorkload(workloadFromCapture(capture, "capture"));
+}
+
+int main(int argc, char** argv) {
+  printReplayResultHeader();
+  UNITY_BEGIN();
+  RUN_TEST(benchCleanTraffic);
+  RUN_TEST(benchHeavyGarbage);
+  RUN_TEST(benchCrcFailures);
+  RUN_TEST(benchReplayIdle);
+  RUN_TEST(benchPerPacketType);
+  RUN_TEST(benchCapture);
+  UNITY_END();
+
+  return 0;
+}
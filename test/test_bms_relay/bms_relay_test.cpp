@@ -1,4 +1,5 @@
 #include "bms_relay.h"
+#include "bms_relay_core.h"
 
 #include <unity.h>
 
@@ -12,6 +13,12 @@ std::unique_ptr<BmsRelay> relay;
 std::deque<int> mockBmsData;
 std::vector<uint8_t> mockDataOut;
 unsigned long timeMillis = 0;
+unsigned long timeMicros = 0;
+std::vector<uint8_t> receivedPacket;
+
+void recordReceivedPacket(BmsRelay*, Packet* p) {
+  receivedPacket.assign(p->start(), p->start() + p->len());
+}
 
 void setUp(void) {
   relay.reset(new BmsRelay(
@@ -30,6 +37,7 @@ void setUp(void) {
       [&]() { return timeMillis; }));
   mockBmsData.clear();
   mockDataOut.clear();
+  receivedPacket.clear();
 }
 
 void addMockData(const std::vector<uint8_t>& data) {
@@ -94,10 +102,9 @@ void testPacketLengths() {
       {0xff, 0x55, 0xaa, 0x10, 0x03, 0x03, 0x0b, 0x03, 0x03, 0x03, 0x03, 0x03,
        0x03, 0x03, 0x02, 0x34},
       {0xff, 0x55, 0xaa, 0x11, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0f}};
-  std::vector<uint8_t> receivedPacket;
-  relay->addReceivedPacketCallback([&](BmsRelay*, Packet* p) {
+  relay->addReceivedPacketCallback([](BmsRelay*, Packet* p) {
     TEST_ASSERT_TRUE(p->isValid());
-    receivedPacket = std::vector<uint8_t>(p->start(), p->start() + p->len());
+    recordReceivedPacket(nullptr, p);
   });
   for (const auto& packet : packets) {
     addMockData(packet);
@@ -111,11 +118,7 @@ void testPacketLengths() {
 void testPacketCallback() {
   addMockData({0x1, 0x2, 0x3, 0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2,
                0xE, 0xFF, 0x55, 0xAA});
-  std::vector<uint8_t> receivedPacket;
-  relay->addReceivedPacketCallback([&](BmsRelay*, Packet* p) {
-    const uint8_t* start = p->start();
-    receivedPacket.assign(start, start + p->len());
-  });
+  relay->addReceivedPacketCallback(recordReceivedPacket);
   relay->loop();
   std::vector<uint8_t> expected(
       {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE});
@@ -191,11 +194,381 @@ void testPacketReplay() {
   expectDataOut({});
 
   // Rewind time to far future to trigger both slow and fast packet
-  // replay.
+  // replay. They go out one at a time, status first.
   timeMillis = 10000;
   relay->loop();
-  expectDataOut({0xff, 0x55, 0xaa, 0x0, 0x21, 0x2, 0x1F, 0xff, 0x55, 0xaa, 0x08,
-                 0x06, 0x02, 0x0c});
+  expectDataOut({0xff, 0x55, 0xaa, 0x0, 0x21, 0x2, 0x1F});
+  timeMillis = 10000 + TxScheduler::REPLAY_SPACING_MILLIS - 1;
+  relay->loop();
+  expectDataOut({});
+  timeMillis = 10000 + TxScheduler::REPLAY_SPACING_MILLIS;
+  relay->loop();
+  expectDataOut({0xff, 0x55, 0xaa, 0x08, 0x06, 0x02, 0x0c});
+}
+
+void testReplayWaitsForPacketBoundary() {
+  relay->setCutThroughForwarding(true);
+  timeMillis = 0;
+  addMockData({0xff, 0x55, 0xaa, 0x0, 0x21, 0x2, 0x1F});
+  relay->loop();
+  expectDataOut({0xff, 0x55, 0xaa, 0x0, 0x21, 0x2, 0x1F});
+  // Half of a temperature packet went out when the status replay is due.
+  timeMillis = 600;
+  addMockData({0xff, 0x55, 0xaa, 0x04, 0x16, 0x17});
+  relay->loop();
+  expectDataOut({0xff, 0x55, 0xaa, 0x04, 0x16, 0x17});
+  timeMillis = 605;
+  relay->loop();
+  expectDataOut({});
+  timeMillis = 606;
+  addMockData({0x17, 0x17, 0x18, 0x02, 0x75});
+  relay->loop();
+  expectDataOut({0x17, 0x17, 0x18, 0x02, 0x75});
+  // And then for the line to be quiet for a bit.
+  timeMillis = 606 + TxScheduler::MIN_QUIET_MILLIS;
+  relay->loop();
+  expectDataOut({0xff, 0x55, 0xaa, 0x0, 0x21, 0x2, 0x1F});
+}
+
+void testCutThroughForwarding() {
+  relay->setCutThroughForwarding(true);
+  relay->addReceivedPacketCallback(recordReceivedPacket);
+  // Temperature packet streams through as soon as its type is known.
+  addMockData({0xff, 0x55, 0xaa});
+  relay->loop();
+  expectDataOut({});
+  addMockData({0x04, 0x16, 0x17});
+  relay->loop();
+  expectDataOut({0xff, 0x55, 0xaa, 0x04, 0x16, 0x17});
+  addMockData({0x17, 0x17, 0x18, 0x02});
+  relay->loop();
+  expectDataOut({0x17, 0x17, 0x18, 0x02});
+  TEST_ASSERT_TRUE(receivedPacket.empty());
+  addMockData({0x75});
+  relay->loop();
+  expectDataOut({0x75});
+  std::vector<uint8_t> expected(
+      {0xff, 0x55, 0xaa, 0x04, 0x16, 0x17, 0x17, 0x17, 0x18, 0x02, 0x75});
+  TEST_ASSERT_EQUAL(expected.size(), receivedPacket.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(&expected[0], &receivedPacket[0],
+                                expected.size());
+
+  // Serial gets rewritten so it has to be held until complete.
+  relay->setBMSSerialOverride(0x8040201);
+  addMockData({0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3});
+  relay->loop();
+  expectDataOut({});
+  addMockData({0x4, 0x2, 0xE});
+  relay->loop();
+  expectDataOut({0xFF, 0x55, 0xAA, 0x6, 0x8, 0x4, 0x2, 0x1, 0x2, 0x13});
+}
+
+void testForwardingLatencyTracking() {
+  relay->setMicrosProvider([]() { return timeMicros; });
+  relay->setCutThroughForwarding(true);
+  timeMicros = 1000;
+  addMockData({0xff, 0x55});
+  relay->loop();
+  timeMicros = 1200;
+  addMockData({0xaa, 0x04, 0x16, 0x17, 0x17, 0x17, 0x18});
+  relay->loop();
+  timeMicros = 1900;
+  addMockData({0x02, 0x75});
+  relay->loop();
+  // Cut through, first byte went out once the type was known.
+  const IndividualPacketStat& temperatureStat =
+      relay->getPacketTracker().getIndividualPacketStats()[4];
+  TEST_ASSERT_EQUAL(1, temperatureStat.forwarding_latency_samples);
+  TEST_ASSERT_EQUAL(200, temperatureStat.avg_forwarding_latency_micros);
+  TEST_ASSERT_EQUAL(200, temperatureStat.max_forwarding_latency_micros);
+
+  // SOC packet is store and forward.
+  timeMicros = 3000;
+  addMockData({0xFF, 0x55, 0xAA, 0x3});
+  relay->loop();
+  timeMicros = 3600;
+  addMockData({0x2B, 0x02, 0x2C});
+  relay->loop();
+  const IndividualPacketStat& socStat =
+      relay->getPacketTracker().getIndividualPacketStats()[3];
+  TEST_ASSERT_EQUAL(1, socStat.forwarding_latency_samples);
+  TEST_ASSERT_EQUAL(600, socStat.avg_forwarding_latency_micros);
+}
+
+void testRelayLatencyHistogram() {
+  relay->setMicrosProvider([]() { return timeMicros; });
+  relay->setCutThroughForwarding(true);
+  // Cut through, latency runs until the last byte went out.
+  timeMicros = 1000;
+  addMockData({0xff, 0x55, 0xaa, 0x04, 0x16, 0x17});
+  relay->loop();
+  timeMicros = 1900;
+  addMockData({0x17, 0x17, 0x18, 0x02, 0x75});
+  relay->loop();
+  // Store and forward.
+  timeMicros = 3000;
+  addMockData({0xFF, 0x55, 0xAA, 0x3});
+  relay->loop();
+  timeMicros = 3003;
+  addMockData({0x2B, 0x02, 0x2C});
+  relay->loop();
+  // Swallowed, never reaches the MB.
+  addMockData({0xff, 0x55, 0xaa, 0x0, 0x0, 0x1, 0xFE});
+  relay->loop();
+
+  const auto& stats = relay->getPacketTracker().getIndividualPacketStats();
+  TEST_ASSERT_EQUAL(1, stats[4].relay_latency_micros.total());
+  TEST_ASSERT_EQUAL(1, stats[4].relay_latency_micros.count(
+                           LogHistogram<16>::bucketFor(900)));
+  TEST_ASSERT_EQUAL(1, stats[3].relay_latency_micros.total());
+  TEST_ASSERT_EQUAL(1, stats[3].relay_latency_micros.count(2));
+  TEST_ASSERT_EQUAL(0, stats[0].relay_latency_micros.total());
+}
+
+void testResyncKeepsPreambleStartAfterMismatch() {
+  relay->addReceivedPacketCallback(recordReceivedPacket);
+  addMockData({0xFF, 0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  relay->loop();
+  std::vector<uint8_t> expected({0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  TEST_ASSERT_EQUAL(expected.size(), receivedPacket.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(&expected[0], &receivedPacket[0],
+                                expected.size());
+  TEST_ASSERT_EQUAL(43, relay->getBmsReportedSOC());
+  const GlobalStats& stats = relay->getPacketTracker().getGlobalStats();
+  TEST_ASSERT_EQUAL(1, stats.total_unknown_bytes_received);
+  TEST_ASSERT_EQUAL(1, stats.total_packets_recovered_by_resync);
+  TEST_ASSERT_EQUAL(0, stats.total_partial_packets_discarded);
+}
+
+void testResyncAfterInvalidPacketType() {
+  // 0xFF is not a valid type but could be the start of the next packet.
+  addMockData({0xFF, 0x55, 0xAA, 0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  relay->loop();
+  TEST_ASSERT_EQUAL(43, relay->getBmsReportedSOC());
+  const GlobalStats& stats = relay->getPacketTracker().getGlobalStats();
+  TEST_ASSERT_EQUAL(3, stats.total_unknown_bytes_received);
+  TEST_ASSERT_EQUAL(1, stats.total_packets_recovered_by_resync);
+  TEST_ASSERT_EQUAL(1, stats.total_partial_packets_discarded);
+  TEST_ASSERT_EQUAL(1, stats.total_known_packets_received);
+}
+
+void testGarbageRunsAreForwardedUnchanged() {
+  std::vector<uint8_t> garbage;
+  for (int i = 0; i < 200; i++) {
+    garbage.push_back(i % 3 == 0 ? 0xFF : (i & 0x3F));
+  }
+  garbage.push_back(0xFF);
+  garbage.push_back(0x55);
+  garbage.push_back(0x1);
+  addMockData(garbage);
+  relay->loop();
+  expectDataOut(garbage);
+  const GlobalStats& stats = relay->getPacketTracker().getGlobalStats();
+  TEST_ASSERT_EQUAL(garbage.size(), stats.total_unknown_bytes_received);
+  TEST_ASSERT_EQUAL(0, stats.total_packets_recovered_by_resync);
+  TEST_ASSERT_EQUAL(1, stats.total_partial_packets_discarded);
+  TEST_ASSERT_EQUAL(0, stats.total_known_packets_received);
+}
+
+void testPacketCallbackLimit() {
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(relay->addForwardedPacketCallback(recordReceivedPacket));
+  }
+  TEST_ASSERT_FALSE(relay->addForwardedPacketCallback(recordReceivedPacket));
+  addMockData({0xff, 0x55, 0xaa, 0x08, 0x06, 0x02, 0x0c});
+  relay->loop();
+  TEST_ASSERT_EQUAL(7, receivedPacket.size());
+}
+
+void testReplayKeepsReportedSoc() {
+  timeMillis = 0;
+  addMockData({0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  relay->loop();
+  expectDataOut({0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+  for (timeMillis = 3000; timeMillis <= 9000; timeMillis += 3000) {
+    relay->loop();
+    expectDataOut({0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+    TEST_ASSERT_EQUAL(43, relay->getBmsReportedSOC());
+  }
+  // Replays aren't counted as received.
+  TEST_ASSERT_EQUAL(1, relay->getPacketTracker()
+                           .getGlobalStats()
+                           .total_known_packets_received);
+}
+
+int changedPackets = 0;
+
+void testChangedPacketCallbacks() {
+  changedPackets = 0;
+  relay->addChangedPacketCallback(
+      [](BmsRelay*, Packet* p) { changedPackets++; });
+  const std::vector<uint8_t> temperature(
+      {0xff, 0x55, 0xaa, 0x04, 0x16, 0x17, 0x17, 0x17, 0x18, 0x02, 0x75});
+  const std::vector<uint8_t> status({0xff, 0x55, 0xaa, 0x0, 0x0, 0x1, 0xFE});
+  for (int i = 0; i < 3; i++) {
+    addMockData(temperature);
+    addMockData(status);
+    relay->loop();
+    // Unchanged packets are forwarded and filtered all the same.
+    expectDataOut(temperature);
+  }
+  TEST_ASSERT_EQUAL(2, changedPackets);
+  TEST_ASSERT_EQUAL(
+      2, relay->getPacketTracker().getIndividualPacketStats()[4].unchanged_num);
+
+  // A different reading is decoded again.
+  addMockData(
+      {0xff, 0x55, 0xaa, 0x04, 0x20, 0x20, 0x20, 0x20, 0x20, 0x02, 0xA2});
+  relay->loop();
+  TEST_ASSERT_EQUAL(3, changedPackets);
+  TEST_ASSERT_EQUAL(32, relay->getAverageTemperatureCelsius());
+}
+
+void testReplayKeepsStoredPacketUnchanged() {
+  changedPackets = 0;
+  relay->addChangedPacketCallback(
+      [](BmsRelay*, Packet* p) { changedPackets++; });
+  const std::vector<uint8_t> soc({0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  timeMillis = 0;
+  addMockData(soc);
+  relay->loop();
+  expectDataOut({0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+  // The replay rewrites its SOC byte, not the one the tracker compares to.
+  timeMillis = 3000;
+  relay->loop();
+  expectDataOut({0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+  addMockData(soc);
+  relay->loop();
+  expectDataOut({0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+  TEST_ASSERT_EQUAL(1, changedPackets);
+  TEST_ASSERT_EQUAL(
+      1, relay->getPacketTracker().getIndividualPacketStats()[3].unchanged_num);
+}
+
+struct MockSource {
+  size_t operator()(uint8_t* buffer, size_t maxLen) const {
+    size_t len = 0;
+    while (len < maxLen && !mockBmsData.empty()) {
+      buffer[len++] = mockBmsData.front();
+      mockBmsData.pop_front();
+    }
+    return len;
+  }
+};
+
+struct MockSink {
+  void operator()(const uint8_t* data, size_t len) const {
+    mockDataOut.insert(mockDataOut.end(), data, data + len);
+  }
+};
+
+struct MockClock {
+  unsigned long millis() const { return timeMillis; }
+  unsigned long micros() const { return timeMicros; }
+  bool hasMicros() const { return true; }
+};
+
+void testCompileTimePolicies() {
+  BmsRelayCore<MockSource, MockSink, MockClock> core(MockSource{}, MockSink{},
+                                                     MockClock{});
+  // Driven through the base class like the firmware's callbacks see it.
+  BmsRelay* base = &core;
+  base->setCutThroughForwarding(true);
+  timeMillis = 0;
+  timeMicros = 1000;
+  addMockData({0x1, 0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  addMockData({0xff, 0x55, 0xaa, 0x04, 0x16, 0x17});
+  base->loop();
+  expectDataOut({0x1, 0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1, 0xff, 0x55, 0xaa,
+                 0x04, 0x16, 0x17});
+  timeMicros = 1300;
+  addMockData({0x17, 0x17, 0x18, 0x02, 0x75});
+  base->loop();
+  expectDataOut({0x17, 0x17, 0x18, 0x02, 0x75});
+  TEST_ASSERT_EQUAL(43, base->getBmsReportedSOC());
+  TEST_ASSERT_EQUAL(23, base->getAverageTemperatureCelsius());
+  TEST_ASSERT_EQUAL(1, base->getPacketTracker()
+                           .getIndividualPacketStats()[4]
+                           .forwarding_latency_samples);
+
+  timeMillis = 3000;
+  base->loop();
+  expectDataOut({0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+  timeMillis = 3000 + TxScheduler::REPLAY_SPACING_MILLIS;
+  base->loop();
+  expectDataOut({0xff, 0x55, 0xaa, 0x04, 0x16, 0x17, 0x17, 0x17, 0x18, 0x02,
+                 0x75});
+}
+
+unsigned long rxMicros = 0;
+uint32_t rxDropped = 0;
+
+// Like a receiver that buffers bytes from an interrupt handler.
+struct TimestampingMockSource : MockSource {
+  unsigned long receivedMicros() const { return rxMicros; }
+  uint32_t takeDroppedBytes() const {
+    const uint32_t dropped = rxDropped;
+    rxDropped = 0;
+    return dropped;
+  }
+};
+
+void testSourceReceiveTimesAndDrops() {
+  BmsRelayCore<TimestampingMockSource, MockSink, MockClock> core(
+      TimestampingMockSource{}, MockSink{}, MockClock{});
+  timeMicros = 5000;
+  // Bytes sat in the receive buffer for 800us before loop() got to them.
+  rxMicros = 4200;
+  rxDropped = 3;
+  addMockData({0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  core.loop();
+  const auto& socStat = core.getPacketTracker().getIndividualPacketStats()[3];
+  TEST_ASSERT_EQUAL(800, socStat.avg_forwarding_latency_micros);
+  TEST_ASSERT_EQUAL(3, core.getPacketTracker()
+                           .getGlobalStats()
+                           .total_rx_bytes_dropped);
+  // Only counted once.
+  core.loop();
+  TEST_ASSERT_EQUAL(3, core.getPacketTracker()
+                           .getGlobalStats()
+                           .total_rx_bytes_dropped);
+}
+
+void testBusUtilizationCounters() {
+  relay->setMicrosProvider([]() { return timeMicros; });
+  timeMillis = 0;
+  timeMicros = 0;
+  // Status packet gets swallowed, the unknown byte goes out as is.
+  addMockData({0xff, 0x55, 0xaa, 0x0, 0x0, 0x1, 0xFE, 0x42});
+  relay->loop();
+  timeMicros = 10000;
+  addMockData({0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  relay->loop();
+  timeMicros = 12000;
+  addMockData({0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  relay->loop();
+  // The status replay is swallowed just the same, SOC comes after it.
+  timeMillis = 3000;
+  relay->loop();
+  timeMillis = 3000 + TxScheduler::REPLAY_SPACING_MILLIS;
+  relay->loop();
+  expectDataOut({0x42, 0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1, 0xFF, 0x55, 0xAA,
+                 0x3, 0x0, 0x02, 0x1, 0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+
+  const BusCounters& total = relay->getBusUtilization().total();
+  TEST_ASSERT_EQUAL(22, total.bytes_in);
+  TEST_ASSERT_EQUAL(22, total.bytes_out);
+  TEST_ASSERT_EQUAL(7, total.replayed_bytes);
+  TEST_ASSERT_EQUAL(7, total.swallowed_bytes);
+  TEST_ASSERT_EQUAL(1, total.unknown_bytes);
+  // The first second is over by the time the replay goes out.
+  TEST_ASSERT_EQUAL(22, relay->getBusUtilization().peakSecond().bytes_in);
+  // Only between the SOC packets, the unknown byte came after the status.
+  const BusUtilization::IdleGapHistogram gaps =
+      relay->getBusUtilization().idleGapMicros();
+  TEST_ASSERT_EQUAL(1, gaps.total());
+  TEST_ASSERT_EQUAL(1, gaps.count(BusUtilization::IdleGapHistogram::bucketFor(
+                           2000 - 7 * TxScheduler::BYTE_MICROS)));
 }
 
 int main(int argc, char** argv) {
@@ -210,6 +583,20 @@ int main(int argc, char** argv) {
   RUN_TEST(testCellVoltageParsing);
   RUN_TEST(testBlocksStatusPacketsUnlessWarning);
   RUN_TEST(testPacketReplay);
+  RUN_TEST(testReplayWaitsForPacketBoundary);
+  RUN_TEST(testCutThroughForwarding);
+  RUN_TEST(testForwardingLatencyTracking);
+  RUN_TEST(testRelayLatencyHistogram);
+  RUN_TEST(testResyncKeepsPreambleStartAfterMismatch);
+  RUN_TEST(testResyncAfterInvalidPacketType);
+  RUN_TEST(testGarbageRunsAreForwardedUnchanged);
+  RUN_TEST(testPacketCallbackLimit);
+  RUN_TEST(testReplayKeepsReportedSoc);
+  RUN_TEST(testCompileTimePolicies);
+  RUN_TEST(testSourceReceiveTimesAndDrops);
+  RUN_TEST(testBusUtilizationCounters);
+  RUN_TEST(testChangedPacketCallbacks);
+  RUN_TEST(testReplayKeepsStoredPacketUnchanged);
   UNITY_END();
 
   return 0;
@@ -0,0 +1,108 @@
+#include "board_sim.h"
+
+#include <unity.h>
+
+#include "alloc_counter.h"
+#include "flash_emulator.h"
+#include "nvs.h"
+
+void setUp(void) {}
+
+void testRelayKeepsUpWithTheBms() {
+  BoardSim sim(BoardSim::Config{});
+  // Warm up, first packets and such.
+  sim.run(10 * 1000);
+  const BoardSimStats warm = sim.stats();
+  // Past the 71.6 minutes it takes micros() to wrap.
+  sim.run(2 * 3600 * 1000);
+  const BoardSimStats& stats = sim.stats();
+  const GlobalStats& global = sim.relay().getPacketTracker().getGlobalStats();
+  TEST_ASSERT_EQUAL(0, global.total_packet_checksum_mismatches);
+  TEST_ASSERT_EQUAL(0, global.total_rx_bytes_dropped);
+  TEST_ASSERT_EQUAL(0, sim.txQueue().getStats().dropped_bytes);
+  TEST_ASSERT_EQUAL(stats.packets_sent,
+                    global.total_known_packets_received);
+  TEST_ASSERT_EQUAL(stats.bytes_from_bms,
+                    sim.relay().getBusUtilization().total().bytes_in);
+  // The byte path and the task queue run without the heap once going.
+  TEST_ASSERT_EQUAL(warm.allocations, stats.allocations);
+  TEST_ASSERT_EQUAL(warm.heap_growth_bytes, stats.heap_growth_bytes);
+  // Two hours of riding.
+  TEST_ASSERT_GREATER_THAN(0, sim.relay().getUsedChargeMah());
+  // Latencies measured across the wrap stay plausible.
+  for (const auto& stat :
+       sim.relay().getPacketTracker().getIndividualPacketStats()) {
+    TEST_ASSERT_LESS_THAN(100000, stat.max_forwarding_latency_micros);
+  }
+}
+
+void testReplaysCoverSkippedPackets() {
+  BoardSim::Config config;
+  config.skip_per_mille = 300;
+  BoardSim sim(config);
+  sim.run(600 * 1000);
+  TEST_ASSERT_GREATER_THAN(0, sim.stats().packets_skipped);
+  TEST_ASSERT_GREATER_THAN(0,
+                           sim.relay().getBusUtilization().total().replayed_bytes);
+}
+
+void testOneShotTasksRunOnBoardTime() {
+  BoardSim sim(BoardSim::Config{});
+  unsigned long ranAt = 0;
+  sim.taskQueue().postOneShotTask([&]() { ranAt = sim.millis(); }, 5000);
+  sim.run(4999);
+  TEST_ASSERT_EQUAL(0, ranAt);
+  sim.run(10);
+  // TaskQueueType runs tasks once their time has passed.
+  TEST_ASSERT_EQUAL(5001, ranAt);
+}
+
+void testSettingsSavedToFlash() {
+  BoardSim::Config config;
+  config.settings_save_millis = 60 * 1000;
+  BoardSim sim(config);
+  sim.run(3600 * 1000);
+  const BoardSimStats& stats = sim.stats();
+  // Two quick power cycle count writes and one a minute.
+  TEST_ASSERT_EQUAL(2 + 60, stats.settings_saves);
+  TEST_ASSERT_EQUAL(0, stats.failed_settings_saves);
+  TEST_ASSERT_EQUAL(0, sim.flash().stats().violations);
+
+  // Comes back after a restart with the last saved state.
+  FlashEmulator flash = sim.flash();
+  NonVolatileStorage restarted(&flash, flash.sectorSize(),
+                               flash.sectorCount());
+  TEST_ASSERT_TRUE(restarted.begin());
+  uint64_t count;
+  TEST_ASSERT_TRUE(restarted.getUint64("quick_power_cycle_count", &count));
+  TEST_ASSERT_EQUAL(0, count);
+  int64_t saved;
+  TEST_ASSERT_TRUE(restarted.getInt64("current_milliamp_seconds", &saved));
+  int64_t expected;
+  TEST_ASSERT_TRUE(sim.storage().getInt64("current_milliamp_seconds",
+                                          &expected));
+  TEST_ASSERT_EQUAL(expected, saved);
+}
+
+// Keeps the compiler from leaving out the allocation.
+int* volatile allocated;
+
+void testHeapTracking() {
+  const uint64_t before = heapBytesInUse();
+  resetHeapPeak();
+  int* p = allocated = new int[1000];
+  TEST_ASSERT_EQUAL(before + 1000 * sizeof(int), heapBytesInUse());
+  delete[] p;
+  TEST_ASSERT_EQUAL(before, heapBytesInUse());
+  TEST_ASSERT_EQUAL(before + 1000 * sizeof(int), heapBytesPeak());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testRelayKeepsUpWithTheBms);
+  RUN_TEST(testReplaysCoverSkippedPackets);
+  RUN_TEST(testOneShotTasksRunOnBoardTime);
+  RUN_TEST(testSettingsSavedToFlash);
+  RUN_TEST(testHeapTracking);
+  return UNITY_END();
+}
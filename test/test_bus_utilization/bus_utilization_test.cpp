@@ -0,0 +1,69 @@
+#include "bus_utilization.h"
+
+#include <unity.h>
+
+#include <memory>
+
+std::unique_ptr<BusUtilization> bus;
+
+void setUp(void) { bus.reset(new BusUtilization()); }
+
+void testCountsRollOverEverySecond() {
+  bus->update(0);
+  bus->bytesIn(100);
+  bus->bytesOut(90);
+  bus->update(999);
+  bus->swallowedBytes(10);
+  TEST_ASSERT_EQUAL(0, bus->lastSecond().bytes_in);
+  bus->update(1000);
+  TEST_ASSERT_EQUAL(100, bus->lastSecond().bytes_in);
+  TEST_ASSERT_EQUAL(90, bus->lastSecond().bytes_out);
+  TEST_ASSERT_EQUAL(10, bus->lastSecond().swallowed_bytes);
+  bus->bytesIn(50);
+  bus->replayedBytes(7);
+  bus->unknownBytes(3);
+  bus->update(2500);
+  TEST_ASSERT_EQUAL(50, bus->lastSecond().bytes_in);
+  TEST_ASSERT_EQUAL(7, bus->lastSecond().replayed_bytes);
+  TEST_ASSERT_EQUAL(3, bus->lastSecond().unknown_bytes);
+  TEST_ASSERT_EQUAL(150, bus->total().bytes_in);
+  TEST_ASSERT_EQUAL(100, bus->peakSecond().bytes_in);
+  TEST_ASSERT_EQUAL(7, bus->peakSecond().replayed_bytes);
+}
+
+void testQuietSecondsCountAsZero() {
+  bus->update(0);
+  bus->bytesIn(100);
+  // The second ending at 2000 had nothing.
+  bus->update(2100);
+  TEST_ASSERT_EQUAL(0, bus->lastSecond().bytes_in);
+  TEST_ASSERT_EQUAL(100, bus->peakSecond().bytes_in);
+}
+
+void testIdleGapsCoverTwoWindows() {
+  const unsigned long window = BusUtilization::IDLE_GAP_WINDOW_MILLIS;
+  bus->update(0);
+  bus->idleGap(100);
+  bus->update(window);
+  bus->idleGap(3000);
+  BusUtilization::IdleGapHistogram gaps = bus->idleGapMicros();
+  TEST_ASSERT_EQUAL(2, gaps.total());
+  TEST_ASSERT_EQUAL(
+      1, gaps.count(BusUtilization::IdleGapHistogram::bucketFor(100)));
+  bus->update(2 * window);
+  gaps = bus->idleGapMicros();
+  TEST_ASSERT_EQUAL(1, gaps.total());
+  TEST_ASSERT_EQUAL(
+      1, gaps.count(BusUtilization::IdleGapHistogram::bucketFor(3000)));
+  // Skipping a window drops everything.
+  bus->update(4 * window);
+  TEST_ASSERT_EQUAL(0, bus->idleGapMicros().total());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testCountsRollOverEverySecond);
+  RUN_TEST(testQuietSecondsCountAsZero);
+  RUN_TEST(testIdleGapsCoverTwoWindows);
+  return UNITY_END();
+}
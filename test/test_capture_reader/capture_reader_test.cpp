@@ -0,0 +1,122 @@
+#include "capture_reader.h"
+
+#include <unity.h>
+
+#include <deque>
+#include <vector>
+
+#include "bms_relay.h"
+#include "capture_recorder.h"
+#include "relay_replay.h"
+
+void setUp(void) {}
+
+std::vector<uint8_t> readAll(const CaptureRecorder& recorder) {
+  std::vector<uint8_t> capture(recorder.captureSize());
+  recorder.readCapture(0, capture.data(), capture.size());
+  return capture;
+}
+
+void expectFrame(const Capture::Frame& frame, uint32_t micros, uint8_t flags,
+                 const std::vector<uint8_t>& data) {
+  TEST_ASSERT_EQUAL(micros, frame.micros);
+  TEST_ASSERT_EQUAL(flags, frame.flags);
+  TEST_ASSERT_EQUAL(data.size(), frame.data.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data.data(), frame.data.data(), data.size());
+}
+
+void testRelayTrafficRoundTrip() {
+  std::deque<uint8_t> in;
+  unsigned long millis = 0;
+  unsigned long micros = 0;
+  BmsRelay relay(
+      [&]() -> int {
+        if (in.empty()) {
+          return -1;
+        }
+        const uint8_t b = in.front();
+        in.pop_front();
+        return b;
+      },
+      [](uint8_t) {}, [&]() { return millis; });
+  relay.setMicrosProvider([&]() { return micros; });
+  CaptureRecorder recorder(1024);
+  relay.setCaptureRecorder(&recorder);
+
+  // Forwarded as is, then an unknown byte.
+  micros = 1000;
+  in.insert(in.end(), {0xff, 0x55, 0xaa, 0x08, 0x06, 0x02, 0x0c, 0x42});
+  relay.loop();
+  // Rewritten.
+  micros = 3000;
+  in.insert(in.end(), {0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  relay.loop();
+  // Swallowed.
+  micros = 5000;
+  in.insert(in.end(), {0xff, 0x55, 0xaa, 0x0, 0x0, 0x1, 0xFE});
+  relay.loop();
+  // Replayed, and swallowed again as a status packet. SOC comes after it.
+  millis = 3000;
+  micros = 3000000;
+  relay.loop();
+  millis += TxScheduler::REPLAY_SPACING_MILLIS;
+  micros += TxScheduler::REPLAY_SPACING_MILLIS * 1000;
+  relay.loop();
+
+  const std::vector<uint8_t> data = readAll(recorder);
+  Capture capture;
+  TEST_ASSERT_TRUE(parseCapture(data.data(), data.size(), &capture));
+  TEST_ASSERT_EQUAL(0, capture.lost_records);
+  TEST_ASSERT_EQUAL(6, capture.frames.size());
+  expectFrame(capture.frames[0], 1000, CAPTURE_FORWARDED,
+              {0xff, 0x55, 0xaa, 0x08, 0x06, 0x02, 0x0c});
+  expectFrame(capture.frames[1], 1000, CAPTURE_UNKNOWN_DATA | CAPTURE_FORWARDED,
+              {0x42});
+  expectFrame(capture.frames[2], 3000, 0,
+              {0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C});
+  expectFrame(capture.frames[3], 3000, CAPTURE_TO_MB | CAPTURE_MODIFIED,
+              {0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+  expectFrame(capture.frames[4], 5000, 0,
+              {0xff, 0x55, 0xaa, 0x0, 0x0, 0x1, 0xFE});
+  expectFrame(capture.frames[5], micros, CAPTURE_TO_MB | CAPTURE_REPLAYED,
+              {0xFF, 0x55, 0xAA, 0x3, 0x0, 0x02, 0x1});
+
+  // Truncated.
+  TEST_ASSERT_FALSE(parseCapture(data.data(), data.size() - 1, &capture));
+  TEST_ASSERT_FALSE(parseCapture(data.data(), 10, &capture));
+}
+
+void testWorkloadFromCapture() {
+  CaptureRecorder recorder(1024);
+  const std::vector<uint8_t> soc = {0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C};
+  const std::vector<uint8_t> rewritten = {0xFF, 0x55, 0xAA, 0x3,
+                                          0x0,  0x02, 0x1};
+  recorder.record(50000, 0, soc.data(), soc.size());
+  recorder.record(50000, CAPTURE_TO_MB | CAPTURE_MODIFIED, rewritten.data(),
+                  rewritten.size());
+  recorder.record(55000, 0, soc.data(), soc.size());
+  const std::vector<uint8_t> data = readAll(recorder);
+  Capture capture;
+  TEST_ASSERT_TRUE(parseCapture(data.data(), data.size(), &capture));
+
+  const Workload workload = workloadFromCapture(capture, "capture");
+  TEST_ASSERT_EQUAL(14, workload.bytes.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(soc.data(), workload.bytes.data(), soc.size());
+  TEST_ASSERT_EQUAL(7 * WIRE_BYTE_MICROS, workload.chunks.front().micros);
+  TEST_ASSERT_EQUAL(5000 + 7 * WIRE_BYTE_MICROS, workload.endMicros());
+  // Polls in between, the last one a millisecond before the packet.
+  TEST_ASSERT_EQUAL(0, workload.chunks[workload.chunks.size() - 2].len);
+  TEST_ASSERT_EQUAL(4000 + 7 * WIRE_BYTE_MICROS,
+                    workload.chunks[workload.chunks.size() - 2].micros);
+
+  const ReplayResult result = RelayReplay::run(workload, 1);
+  TEST_ASSERT_EQUAL(14, result.bytes_in);
+  TEST_ASSERT_EQUAL(2, result.packets);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testRelayTrafficRoundTrip);
+  RUN_TEST(testWorkloadFromCapture);
+  return UNITY_END();
+}
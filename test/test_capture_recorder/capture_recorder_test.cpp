@@ -0,0 +1,95 @@
+#include "capture_recorder.h"
+
+#include <unity.h>
+
+#include <vector>
+
+void setUp(void) {}
+
+std::vector<uint8_t> readAll(const CaptureRecorder& recorder,
+                             size_t pieceSize = 1000) {
+  std::vector<uint8_t> capture(recorder.captureSize());
+  size_t offset = 0;
+  while (size_t len = recorder.readCapture(offset, &capture[offset],
+                                           pieceSize)) {
+    offset += len;
+  }
+  TEST_ASSERT_EQUAL(capture.size(), offset);
+  return capture;
+}
+
+void testRecordsFollowTheHeader() {
+  CaptureRecorder recorder(64);
+  const uint8_t packet[] = {0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C};
+  recorder.record(1000, 0, packet, sizeof(packet));
+  recorder.addFlagsToLast(CAPTURE_FORWARDED);
+  TEST_ASSERT_TRUE(recorder.lastRecordMatches(packet, sizeof(packet)));
+  TEST_ASSERT_FALSE(recorder.lastRecordMatches(packet, 3));
+  const uint8_t garbage[] = {0x42};
+  // 300us later, a two byte varint.
+  recorder.record(1300, CAPTURE_UNKNOWN_DATA, garbage, 1);
+
+  const std::vector<uint8_t> expected = {
+      'O', 'W', 'C', 'P', 1, 0, 0, 0,
+      // Start micros, lost records.
+      0xE8, 0x03, 0, 0, 0, 0, 0, 0,
+      CAPTURE_FORWARDED, 0, 7, 0xFF, 0x55, 0xAA, 0x3, 0x2B, 0x02, 0x2C,
+      CAPTURE_UNKNOWN_DATA, 0xAC, 0x02, 1, 0x42};
+  TEST_ASSERT_EQUAL(expected.size(), recorder.captureSize());
+  const std::vector<uint8_t> capture = readAll(recorder, 3);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), capture.data(),
+                                expected.size());
+  uint8_t b;
+  TEST_ASSERT_EQUAL(0, recorder.readCapture(capture.size(), &b, 1));
+}
+
+void testOldestRecordsMakeRoom() {
+  CaptureRecorder recorder(20);
+  const uint8_t data[] = {1, 2, 3, 4, 5, 6};
+  // 9 bytes per record, room for two.
+  for (uint32_t i = 0; i < 5; i++) {
+    recorder.record(100 * (i + 1), i, data, sizeof(data));
+  }
+  TEST_ASSERT_EQUAL(CaptureRecorder::CAPTURE_HEADER_SIZE + 18,
+                    recorder.captureSize());
+  const std::vector<uint8_t> capture = readAll(recorder);
+  // Relative to the last record that's gone.
+  TEST_ASSERT_EQUAL(300, capture[8] | capture[9] << 8);
+  TEST_ASSERT_EQUAL(3, capture[12]);
+  TEST_ASSERT_EQUAL(3, capture[16]);
+  TEST_ASSERT_EQUAL(100, capture[17]);
+  TEST_ASSERT_EQUAL(4, capture[25]);
+  // Across the end of the ring.
+  TEST_ASSERT_TRUE(recorder.lastRecordMatches(data, sizeof(data)));
+  recorder.addFlagsToLast(CAPTURE_TO_MB);
+  TEST_ASSERT_EQUAL(4 | CAPTURE_TO_MB, readAll(recorder)[25]);
+
+  // Doesn't fit at all.
+  const std::vector<uint8_t> big(30);
+  recorder.record(600, 0, big.data(), big.size());
+  TEST_ASSERT_EQUAL(4, readAll(recorder)[12]);
+}
+
+void testNothingIsRecordedWhilePaused() {
+  CaptureRecorder recorder(64);
+  const uint8_t data[] = {1, 2, 3};
+  recorder.record(0, 0, data, sizeof(data));
+  recorder.setPaused(true);
+  recorder.record(10, 0, data, sizeof(data));
+  const size_t size = recorder.captureSize();
+  recorder.setPaused(false);
+  recorder.record(20, 0, data, sizeof(data));
+  const std::vector<uint8_t> capture = readAll(recorder);
+  TEST_ASSERT_EQUAL(size + 6, capture.size());
+  TEST_ASSERT_EQUAL(1, capture[12]);
+  // Still relative to the previous record.
+  TEST_ASSERT_EQUAL(20, capture[size + 1]);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testRecordsFollowTheHeader);
+  RUN_TEST(testOldestRecordsMakeRoom);
+  RUN_TEST(testNothingIsRecordedWhilePaused);
+  return UNITY_END();
+}
@@ -0,0 +1,47 @@
+#include "crc8.h"
+
+#include <unity.h>
+
+#include <vector>
+
+void setUp(void) {}
+
+// xorshift32, any data will do.
+uint8_t nextRandomByte(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+void testKnownValue() {
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  TEST_ASSERT_EQUAL_HEX8(0xF4, Crc8Bitwise(check, sizeof(check)));
+  TEST_ASSERT_EQUAL_HEX8(0xF4, Crc8Table(check, sizeof(check)));
+  TEST_ASSERT_EQUAL_HEX8(0xF4, Crc8SliceBy4(check, sizeof(check)));
+  TEST_ASSERT_EQUAL_HEX8(0xF4, Crc8(check, sizeof(check)));
+  TEST_ASSERT_EQUAL(0, Crc8(check, 0));
+}
+
+void testAllVariantsMatchBitwise() {
+  uint32_t state = 1;
+  std::vector<uint8_t> data(300);
+  for (uint8_t& b : data) {
+    b = nextRandomByte(&state);
+  }
+  // Every length and start, for the tail handling of slice-by-4.
+  for (size_t start = 0; start < 4; start++) {
+    for (size_t len = 0; start + len <= data.size(); len++) {
+      const uint8_t expected = Crc8Bitwise(&data[start], len);
+      TEST_ASSERT_EQUAL_HEX8(expected, Crc8Table(&data[start], len));
+      TEST_ASSERT_EQUAL_HEX8(expected, Crc8SliceBy4(&data[start], len));
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testKnownValue);
+  RUN_TEST(testAllVariantsMatchBitwise);
+  return UNITY_END();
+}
@@ -0,0 +1,83 @@
+#include "deadline_queue.h"
+
+#include <unity.h>
+
+#include <cstdlib>
+#include <memory>
+
+std::unique_ptr<DeadlineQueue<16>> queue;
+
+void setUp(void) { queue.reset(new DeadlineQueue<16>()); }
+
+void testPopsInDeadlineOrder() {
+  queue->schedule(3, 300);
+  queue->schedule(1, 100);
+  queue->schedule(2, 200);
+  TEST_ASSERT_EQUAL(3, queue->size());
+  TEST_ASSERT_EQUAL(1, queue->top());
+  TEST_ASSERT_EQUAL(100, queue->topDeadline());
+  queue->pop();
+  TEST_ASSERT_EQUAL(2, queue->top());
+  queue->pop();
+  TEST_ASSERT_EQUAL(3, queue->top());
+  queue->pop();
+  TEST_ASSERT_TRUE(queue->empty());
+}
+
+void testRescheduleMovesExistingEntry() {
+  queue->schedule(1, 100);
+  queue->schedule(2, 200);
+  queue->schedule(1, 300);
+  TEST_ASSERT_EQUAL(2, queue->size());
+  TEST_ASSERT_EQUAL(2, queue->top());
+  queue->schedule(1, 50);
+  TEST_ASSERT_EQUAL(1, queue->top());
+  queue->cancel(1);
+  TEST_ASSERT_FALSE(queue->contains(1));
+  TEST_ASSERT_EQUAL(2, queue->top());
+}
+
+void testDeadlinesWrapAround() {
+  queue->schedule(1, 0xFFFFFFF0);
+  queue->schedule(2, 0x10);
+  TEST_ASSERT_EQUAL(1, queue->top());
+}
+
+void testRandomizedAgainstLinearScan() {
+  uint32_t deadlines[16];
+  bool queued[16] = {false};
+  srand(1234);
+  for (int i = 0; i < 10000; i++) {
+    const uint8_t id = rand() % 16;
+    if (rand() % 4 == 0) {
+      queue->cancel(id);
+      queued[id] = false;
+    } else {
+      deadlines[id] = rand() % 100000;
+      queue->schedule(id, deadlines[id]);
+      queued[id] = true;
+    }
+    uint32_t earliest = UINT32_MAX;
+    for (int j = 0; j < 16; j++) {
+      if (queued[j] && deadlines[j] < earliest) {
+        earliest = deadlines[j];
+      }
+    }
+    if (earliest == UINT32_MAX) {
+      TEST_ASSERT_TRUE(queue->empty());
+    } else {
+      TEST_ASSERT_EQUAL(earliest, queue->topDeadline());
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testPopsInDeadlineOrder);
+  RUN_TEST(testRescheduleMovesExistingEntry);
+  RUN_TEST(testDeadlinesWrapAround);
+  RUN_TEST(testRandomizedAgainstLinearScan);
+  UNITY_END();
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "filter.h"
+
+#include <unity.h>
+
+#include <cmath>
+#include <cstdlib>
+
+void setUp(void) {}
+
+// What LowPassFilter was designed for.
+struct OneHertzDesign {
+  static constexpr double CUTOFF_HZ = 0.0025;
+  static constexpr double SAMPLE_RATE_HZ = 1;
+  static constexpr int32_t MAX_INPUT = 8192;
+};
+
+void testDesignMatchesFloatCoefficients() {
+  // LowPassFilter's coefficients times 2^30.
+  constexpr BiquadQ30 q = FixedLowPassFilter<OneHertzDesign>::COEFFICIENTS;
+  TEST_ASSERT_INT_WITHIN(1, 65504, q.b);
+  TEST_ASSERT_INT_WITHIN(4, -1050152259, q.a0);
+  TEST_ASSERT_INT_WITHIN(1, 2123632067, q.a1);
+  // Exact DC gain.
+  TEST_ASSERT_EQUAL(BiquadQ30::ONE, 4 * (int64_t)q.b + q.a0 + q.a1);
+}
+
+void testStepResponseMatchesFloat() {
+  LowPassFilter reference;
+  FixedLowPassFilter<OneHertzDesign> filter;
+  reference.step(3400);
+  filter.step(3400);
+  TEST_ASSERT_EQUAL(3400, filter.get());
+  for (int i = 0; i < 4000; i++) {
+    reference.step(3908);
+    filter.step(3908);
+    TEST_ASSERT_FLOAT_WITHIN(1, reference.get(), filter.get());
+  }
+  // Settles exactly, no dead band short of the target.
+  for (int i = 0; i < 4000; i++) {
+    filter.step(3908);
+  }
+  TEST_ASSERT_EQUAL(3908, filter.get());
+}
+
+void testNoisyInputMatchesFloat() {
+  LowPassFilter reference;
+  FixedLowPassFilter<OneHertzDesign> filter;
+  srand(42);
+  for (int i = 0; i < 20000; i++) {
+    const int32_t x = 3000 + (i / 2000) * 100 + rand() % 41 - 20;
+    reference.step(x);
+    filter.step(x);
+    TEST_ASSERT_FLOAT_WITHIN(1, reference.get(), filter.get());
+  }
+}
+
+void testFullScaleInputs() {
+  FixedLowPassFilter<OneHertzDesign> filter;
+  // Worst case for overshoot, swinging between the extremes.
+  for (int i = 0; i < 20000; i++) {
+    filter.step((i / 200) % 2 ? 8192 : -8192);
+    TEST_ASSERT_TRUE(std::abs(filter.get()) <= 8192 * 2);
+  }
+}
+
+void testAdaptiveFollowsRealTime() {
+  typedef AdaptiveLowPassFilter<OneHertzDesign, 16, 125, 24> Adaptive;
+  // At the design rate it's the same filter.
+  TEST_ASSERT_EQUAL(FixedLowPassFilter<OneHertzDesign>::COEFFICIENTS.b,
+                    Adaptive::COEFFICIENTS[7].b);
+  Adaptive everySecond;
+  Adaptive everyQuarterSecond;
+  FixedLowPassFilter<OneHertzDesign> fixed;
+  everySecond.step(3400, 0);
+  everyQuarterSecond.step(3400, 0);
+  fixed.step(3400);
+  for (uint32_t millis = 250; millis <= 600000; millis += 250) {
+    everyQuarterSecond.step(3908, millis);
+    if (millis % 1000 == 0) {
+      everySecond.step(3908, millis);
+      fixed.step(3908);
+      TEST_ASSERT_EQUAL(fixed.get(), everySecond.get());
+      // Same cutoff in real time, 4 times the samples.
+      TEST_ASSERT_INT_WITHIN(2, everySecond.get(), everyQuarterSecond.get());
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testDesignMatchesFloatCoefficients);
+  RUN_TEST(testStepResponseMatchesFloat);
+  RUN_TEST(testNoisyInputMatchesFloat);
+  RUN_TEST(testFullScaleInputs);
+  RUN_TEST(testAdaptiveFollowsRealTime);
+  return UNITY_END();
+}
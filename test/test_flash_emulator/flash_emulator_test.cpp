@@ -0,0 +1,63 @@
+#include "flash_emulator.h"
+
+#include <unity.h>
+
+void setUp(void) {}
+
+void testProgrammingOnlyClearsBits() {
+  FlashEmulator flash(4096, 2);
+  const uint8_t first[] = {0xF0, 0x0F};
+  TEST_ASSERT_TRUE(flash.program(4096, first, 2));
+  // 0xFF leaves a byte alone, clearing more bits is fine.
+  const uint8_t more[] = {0xFF, 0x01};
+  TEST_ASSERT_TRUE(flash.program(4096, more, 2));
+  uint8_t read[2];
+  TEST_ASSERT_TRUE(flash.read(4096, read, 2));
+  TEST_ASSERT_EQUAL_HEX8(0xF0, read[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, read[1]);
+  // Setting a bit needs an erase.
+  const uint8_t back[] = {0xF1};
+  TEST_ASSERT_FALSE(flash.program(4096, back, 1));
+  TEST_ASSERT_EQUAL(1, flash.stats().violations);
+  TEST_ASSERT_EQUAL(3, flash.stats().bytes_programmed);
+
+  TEST_ASSERT_TRUE(flash.eraseSector(1));
+  TEST_ASSERT_TRUE(flash.program(4096, back, 1));
+  TEST_ASSERT_EQUAL(1, flash.eraseCount(1));
+  TEST_ASSERT_EQUAL(0, flash.eraseCount(0));
+  TEST_ASSERT_FALSE(flash.eraseSector(2));
+}
+
+void testPowerCutsLeaveHalfDoneWork() {
+  FlashEmulator flash(4096, 1);
+  const uint8_t data[] = {1, 2, 3, 4};
+  flash.cutPowerAfter(2);
+  TEST_ASSERT_FALSE(flash.program(0, data, 4));
+  TEST_ASSERT_TRUE(flash.poweredOff());
+  uint8_t read[4];
+  TEST_ASSERT_FALSE(flash.read(0, read, 4));
+  flash.powerOn();
+  TEST_ASSERT_TRUE(flash.read(0, read, 4));
+  TEST_ASSERT_EQUAL(1, read[0]);
+  TEST_ASSERT_EQUAL(2, read[1]);
+  TEST_ASSERT_EQUAL_HEX8(0xFF, read[2]);
+  TEST_ASSERT_EQUAL(2, flash.steps());
+
+  const uint8_t end[] = {5};
+  TEST_ASSERT_TRUE(flash.program(4095, end, 1));
+  flash.cutPowerAfter(0);
+  TEST_ASSERT_FALSE(flash.eraseSector(0));
+  flash.powerOn();
+  TEST_ASSERT_TRUE(flash.read(0, read, 1));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, read[0]);
+  TEST_ASSERT_TRUE(flash.read(4095, read, 1));
+  TEST_ASSERT_EQUAL(5, read[0]);
+  TEST_ASSERT_EQUAL(0, flash.eraseCount(0));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testProgrammingOnlyClearsBits);
+  RUN_TEST(testPowerCutsLeaveHalfDoneWork);
+  return UNITY_END();
+}
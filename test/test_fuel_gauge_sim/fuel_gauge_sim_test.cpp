@@ -0,0 +1,56 @@
+#include "fuel_gauge_sim.h"
+
+#include <unity.h>
+
+#include "pack_model.h"
+
+void setUp(void) {}
+
+void testOcvFollowsTheGaugeCurve() {
+  PackModel pack(PackParams{}, 50);
+  // DefaultOcvCurve points, 50mV apart from 2.7V.
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 3800, pack.ocvMillivolts(53));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 3825, pack.ocvMillivolts(56.5));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 4200, pack.ocvMillivolts(100));
+  // Where the curve is flat at 0%.
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 2850, pack.ocvMillivolts(0));
+}
+
+void testPackChargeAndRelaxation() {
+  PackParams params;
+  params.voltage_noise_millivolts = 0;
+  params.current_noise_milliamps = 0;
+  params.imbalance_millivolts = 0;
+  PackModel pack(params, 50);
+  // 350mAh is 10%.
+  pack.step(3500, 360);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 40, pack.soc());
+  const double ocv = pack.ocvMillivolts(40);
+  // Series and fully built up polarization drop.
+  TEST_ASSERT_INT_WITHIN(1, ocv - 3500 * 0.025, pack.measuredCellMillivolts());
+  TEST_ASSERT_EQUAL(3520, pack.measuredCurrentMilliamps());
+  pack.step(0, 3600);
+  TEST_ASSERT_INT_WITHIN(1, ocv, pack.measuredCellMillivolts());
+  TEST_ASSERT_LESS_THAN(params.capacity_mah, pack.capacityMah());
+}
+
+void testGaugeTracksTheSimulatedPack() {
+  FuelGaugeSimConfig config;
+  config.cycles = 20;
+  const FuelGaugeSimReport report = runFuelGaugeSim(config);
+  TEST_ASSERT_EQUAL(40, report.sessions);
+  TEST_ASSERT_GREATER_THAN(0, report.hours);
+  TEST_ASSERT_EQUAL(10, report.error_by_tenth.size());
+  TEST_ASSERT_LESS_THAN(15, report.mean_abs_error);
+  TEST_ASSERT_TRUE(report.max_abs_error >= report.mean_abs_error);
+  // Same seed, same run.
+  TEST_ASSERT_TRUE(report.rms_error == runFuelGaugeSim(config).rms_error);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testOcvFollowsTheGaugeCurve);
+  RUN_TEST(testPackChargeAndRelaxation);
+  RUN_TEST(testGaugeTracksTheSimulatedPack);
+  return UNITY_END();
+}
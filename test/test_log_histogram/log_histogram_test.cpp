@@ -0,0 +1,60 @@
+#include "log_histogram.h"
+
+#include <unity.h>
+
+#include <memory>
+
+std::unique_ptr<LogHistogram<8>> histogram;
+
+void setUp(void) { histogram.reset(new LogHistogram<8>()); }
+
+void testBucketBoundaries() {
+  TEST_ASSERT_EQUAL(0, LogHistogram<8>::bucketFor(0));
+  TEST_ASSERT_EQUAL(1, LogHistogram<8>::bucketFor(1));
+  TEST_ASSERT_EQUAL(2, LogHistogram<8>::bucketFor(2));
+  TEST_ASSERT_EQUAL(2, LogHistogram<8>::bucketFor(3));
+  TEST_ASSERT_EQUAL(3, LogHistogram<8>::bucketFor(4));
+  TEST_ASSERT_EQUAL(7, LogHistogram<8>::bucketFor(64));
+  // Everything too big for the last bucket's range goes there too.
+  TEST_ASSERT_EQUAL(7, LogHistogram<8>::bucketFor(0xFFFFFFFF));
+  for (uint8_t bucket = 0; bucket < 8; bucket++) {
+    TEST_ASSERT_EQUAL(
+        bucket,
+        LogHistogram<8>::bucketFor(LogHistogram<8>::bucketLowerBound(bucket)));
+  }
+}
+
+void testCounting() {
+  histogram->add(0);
+  histogram->add(5);
+  histogram->add(6);
+  histogram->add(1000);
+  TEST_ASSERT_EQUAL(4, histogram->total());
+  TEST_ASSERT_EQUAL(1, histogram->count(0));
+  TEST_ASSERT_EQUAL(2, histogram->count(3));
+  TEST_ASSERT_EQUAL(1, histogram->count(7));
+}
+
+void testMergeAndClear() {
+  histogram->add(5);
+  LogHistogram<8> other;
+  other.add(6);
+  other.add(0);
+  histogram->merge(other);
+  TEST_ASSERT_EQUAL(3, histogram->total());
+  TEST_ASSERT_EQUAL(2, histogram->count(3));
+  TEST_ASSERT_EQUAL(1, histogram->count(0));
+  histogram->clear();
+  TEST_ASSERT_EQUAL(0, histogram->total());
+  TEST_ASSERT_EQUAL(0, histogram->count(3));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testBucketBoundaries);
+  RUN_TEST(testCounting);
+  RUN_TEST(testMergeAndClear);
+  UNITY_END();
+
+  return 0;
+}
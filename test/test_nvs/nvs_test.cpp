@@ -0,0 +1,314 @@
+#include "nvs.h"
+
+#include <string.h>
+#include <unity.h>
+
+#include <vector>
+
+void setUp(void) {}
+
+constexpr size_t SECTOR_SIZE = 512;
+constexpr size_t SECTOR_COUNT = 4;
+
+// NOR flash in RAM, programming only clears bits.
+class RamFlash : public NvsFlash {
+ public:
+  RamFlash() : data(SECTOR_SIZE * SECTOR_COUNT, 0xFF) {}
+
+  bool read(size_t address, uint8_t* out, size_t len) override {
+    memcpy(out, &data[address], len);
+    return true;
+  }
+  bool program(size_t address, const uint8_t* in, size_t len) override {
+    for (size_t i = 0; i < len; i++) {
+      data[address + i] &= in[i];
+    }
+    programs++;
+    return true;
+  }
+  bool eraseSector(size_t sector) override {
+    memset(&data[sector * SECTOR_SIZE], 0xFF, SECTOR_SIZE);
+    erases++;
+    return true;
+  }
+
+  std::vector<uint8_t> data;
+  int programs = 0;
+  int erases = 0;
+};
+
+void testValuesSurviveARestart() {
+  RamFlash flash;
+  {
+    NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+    TEST_ASSERT_FALSE(storage.begin());
+    // Only in RAM until there's a page.
+    TEST_ASSERT_TRUE(storage.setString("ap_name", "owie"));
+    TEST_ASSERT_EQUAL(0, flash.programs);
+    TEST_ASSERT_TRUE(storage.format(2));
+    TEST_ASSERT_TRUE(storage.setUint64("count", 300));
+    TEST_ASSERT_TRUE(storage.setInt64("offset", -5));
+    TEST_ASSERT_TRUE(storage.setFixed32("gain", 0x3F800000));
+    TEST_ASSERT_TRUE(storage.setFixed64("big", 0x0123456789ABCDEF));
+    TEST_ASSERT_TRUE(storage.setUint64("gone", 1));
+    TEST_ASSERT_TRUE(storage.erase("gone"));
+  }
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(storage.begin());
+  TEST_ASSERT_EQUAL(2, storage.activeSector());
+  uint64_t u;
+  TEST_ASSERT_TRUE(storage.getUint64("count", &u));
+  TEST_ASSERT_EQUAL(300, u);
+  int64_t i;
+  TEST_ASSERT_TRUE(storage.getInt64("offset", &i));
+  TEST_ASSERT_EQUAL(-5, i);
+  uint32_t f;
+  TEST_ASSERT_TRUE(storage.getFixed32("gain", &f));
+  TEST_ASSERT_EQUAL_HEX32(0x3F800000, f);
+  TEST_ASSERT_TRUE(storage.getFixed64("big", &u));
+  TEST_ASSERT_TRUE(u == 0x0123456789ABCDEF);
+  char name[8];
+  size_t len;
+  TEST_ASSERT_TRUE(storage.getBytes("ap_name", (uint8_t*)name, 8, &len));
+  TEST_ASSERT_EQUAL(4, len);
+  TEST_ASSERT_EQUAL_MEMORY("owie", name, 4);
+  TEST_ASSERT_FALSE(storage.getBytes("ap_name", (uint8_t*)name, 3, &len));
+  // Wrong type, erased, never there.
+  TEST_ASSERT_FALSE(storage.getInt64("count", &i));
+  TEST_ASSERT_FALSE(storage.getUint64("gone", &u));
+  TEST_ASSERT_FALSE(storage.getUint64("nope", &u));
+}
+
+void testSmallUpdatesAppendAFewBytes() {
+  RamFlash flash;
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  storage.begin();
+  storage.format(0);
+  storage.setUint64("count", 1);
+  const size_t named = storage.writeOffset();
+  storage.setUint64("count", 2);
+  // id, value, length and crc, the name went with the first one.
+  TEST_ASSERT_EQUAL(6, storage.writeOffset() - named);
+  const int programs = flash.programs;
+  storage.setUint64("count", 2);
+  TEST_ASSERT_EQUAL(programs, flash.programs);
+  TEST_ASSERT_EQUAL(1, flash.erases);
+}
+
+void testFullPagesAreCompactedRoundTheRing() {
+  RamFlash flash;
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  storage.begin();
+  storage.format(0);
+  storage.setString("name", "board");
+  for (uint64_t count = 0; count < 2000; count++) {
+    TEST_ASSERT_TRUE(storage.setUint64("count", count));
+  }
+  TEST_ASSERT_TRUE(storage.stats().compactions > 0);
+  // Every sector took its turn.
+  for (size_t sector = 0; sector < SECTOR_COUNT; sector++) {
+    const int32_t diff =
+        storage.eraseCount(sector) - storage.eraseCount(0);
+    TEST_ASSERT_TRUE(diff >= -1 && diff <= 1);
+  }
+
+  NonVolatileStorage restarted(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(restarted.begin());
+  TEST_ASSERT_EQUAL(storage.activeSector(), restarted.activeSector());
+  uint64_t count;
+  TEST_ASSERT_TRUE(restarted.getUint64("count", &count));
+  TEST_ASSERT_EQUAL(1999, count);
+  char name[8];
+  size_t len;
+  TEST_ASSERT_TRUE(restarted.getBytes("name", (uint8_t*)name, 8, &len));
+  TEST_ASSERT_EQUAL_MEMORY("board", name, 5);
+  // Erase counts come back from the headers.
+  for (size_t sector = 0; sector < SECTOR_COUNT; sector++) {
+    TEST_ASSERT_EQUAL(storage.eraseCount(sector),
+                      restarted.eraseCount(sector));
+  }
+}
+
+void testTornWritesAreIgnored() {
+  RamFlash flash;
+  {
+    NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+    storage.begin();
+    storage.format(1);
+    storage.setUint64("count", 1);
+    const size_t end = storage.writeOffset();
+    storage.setUint64("count", 2);
+    // Power lost halfway through the last record.
+    flash.data[SECTOR_SIZE + end + 2] = 0xFF;
+    flash.data[SECTOR_SIZE + end + 3] = 0xFF;
+  }
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(storage.begin());
+  uint64_t count;
+  TEST_ASSERT_TRUE(storage.getUint64("count", &count));
+  TEST_ASSERT_EQUAL(1, count);
+  // Can't write after the torn record, the next write moves on.
+  storage.setUint64("count", 3);
+  TEST_ASSERT_EQUAL(1, storage.stats().compactions);
+  TEST_ASSERT_FALSE(storage.activeSector() == 1);
+
+  // A compaction cut short leaves the old page in charge.
+  const int active = storage.activeSector();
+  flash.eraseSector((active + 1) % SECTOR_COUNT);
+  NonVolatileStorage restarted(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(restarted.begin());
+  TEST_ASSERT_EQUAL(active, restarted.activeSector());
+  TEST_ASSERT_TRUE(restarted.getUint64("count", &count));
+  TEST_ASSERT_EQUAL(3, count);
+}
+
+void testInterruptedCompactionCountsAsWorn() {
+  RamFlash flash;
+  {
+    NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+    storage.begin();
+    storage.setUint64("count", 1);
+    for (size_t sector = 0; sector < SECTOR_COUNT; sector++) {
+      TEST_ASSERT_TRUE(storage.format(sector));
+    }
+  }
+  // The next compaction erased sector 0 and then the power went.
+  flash.eraseSector(0);
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(storage.begin());
+  TEST_ASSERT_EQUAL(3, storage.activeSector());
+  TEST_ASSERT_EQUAL(2, storage.eraseCount(0));
+  for (uint64_t count = 0; storage.activeSector() == 3 && count < 500;
+       count++) {
+    storage.setUint64("count", count);
+  }
+  TEST_ASSERT_EQUAL(1, storage.activeSector());
+}
+
+void testRotationOffStaysInSectorZero() {
+  RamFlash flash;
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  storage.begin();
+  storage.format(2);
+  storage.setUint64("count", 7);
+  TEST_ASSERT_TRUE(storage.setRotation(false));
+  TEST_ASSERT_EQUAL(0, storage.activeSector());
+  for (uint64_t count = 0; count < 500; count++) {
+    storage.setUint64("count", count);
+  }
+  TEST_ASSERT_EQUAL(0, storage.activeSector());
+  TEST_ASSERT_EQUAL(1, storage.eraseCount(2));
+  NonVolatileStorage restarted(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(restarted.begin());
+  uint64_t count;
+  TEST_ASSERT_TRUE(restarted.getUint64("count", &count));
+  TEST_ASSERT_EQUAL(499, count);
+}
+
+void testLongKeysAndValuesAreRejected() {
+  RamFlash flash;
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  storage.begin();
+  storage.format(0);
+  TEST_ASSERT_FALSE(
+      storage.setUint64("a_key_that_is_longer_than_31_chars", 1));
+  std::vector<uint8_t> value(128, 'x');
+  TEST_ASSERT_FALSE(storage.setBytes("value", value.data(), value.size()));
+  TEST_ASSERT_TRUE(storage.setBytes("value", value.data(), 127));
+}
+
+void testBatchesAreOneProgram() {
+  RamFlash flash;
+  {
+    NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+    storage.begin();
+    storage.format(0);
+    storage.setUint64("is_locked", 0);
+    const int programs = flash.programs;
+    storage.startBatch();
+    storage.setUint64("is_locked", 1);
+    storage.setUint64("locking_enabled", 1);
+    // Unchanged, not part of the batch.
+    storage.setUint64("is_locked", 1);
+    TEST_ASSERT_EQUAL(programs, flash.programs);
+    TEST_ASSERT_TRUE(storage.commitBatch());
+    TEST_ASSERT_EQUAL(programs + 1, flash.programs);
+    // Nothing to commit.
+    storage.startBatch();
+    TEST_ASSERT_TRUE(storage.commitBatch());
+    TEST_ASSERT_EQUAL(programs + 1, flash.programs);
+  }
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(storage.begin());
+  uint64_t value;
+  TEST_ASSERT_TRUE(storage.getUint64("is_locked", &value));
+  TEST_ASSERT_EQUAL(1, value);
+  TEST_ASSERT_TRUE(storage.getUint64("locking_enabled", &value));
+  TEST_ASSERT_EQUAL(1, value);
+}
+
+void testTornBatchesAreDroppedWhole() {
+  RamFlash flash;
+  size_t end;
+  {
+    NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+    storage.begin();
+    storage.format(0);
+    storage.setInt64("top_soc", 90);
+    storage.setInt64("bottom_soc", 10);
+    end = storage.writeOffset();
+    storage.startBatch();
+    storage.setInt64("top_soc", 95);
+    storage.setInt64("bottom_soc", 5);
+    storage.commitBatch();
+    // Power lost with the first update of the batch on flash.
+    for (size_t i = end + 8; i < storage.writeOffset(); i++) {
+      flash.data[i] = 0xFF;
+    }
+  }
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(storage.begin());
+  TEST_ASSERT_EQUAL(end, storage.writeOffset());
+  int64_t value;
+  TEST_ASSERT_TRUE(storage.getInt64("top_soc", &value));
+  TEST_ASSERT_EQUAL(90, value);
+  TEST_ASSERT_TRUE(storage.getInt64("bottom_soc", &value));
+  TEST_ASSERT_EQUAL(10, value);
+}
+
+void testBatchesThatDontFitGoToAFreshPage() {
+  RamFlash flash;
+  NonVolatileStorage storage(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  storage.begin();
+  storage.format(0);
+  std::vector<uint8_t> value(100, 'x');
+  for (int round = 0; round < 10; round++) {
+    storage.startBatch();
+    value[0] = 'a' + round;
+    storage.setBytes("a", value.data(), value.size());
+    storage.setBytes("b", value.data(), value.size());
+    TEST_ASSERT_TRUE(storage.commitBatch());
+  }
+  TEST_ASSERT_TRUE(storage.stats().compactions > 0);
+  NonVolatileStorage restarted(&flash, SECTOR_SIZE, SECTOR_COUNT);
+  TEST_ASSERT_TRUE(restarted.begin());
+  uint8_t read[100];
+  size_t len;
+  TEST_ASSERT_TRUE(restarted.getBytes("b", read, sizeof(read), &len));
+  TEST_ASSERT_EQUAL('a' + 9, read[0]);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testValuesSurviveARestart);
+  RUN_TEST(testSmallUpdatesAppendAFewBytes);
+  RUN_TEST(testFullPagesAreCompactedRoundTheRing);
+  RUN_TEST(testTornWritesAreIgnored);
+  RUN_TEST(testInterruptedCompactionCountsAsWorn);
+  RUN_TEST(testRotationOffStaysInSectorZero);
+  RUN_TEST(testLongKeysAndValuesAreRejected);
+  RUN_TEST(testBatchesAreOneProgram);
+  RUN_TEST(testTornBatchesAreDroppedWhole);
+  RUN_TEST(testBatchesThatDontFitGoToAFreshPage);
+  return UNITY_END();
+}
@@ -0,0 +1,100 @@
+#include "page.h"
+
+#include <string.h>
+#include <unity.h>
+
+#include <vector>
+
+void setUp(void) {}
+
+constexpr size_t PAGE_SIZE = 256;
+
+class PageBuilder {
+ public:
+  PageBuilder() : data(PAGE_SIZE, 0xFF), end(nvs_record::PAGE_DATA_START) {
+    nvs_record::encodePageStart({nvs_record::PAGE_VERSION, 7, 3},
+                                data.data());
+  }
+
+  size_t add(int32_t id, const char* name, uint64_t value) {
+    nvs_record::ValueUpdate update = {};
+    update.id = id;
+    update.name = name;
+    update.name_length = name == nullptr ? 0 : strlen(name);
+    update.type = nvs_record::UINT64;
+    update.number = value;
+    const size_t size = nvs_record::encodeValueUpdate(update, &data[end]);
+    end += size;
+    return size;
+  }
+
+  std::vector<uint8_t> data;
+  size_t end;
+};
+
+void testLatestValueOfEveryIdIsIndexed() {
+  PageBuilder builder;
+  builder.add(0, "count", 1);
+  builder.add(1, "power", 9);
+  builder.add(0, nullptr, 300);
+  NVSPage page(PAGE_SIZE);
+  TEST_ASSERT_TRUE(page.load(builder.data.data()));
+  TEST_ASSERT_EQUAL(7, page.sequenceNumber());
+  TEST_ASSERT_EQUAL(3, page.eraseCount());
+  TEST_ASSERT_EQUAL(builder.end, page.dataEnd());
+  TEST_ASSERT_TRUE(page.isClean());
+  TEST_ASSERT_EQUAL(2, page.idCount());
+  TEST_ASSERT_EQUAL(0, page.find("count", 5));
+  TEST_ASSERT_EQUAL(1, page.find("power", 5));
+  TEST_ASSERT_EQUAL(-1, page.find("pow", 3));
+
+  nvs_record::ValueUpdate value;
+  TEST_ASSERT_TRUE(page.value(0, &value));
+  TEST_ASSERT_EQUAL(nvs_record::UINT64, value.type);
+  TEST_ASSERT_EQUAL(300, value.number);
+  const char* name;
+  size_t len;
+  TEST_ASSERT_TRUE(page.name(1, &name, &len));
+  // Straight out of the buffer.
+  TEST_ASSERT_TRUE(name > (const char*)builder.data.data() &&
+                   name < (const char*)builder.data.data() + PAGE_SIZE);
+  TEST_ASSERT_EQUAL(5, len);
+  TEST_ASSERT_FALSE(page.value(2, &value));
+}
+
+void testScanStopsAtABrokenRecord() {
+  PageBuilder builder;
+  builder.add(0, "count", 1);
+  const size_t good = builder.end;
+  builder.add(0, nullptr, 2);
+  builder.data[good + 2] ^= 1;
+  builder.add(0, nullptr, 3);
+  NVSPage page(PAGE_SIZE);
+  TEST_ASSERT_TRUE(page.load(builder.data.data()));
+  TEST_ASSERT_EQUAL(good, page.dataEnd());
+  TEST_ASSERT_FALSE(page.isClean());
+  nvs_record::ValueUpdate value;
+  TEST_ASSERT_TRUE(page.value(0, &value));
+  TEST_ASSERT_EQUAL(1, value.number);
+}
+
+void testBadPagesAreRejected() {
+  PageBuilder builder;
+  builder.add(3, "far", 1);
+  NVSPage small(PAGE_SIZE, 2);
+  TEST_ASSERT_FALSE(small.load(builder.data.data()));
+  NVSPage page(PAGE_SIZE);
+  TEST_ASSERT_TRUE(page.load(builder.data.data()));
+  builder.data[1] = 0;
+  TEST_ASSERT_FALSE(page.load(builder.data.data()));
+  std::vector<uint8_t> erased(PAGE_SIZE, 0xFF);
+  TEST_ASSERT_FALSE(page.load(erased.data()));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testLatestValueOfEveryIdIsIndexed);
+  RUN_TEST(testScanStopsAtABrokenRecord);
+  RUN_TEST(testBadPagesAreRejected);
+  return UNITY_END();
+}
@@ -0,0 +1,42 @@
+#include "nvs_sim.h"
+
+#include <unity.h>
+
+#include <cstdio>
+
+void setUp(void) {}
+
+void testWorkloadSpreadsWear() {
+  NvsSimConfig config;
+  config.saves = 20000;
+  const NvsSimReport report = runNvsSim(config);
+  TEST_ASSERT_TRUE(report.restart_ok);
+  TEST_ASSERT_EQUAL(0, report.failed_saves);
+  TEST_ASSERT_TRUE(report.erases > 0);
+  TEST_ASSERT_TRUE(report.max_erase_count - report.min_erase_count <= 1);
+  // Far from a sector per save.
+  TEST_ASSERT_TRUE(report.erases * 20 < report.saves);
+  TEST_ASSERT_TRUE(report.lifetime_years >
+                   10 * report.eeprom_rotate_lifetime_years);
+}
+
+void testEveryPowerCutRecovers() {
+  // Small sectors so that the cuts hit compactions too.
+  NvsSimConfig config;
+  config.sector_size = 512;
+  config.saves = 60;
+  const NvsPowerCutReport report = checkPowerCuts(config);
+  char message[48];
+  snprintf(message, sizeof(message), "first failure at step %lld",
+           (long long)report.first_failure);
+  TEST_ASSERT_TRUE(report.cut_points > 1000);
+  TEST_ASSERT_EQUAL_MESSAGE(report.cut_points, report.consistent, message);
+  TEST_ASSERT_EQUAL_MESSAGE(report.cut_points, report.writable, message);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testWorkloadSpreadsWear);
+  RUN_TEST(testEveryPowerCutRecovers);
+  return UNITY_END();
+}
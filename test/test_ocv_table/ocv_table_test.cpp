@@ -0,0 +1,71 @@
+#include "ocv_table.h"
+
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+typedef OcvTable<DefaultOcvCurve> DefaultOcvTable;
+constexpr DefaultOcvTable::Table TABLE = DefaultOcvTable::generate();
+
+void setUp(void) {}
+
+// The float interpolation the table replaced.
+int32_t referenceSoc(int32_t cellVoltageMillivolts) {
+  static const uint8_t LOOKUP_TABLE[31] = {
+      0,  0,  0,  0,  1,  2,  3,  4,  5,  7,  8,  11, 14, 16, 18, 19,
+      25, 30, 33, 37, 43, 48, 53, 60, 67, 71, 76, 82, 92, 97, 100};
+  const int32_t range = 4200 - 2700;
+  cellVoltageMillivolts =
+      std::min(range - 1, std::max(cellVoltageMillivolts - 2700, 0));
+  const float floatIndex = float(cellVoltageMillivolts) * 30 / range;
+  const int32_t leftIndex = int(floatIndex);
+  const float fractional = floatIndex - leftIndex;
+  const int32_t leftValue = LOOKUP_TABLE[leftIndex];
+  const int32_t rightValue = LOOKUP_TABLE[leftIndex + 1];
+  return std::min<int32_t>(
+      100, std::max<int32_t>(
+               0, leftValue + round((rightValue - leftValue) * fractional)));
+}
+
+void testWithinOnePercentOfFloatInterpolation() {
+  for (int32_t millivolts = 2000; millivolts <= 5000; millivolts++) {
+    const int32_t soc = DefaultOcvTable::socPercent(TABLE, millivolts);
+    TEST_ASSERT_INT_WITHIN(1, referenceSoc(millivolts), soc);
+  }
+}
+
+void testCurvePointsAndClamping() {
+  TEST_ASSERT_EQUAL(0, DefaultOcvTable::socPercent(TABLE, 0));
+  TEST_ASSERT_EQUAL(0, DefaultOcvTable::socPercent(TABLE, 2700));
+  TEST_ASSERT_EQUAL(53, DefaultOcvTable::socPercent(TABLE, 3800));
+  // Halfway between 18 and 19 is rounded up.
+  TEST_ASSERT_EQUAL(19, DefaultOcvTable::socPercent(TABLE, 3425));
+  TEST_ASSERT_EQUAL(100, DefaultOcvTable::socPercent(TABLE, 4200));
+  TEST_ASSERT_EQUAL(100, DefaultOcvTable::socPercent(TABLE, 9000));
+}
+
+// Curves are template parameters, anything evenly spaced works.
+typedef OcvCurve<3000, 4000, 100, 0> FallingCurve;
+constexpr OcvTable<FallingCurve>::Table FALLING_TABLE =
+    OcvTable<FallingCurve>::generate();
+
+void testCustomCurve() {
+  TEST_ASSERT_EQUAL(1000, OcvTable<FallingCurve>::SIZE);
+  TEST_ASSERT_EQUAL(
+      100, OcvTable<FallingCurve>::socPercent(FALLING_TABLE, 3000));
+  TEST_ASSERT_EQUAL(
+      50, OcvTable<FallingCurve>::socPercent(FALLING_TABLE, 3500));
+  // 0.5 away from 75 and 74, rounded away from zero.
+  TEST_ASSERT_EQUAL(
+      75, OcvTable<FallingCurve>::socPercent(FALLING_TABLE, 3245));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testWithinOnePercentOfFloatInterpolation);
+  RUN_TEST(testCurvePointsAndClamping);
+  RUN_TEST(testCustomCurve);
+  return UNITY_END();
+}
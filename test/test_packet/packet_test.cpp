@@ -0,0 +1,61 @@
+#include "packet.h"
+
+#include <unity.h>
+
+#include <cstring>
+
+void setUp(void) {}
+
+void testValidation() {
+  uint8_t data[] = {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE};
+  TEST_ASSERT_TRUE(Packet(data, sizeof(data)).isValid());
+  data[4] = 0x2;
+  TEST_ASSERT_FALSE(Packet(data, sizeof(data)).isValid());
+}
+
+void testSetDataBytePatchesChecksum() {
+  uint8_t data[] = {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE};
+  Packet p(data, sizeof(data));
+  p.setDataByte(0, 0x8);
+  p.setDataByte(1, 0x4);
+  p.setDataByte(2, 0x2);
+  p.setDataByte(3, 0x1);
+  const uint8_t expected[] = {0xFF, 0x55, 0xAA, 0x6, 0x8,
+                              0x4,  0x2,  0x1,  0x2, 0x13};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, data, sizeof(data));
+  TEST_ASSERT_TRUE(Packet(data, sizeof(data)).isValid());
+}
+
+void testSetDataByteMatchesFullRecalculation() {
+  // Exercise carries and borrows across the checksum's byte boundary.
+  uint8_t data[] = {0xff, 0x55, 0xaa, 0x03, 0x29, 0x02, 0x2a};
+  Packet p(data, sizeof(data));
+  for (int value = 0; value < 256; value += 7) {
+    p.setDataByte(0, value);
+    uint8_t copy[sizeof(data)];
+    memcpy(copy, data, sizeof(data));
+    Packet recalculated(copy, sizeof(copy));
+    recalculated.recalculateCrcIfValid();
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(copy, data, sizeof(data));
+    TEST_ASSERT_TRUE(Packet(copy, sizeof(copy)).isValid());
+  }
+}
+
+void testSetDataByteIgnoresInvalidPackets() {
+  uint8_t data[] = {0xff, 0x55, 0xaa, 0x03, 0x29, 0x02, 0x2b};
+  Packet p(data, sizeof(data));
+  p.setDataByte(0, 0x10);
+  TEST_ASSERT_EQUAL(0x29, data[4]);
+  TEST_ASSERT_EQUAL(0x2b, data[6]);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testValidation);
+  RUN_TEST(testSetDataBytePatchesChecksum);
+  RUN_TEST(testSetDataByteMatchesFullRecalculation);
+  RUN_TEST(testSetDataByteIgnoresInvalidPackets);
+  UNITY_END();
+
+  return 0;
+}
@@ -2,6 +2,7 @@
 
 #include <unity.h>
 
+#include <limits>
 #include <memory>
 #include <string>
 
@@ -41,12 +42,9 @@ void testindividualStatsCalculation() {
       0, tracker->getIndividualPacketStats()[6].mean_period_millis());
   TEST_ASSERT_EQUAL(0,
                     tracker->getIndividualPacketStats()[6].deviation_millis());
-  TEST_ASSERT_EQUAL(
-      sizeof(data),
-      tracker->getIndividualPacketStats()[6].last_seen_valid_packet.size());
-  TEST_ASSERT_EQUAL_UINT8_ARRAY(
-      data, &tracker->getIndividualPacketStats()[6].last_seen_valid_packet[0],
-      sizeof(data));
+  TEST_ASSERT_NOT_NULL(tracker->getLastValidPacket(6));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data, tracker->getLastValidPacket(6),
+                                sizeof(data));
 
   // Advance the time by 1000 millis and send the same packet
   tracker->processPacket(p, 1000);
@@ -61,16 +59,130 @@ void testindividualStatsCalculation() {
 
   TEST_ASSERT_EQUAL(3, tracker->getIndividualPacketStats()[6].total_num);
   TEST_ASSERT_EQUAL(6, tracker->getIndividualPacketStats()[6].id);
+  // Moving averages, the newest interval has 1/16 weight.
   TEST_ASSERT_EQUAL(
-      1003, tracker->getIndividualPacketStats()[6].mean_period_millis());
-  TEST_ASSERT_EQUAL(4,
+      1000, tracker->getIndividualPacketStats()[6].mean_period_millis());
+  TEST_ASSERT_EQUAL(1,
                     tracker->getIndividualPacketStats()[6].deviation_millis());
+  TEST_ASSERT_EQUAL(1000,
+                    tracker->getIndividualPacketStats()[6].min_period_millis);
+  TEST_ASSERT_EQUAL(1006,
+                    tracker->getIndividualPacketStats()[6].max_period_millis);
+}
+
+void testPeriodStatsConverge() {
+  uint8_t data[] = {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE};
+  Packet p(data, sizeof(data));
+  // Alternating 400 and 600ms apart.
+  unsigned long now = 0;
+  for (int i = 0; i < 200; i++) {
+    tracker->processPacket(p, now);
+    now += i % 2 ? 400 : 600;
+  }
+  const IndividualPacketStat& stat = tracker->getIndividualPacketStats()[6];
+  TEST_ASSERT_INT_WITHIN(10, 500, stat.mean_period_millis());
+  TEST_ASSERT_INT_WITHIN(10, 100, stat.deviation_millis());
+  TEST_ASSERT_EQUAL(400, stat.min_period_millis);
+  TEST_ASSERT_EQUAL(600, stat.max_period_millis);
+  TEST_ASSERT_EQUAL(199, stat.period_millis.total());
+  TEST_ASSERT_EQUAL(99, stat.period_millis.count(
+                            LogHistogram<13>::bucketFor(400)));
+  TEST_ASSERT_EQUAL(100, stat.period_millis.count(
+                             LogHistogram<13>::bucketFor(600)));
+  TEST_ASSERT_EQUAL(0, stat.missed_num);
+}
+
+void testMissedPacketsAreCounted() {
+  uint8_t data[] = {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE};
+  Packet p(data, sizeof(data));
+  unsigned long now = 0;
+  for (int i = 0; i < 20; i++) {
+    tracker->processPacket(p, now += 500);
+  }
+  // Two packets lost in between.
+  tracker->processPacket(p, now += 1500);
+  TEST_ASSERT_EQUAL(2, tracker->getIndividualPacketStats()[6].missed_num);
+  // Within 1.5 periods is just jitter.
+  tracker->processPacket(p, now += 700);
+  TEST_ASSERT_EQUAL(2, tracker->getIndividualPacketStats()[6].missed_num);
+}
+
+void testNextPacketPrediction() {
+  uint8_t data[] = {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE};
+  Packet p(data, sizeof(data));
+  unsigned long now = 0;
+  // Not enough periods to go by yet.
+  for (int i = 0; i < 3; i++) {
+    tracker->processPacket(p, now += 500);
+  }
+  TEST_ASSERT_EQUAL(std::numeric_limits<unsigned long>::max(),
+                    tracker->millisUntilNextPacket(now));
+  for (int i = 0; i < 20; i++) {
+    tracker->processPacket(p, now += 500);
+  }
+  TEST_ASSERT_EQUAL(500, tracker->millisUntilNextPacket(now));
+  TEST_ASSERT_EQUAL(100, tracker->millisUntilNextPacket(now + 400));
+  TEST_ASSERT_EQUAL(0, tracker->millisUntilNextPacket(now + 600));
+  // Well overdue, no longer expected.
+  TEST_ASSERT_EQUAL(std::numeric_limits<unsigned long>::max(),
+                    tracker->millisUntilNextPacket(now + 800));
+}
+
+void testOnlyValidPacketsAreStored() {
+  TEST_ASSERT_NULL(tracker->getLastValidPacket(6));
+  uint8_t data[] = {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE};
+  tracker->processPacket(Packet(data, sizeof(data)), 0);
+  uint8_t corrupted[] = {0xFF, 0x55, 0xAA, 0x6, 0x9, 0x2, 0x3, 0x4, 0x2, 0xE};
+  tracker->processPacket(Packet(corrupted, sizeof(corrupted)), 1000);
+  TEST_ASSERT_EQUAL(1,
+                    tracker->getGlobalStats().total_packet_checksum_mismatches);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data, tracker->getLastValidPacket(6),
+                                sizeof(data));
+  // Slots don't overlap.
+  uint8_t other[] = {0xff, 0x55, 0xaa, 0x07, 0x10, 0xcc, 0x10,
+                     0x57, 0x09, 0xc4, 0x50, 0x04, 0x65};
+  tracker->processPacket(Packet(other, sizeof(other)), 1000);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data, tracker->getLastValidPacket(6),
+                                sizeof(data));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(other, tracker->getLastValidPacket(7),
+                                sizeof(other));
+}
+
+void testReplayedPacketsAreIgnored() {
+  uint8_t data[] = {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE};
+  tracker->processPacket(Packet(data, sizeof(data), /*replayed=*/true), 0);
+  TEST_ASSERT_EQUAL(0, tracker->getGlobalStats().total_known_packets_received);
+  TEST_ASSERT_NULL(tracker->getLastValidPacket(6));
+}
+
+void testChangeDetection() {
+  uint8_t data[] = {0xFF, 0x55, 0xAA, 0x6, 0x1, 0x2, 0x3, 0x4, 0x2, 0xE};
+  uint8_t other[] = {0xFF, 0x55, 0xAA, 0x6, 0x8, 0x4, 0x2, 0x1, 0x2, 0x13};
+  TEST_ASSERT_TRUE(tracker->processPacket(Packet(data, sizeof(data)), 0));
+  TEST_ASSERT_FALSE(tracker->processPacket(Packet(data, sizeof(data)), 1000));
+  TEST_ASSERT_TRUE(tracker->processPacket(Packet(other, sizeof(other)), 2000));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(other, tracker->getLastValidPacket(6),
+                                sizeof(other));
+  TEST_ASSERT_FALSE(
+      tracker->processPacket(Packet(other, sizeof(other), true), 3000));
+  const IndividualPacketStat& stat = tracker->getIndividualPacketStats()[6];
+  TEST_ASSERT_EQUAL(3, stat.total_num);
+  TEST_ASSERT_EQUAL(1, stat.unchanged_num);
+  // Corrupted packets are never the same as the last valid one.
+  other[4] = 0x9;
+  TEST_ASSERT_TRUE(tracker->processPacket(Packet(other, sizeof(other)), 4000));
 }
 
 int main(int argc, char** argv) {
   UNITY_BEGIN();
   RUN_TEST(testGlobalTracking);
   RUN_TEST(testindividualStatsCalculation);
+  RUN_TEST(testPeriodStatsConverge);
+  RUN_TEST(testMissedPacketsAreCounted);
+  RUN_TEST(testNextPacketPrediction);
+  RUN_TEST(testOnlyValidPacketsAreStored);
+  RUN_TEST(testReplayedPacketsAreIgnored);
+  RUN_TEST(testChangeDetection);
   UNITY_END();
 
   return 0;
@@ -0,0 +1,112 @@
+#include "spsc_ring.h"
+
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+
+std::unique_ptr<SpscRing<uint8_t, 16>> ring;
+
+void setUp(void) { ring.reset(new SpscRing<uint8_t, 16>()); }
+
+void testPushAndPop() {
+  const uint8_t data[] = {1, 2, 3, 4, 5};
+  TEST_ASSERT_EQUAL(5, ring->push(data, sizeof(data)));
+  TEST_ASSERT_EQUAL(5, ring->size());
+  uint8_t front;
+  TEST_ASSERT_TRUE(ring->front(&front));
+  TEST_ASSERT_EQUAL(1, front);
+  uint8_t out[8];
+  TEST_ASSERT_EQUAL(3, ring->pop(out, 3));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out, 3);
+  TEST_ASSERT_EQUAL(2, ring->pop(out, sizeof(out)));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data + 3, out, 2);
+  TEST_ASSERT_FALSE(ring->front(&front));
+  TEST_ASSERT_EQUAL(5, ring->totalPushed());
+  TEST_ASSERT_EQUAL(5, ring->totalPopped());
+}
+
+void testFullRingKeepsOldData() {
+  uint8_t data[20];
+  for (int i = 0; i < 20; i++) {
+    data[i] = i;
+  }
+  TEST_ASSERT_EQUAL(16, ring->push(data, sizeof(data)));
+  TEST_ASSERT_FALSE(ring->push(data[0]));
+  uint8_t out[20];
+  TEST_ASSERT_EQUAL(4, ring->pop(out, 4));
+  // Wraps around the end of the buffer.
+  TEST_ASSERT_EQUAL(4, ring->push(data + 16, 4));
+  TEST_ASSERT_EQUAL(16, ring->pop(out, sizeof(out)));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(data + 4, out, 16);
+}
+
+// Producer thread plays the UART RX interrupt, pushing bursts of increasing
+// numbers at random. The consumer has to see them in order, with nothing
+// lost other than what the producer was told didn't fit.
+void testConcurrentProducerAndConsumer() {
+  static SpscRing<uint32_t, 64> numbers;
+  constexpr uint32_t TOTAL = 2000000;
+  std::atomic<bool> done(false);
+  uint32_t dropped = 0;
+  std::thread producer([&]() {
+    std::minstd_rand random(1234);
+    uint32_t next = 0;
+    uint32_t burst[32];
+    while (next < TOTAL) {
+      const uint32_t len =
+          std::min<uint32_t>(1 + random() % 32, TOTAL - next);
+      for (uint32_t i = 0; i < len; i++) {
+        burst[i] = next + i;
+      }
+      const uint32_t pushed = numbers.push(burst, len);
+      dropped += len - pushed;
+      next += len;
+      // Bytes trickle in, give the consumer a chance to catch up, also when
+      // both threads share a single core.
+      if (pushed < len) {
+        std::this_thread::sleep_for(std::chrono::microseconds(1));
+      }
+    }
+    done = true;
+  });
+
+  uint32_t received = 0;
+  int64_t last = -1;
+  bool inOrder = true;
+  std::minstd_rand random(5678);
+  uint32_t out[48];
+  while (true) {
+    const bool producerDone = done;
+    const uint32_t len = numbers.pop(out, 1 + random() % 48);
+    for (uint32_t i = 0; i < len; i++) {
+      inOrder &= (int64_t)out[i] > last;
+      last = out[i];
+    }
+    received += len;
+    if (len == 0 && producerDone) {
+      break;
+    }
+  }
+  producer.join();
+  TEST_ASSERT_TRUE(inOrder);
+  TEST_ASSERT_EQUAL(TOTAL, received + dropped);
+  TEST_ASSERT_EQUAL(numbers.totalPushed(), numbers.totalPopped());
+  // Both paths got exercised.
+  TEST_ASSERT_GREATER_THAN(TOTAL / 10, received);
+  TEST_ASSERT_GREATER_THAN(0, dropped);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testPushAndPop);
+  RUN_TEST(testFullRingKeepsOldData);
+  RUN_TEST(testConcurrentProducerAndConsumer);
+  UNITY_END();
+
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include "tx_queue.h"
+
+#include <unity.h>
+
+#include <memory>
+#include <vector>
+
+// Fake UART with a 128 byte FIFO that only empties when the test says so.
+constexpr size_t UART_FIFO_SIZE = 128;
+
+std::vector<uint8_t> uartFifo;
+std::vector<uint8_t> wire;
+std::unique_ptr<TxQueue> queue;
+
+void drainUart(size_t len) {
+  len = std::min(len, uartFifo.size());
+  wire.insert(wire.end(), uartFifo.begin(), uartFifo.begin() + len);
+  uartFifo.erase(uartFifo.begin(), uartFifo.begin() + len);
+}
+
+void setUp(void) {
+  uartFifo.clear();
+  wire.clear();
+  queue.reset(new TxQueue(
+      []() { return UART_FIFO_SIZE - uartFifo.size(); },
+      [](const uint8_t* data, size_t len) {
+        TEST_ASSERT_LESS_OR_EQUAL(UART_FIFO_SIZE - uartFifo.size(), len);
+        uartFifo.insert(uartFifo.end(), data, data + len);
+      }));
+}
+
+std::vector<uint8_t> sequence(size_t start, size_t len) {
+  std::vector<uint8_t> data;
+  for (size_t i = 0; i < len; i++) {
+    data.push_back((uint8_t)(start + i));
+  }
+  return data;
+}
+
+void testWritesStraightToUartWhenThereIsRoom() {
+  const auto data = sequence(0, 100);
+  queue->write(data.data(), data.size());
+  TEST_ASSERT_EQUAL(0, queue->size());
+  TEST_ASSERT_EQUAL(100, uartFifo.size());
+  TEST_ASSERT_EQUAL(0, queue->getStats().would_block_count);
+  TEST_ASSERT_EQUAL(0, queue->getStats().high_water_bytes);
+}
+
+void testQueuesOverflowAndKeepsOrder() {
+  const auto first = sequence(0, 100);
+  const auto second = sequence(100, 100);
+  queue->write(first.data(), first.size());
+  queue->write(second.data(), second.size());
+  TEST_ASSERT_EQUAL(128, uartFifo.size());
+  TEST_ASSERT_EQUAL(72, queue->size());
+  TEST_ASSERT_EQUAL(1, queue->getStats().would_block_count);
+  TEST_ASSERT_EQUAL(72, queue->getStats().high_water_bytes);
+
+  drainUart(50);
+  queue->pump();
+  TEST_ASSERT_EQUAL(22, queue->size());
+  drainUart(UART_FIFO_SIZE);
+  queue->pump();
+  TEST_ASSERT_EQUAL(0, queue->size());
+  drainUart(UART_FIFO_SIZE);
+
+  const auto expected = sequence(0, 200);
+  TEST_ASSERT_EQUAL(expected.size(), wire.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), wire.data(), wire.size());
+}
+
+void testDropsWholeWritesThatDontFit() {
+  const auto data = sequence(0, 128);
+  queue->write(data.data(), data.size());
+  queue->write(data.data(), data.size());
+  queue->write(data.data(), data.size());
+  TEST_ASSERT_EQUAL(256, queue->size());
+  // No room left at all, the packet has to go entirely.
+  const auto packet = sequence(0, 7);
+  queue->write(packet.data(), packet.size());
+  TEST_ASSERT_EQUAL(256, queue->size());
+  TEST_ASSERT_EQUAL(7, queue->getStats().dropped_bytes);
+  TEST_ASSERT_EQUAL(1, queue->getStats().dropped_writes);
+  TEST_ASSERT_EQUAL(256, queue->getStats().high_water_bytes);
+}
+
+void testWrapsAroundTheRing() {
+  std::vector<uint8_t> expected;
+  for (int i = 0; i < 50; i++) {
+    const auto packet = sequence(i * 37, 37);
+    expected.insert(expected.end(), packet.begin(), packet.end());
+    queue->write(packet.data(), packet.size());
+    drainUart(30);
+    queue->pump();
+  }
+  while (queue->size() > 0 || !uartFifo.empty()) {
+    drainUart(UART_FIFO_SIZE);
+    queue->pump();
+  }
+  TEST_ASSERT_EQUAL(0, queue->getStats().dropped_bytes);
+  TEST_ASSERT_EQUAL(expected.size(), wire.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), wire.data(), wire.size());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testWritesStraightToUartWhenThereIsRoom);
+  RUN_TEST(testQueuesOverflowAndKeepsOrder);
+  RUN_TEST(testDropsWholeWritesThatDontFit);
+  RUN_TEST(testWrapsAroundTheRing);
+  UNITY_END();
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include "tx_scheduler.h"
+
+#include <unity.h>
+
+#include <limits>
+#include <memory>
+
+std::unique_ptr<TxScheduler> scheduler;
+
+void setUp(void) { scheduler.reset(new TxScheduler()); }
+
+BusState idleBus(unsigned long nowMillis) {
+  BusState bus;
+  bus.now_millis = nowMillis;
+  bus.quiet_millis = 100;
+  bus.mid_packet = false;
+  bus.millis_until_next_packet = std::numeric_limits<unsigned long>::max();
+  return bus;
+}
+
+void testReplaysOnceDue() {
+  scheduler->schedule(4, 1000);
+  TEST_ASSERT_FALSE(scheduler->hasDueReplays(999));
+  TEST_ASSERT_EQUAL(-1, scheduler->nextReplay(idleBus(999)));
+  TEST_ASSERT_TRUE(scheduler->hasDueReplays(1000));
+  TEST_ASSERT_EQUAL(4, scheduler->nextReplay(idleBus(1000)));
+  TEST_ASSERT_FALSE(scheduler->hasDueReplays(1000));
+}
+
+void testLivePacketCancelsDueReplay() {
+  scheduler->schedule(4, 1000);
+  BusState bus = idleBus(1000);
+  bus.mid_packet = true;
+  TEST_ASSERT_EQUAL(-1, scheduler->nextReplay(bus));
+  scheduler->schedule(4, 4000);
+  TEST_ASSERT_EQUAL(-1, scheduler->nextReplay(idleBus(1001)));
+}
+
+void testStatusAndSocGoFirstAndAreSpread() {
+  scheduler->schedule(8, 100);
+  scheduler->schedule(4, 200);
+  scheduler->schedule(3, 300);
+  scheduler->schedule(0, 400);
+  const unsigned long spacing = TxScheduler::REPLAY_SPACING_MILLIS;
+  unsigned long now = 1000;
+  TEST_ASSERT_EQUAL(0, scheduler->nextReplay(idleBus(now)));
+  TEST_ASSERT_EQUAL(-1, scheduler->nextReplay(idleBus(now + spacing - 1)));
+  now += spacing;
+  TEST_ASSERT_EQUAL(3, scheduler->nextReplay(idleBus(now)));
+  now += spacing;
+  TEST_ASSERT_EQUAL(4, scheduler->nextReplay(idleBus(now)));
+  now += spacing;
+  TEST_ASSERT_EQUAL(8, scheduler->nextReplay(idleBus(now)));
+  now += spacing;
+  TEST_ASSERT_EQUAL(-1, scheduler->nextReplay(idleBus(now)));
+}
+
+void testWaitsForQuietBus() {
+  scheduler->schedule(3, 100);
+  BusState bus = idleBus(100);
+  bus.quiet_millis = TxScheduler::MIN_QUIET_MILLIS - 1;
+  TEST_ASSERT_EQUAL(-1, scheduler->nextReplay(bus));
+  bus.quiet_millis = TxScheduler::MIN_QUIET_MILLIS;
+  TEST_ASSERT_EQUAL(3, scheduler->nextReplay(bus));
+}
+
+void testWaitsForGapBeforeNextPacket() {
+  // 38 bytes take 3.3ms on the line, plus a millisecond of margin.
+  scheduler->schedule(2, 100);
+  BusState bus = idleBus(100);
+  bus.millis_until_next_packet = 4;
+  TEST_ASSERT_EQUAL(-1, scheduler->nextReplay(bus));
+  bus.millis_until_next_packet = 5;
+  TEST_ASSERT_EQUAL(2, scheduler->nextReplay(bus));
+}
+
+void testOverdueReplayStopsWaitingForGap() {
+  scheduler->schedule(2, 100);
+  BusState bus = idleBus(100 + TxScheduler::MAX_REPLAY_DELAY_MILLIS - 1);
+  bus.millis_until_next_packet = 0;
+  TEST_ASSERT_EQUAL(-1, scheduler->nextReplay(bus));
+  bus.now_millis++;
+  TEST_ASSERT_EQUAL(2, scheduler->nextReplay(bus));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testReplaysOnceDue);
+  RUN_TEST(testLivePacketCancelsDueReplay);
+  RUN_TEST(testStatusAndSocGoFirstAndAreSpread);
+  RUN_TEST(testWaitsForQuietBus);
+  RUN_TEST(testWaitsForGapBeforeNextPacket);
+  RUN_TEST(testOverdueReplayStopsWaitingForGap);
+  return UNITY_END();
+}
@@ -0,0 +1,50 @@
+#include "workload.h"
+
+#include <unity.h>
+
+void setUp(void) {}
+
+void testChunksFollowWireTiming() {
+  Workload workload;
+  const std::vector<uint8_t> data(70, 0xAB);
+  workload.addBytes(data);
+  TEST_ASSERT_EQUAL(70, workload.bytes.size());
+  TEST_ASSERT_EQUAL(3, workload.chunks.size());
+  TEST_ASSERT_EQUAL(32, workload.chunks[0].len);
+  TEST_ASSERT_EQUAL(32 * WIRE_BYTE_MICROS, workload.chunks[0].micros);
+  TEST_ASSERT_EQUAL(6, workload.chunks[2].len);
+  TEST_ASSERT_EQUAL(70 * WIRE_BYTE_MICROS, workload.endMicros());
+  workload.addIdle(5000);
+  TEST_ASSERT_EQUAL(8, workload.chunks.size());
+  TEST_ASSERT_EQUAL(0, workload.chunks.back().len);
+  TEST_ASSERT_EQUAL(70 * WIRE_BYTE_MICROS + 5000, workload.endMicros());
+}
+
+uint32_t chunkBytes(const Workload& workload) {
+  uint32_t total = 0;
+  for (const Workload::Chunk& chunk : workload.chunks) {
+    total += chunk.len;
+  }
+  return total;
+}
+
+void testGeneratorsAreConsistentAndReproducible() {
+  for (const Workload& workload :
+       {cleanTrafficWorkload(10000), heavyGarbageWorkload(10000),
+        crcFailureWorkload(10000), replayIdleWorkload(2)}) {
+    TEST_ASSERT_EQUAL(workload.bytes.size(), chunkBytes(workload));
+  }
+  TEST_ASSERT_TRUE(heavyGarbageWorkload(10000, 7).bytes ==
+                   heavyGarbageWorkload(10000, 7).bytes);
+  TEST_ASSERT_FALSE(heavyGarbageWorkload(10000, 7).bytes ==
+                    heavyGarbageWorkload(10000, 8).bytes);
+  // Eleven seconds per cycle.
+  TEST_ASSERT_EQUAL(22000000, replayIdleWorkload(2).endMicros());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(testChunksFollowWireTiming);
+  RUN_TEST(testGeneratorsAreConsistentAndReproducible);
+  return UNITY_END();
+}